@@ -19,47 +19,674 @@
 
 #include "cameraparams.h"
 #include <string>
-#include <iostream>
-#include <sstream>
-#include <map>
 #include <vector>
+#include <tr1/unordered_set>
+#include <algorithm>
+#include <iostream>
 #include <cstring>
 #include <cstdlib>
-#include "gstdroidcamsrc.h"
+#include <cstdio>
+#include <cstddef>
 
 G_BEGIN_DECLS;
 
+/*
+ * The HAL hands us one string of the form "key1=value1;key2=value2;..."
+ * We copy it once into an arena chunk and tokenize it in place, replacing
+ * the separators with NUL so every key and value is a C string pointing
+ * into the copy. Values stored later by camera_params_set() are appended
+ * to the arena as well. Strings are never modified once they are in the
+ * arena; replaced values are abandoned until the arena gets compacted.
+ *
+ * Copies made by camera_params_copy () share the arena, which is why it
+ * is refcounted. Only the newest copy may append to it.
+ */
+#define CAMERA_PARAMS_ARENA_CHUNK_SIZE 4096
+
+struct camera_params_arena
+{
+  gint refcount;
+  std::vector < char *>chunks;
+  char *pos;
+  size_t left;
+};
+
+struct camera_params_entry
+{
+  const char *key;
+  const char *value;
+  size_t key_len;
+  size_t value_len;
+
+  /* where the value starts in the serialized string */
+  size_t offset;
+
+  /* changed since camera_params_clear_dirty () */
+  bool dirty;
+
+  /* camera_params_refresh () run which saw the key last */
+  unsigned refresh;
+};
+
+/* A key which is not NUL terminated */
+struct camera_params_key_ref
+{
+  const char *key;
+  size_t len;
+};
+
+struct camera_params_entry_less
+{
+  bool operator () (const camera_params_entry & a,
+      const camera_params_entry & b) const
+  {
+    return strcmp (a.key, b.key) < 0;
+  }
+  bool operator () (const camera_params_entry & a, const char *key) const
+  {
+    return strcmp (a.key, key) < 0;
+  }
+  bool operator () (const camera_params_entry & a,
+      const camera_params_key_ref & b) const
+  {
+    return strncmp (a.key, b.key, b.len) < 0;
+  }
+};
+
+struct camera_params_entry_equal
+{
+  bool operator () (const camera_params_entry & a,
+      const camera_params_entry & b) const
+  {
+    return strcmp (a.key, b.key) == 0;
+  }
+};
+
+/* Indexed by CameraParamKey */
+static const char *const camera_params_key_names[] = {
+  "zoom",
+  "max-zoom",
+  "flash-mode",
+  "focus-mode",
+  "whitebalance",
+  "iso",
+  "exposure-compensation",
+  "min-exposure-compensation",
+  "max-exposure-compensation",
+  "focus-areas",
+  "metering-areas",
+  "max-num-focus-areas",
+  "max-num-metering-areas",
+  "preview-size",
+  "preview-frame-rate",
+  "preview-fps-range",
+  "picture-size",
+  "video-size",
+  "denoise",
+  "recording-hint",
+};
+
+/* Breaks the build if the table and CameraParamKey get out of sync */
+typedef char camera_params_key_names_check[(sizeof (camera_params_key_names)
+        / sizeof (camera_params_key_names[0]) == CAMERA_PARAM_LAST) ? 1 : -1];
+
+/* CAMERA_PARAM_MASK_OTHER needs a bit too */
+typedef char camera_params_mask_check[(CAMERA_PARAM_LAST < 32) ? 1 : -1];
+
+/*
+ * Where the HAL advertises what it accepts for a CameraParamKey: either
+ * a "*-values" list or an integer range. A missing min defaults to 0.
+ */
+struct camera_params_constraint
+{
+  const char *values;
+  const char *min;
+  const char *max;
+};
+
+/* Indexed by CameraParamKey */
+static const camera_params_constraint camera_params_constraints[] = {
+  {NULL, NULL, "max-zoom"},
+  {NULL, NULL, NULL},
+  {"flash-mode-values", NULL, NULL},
+  {"focus-mode-values", NULL, NULL},
+  {"whitebalance-values", NULL, NULL},
+  {"iso-values", NULL, NULL},
+  {NULL, "min-exposure-compensation", "max-exposure-compensation"},
+  {NULL, NULL, NULL},
+  {NULL, NULL, NULL},
+  {NULL, NULL, NULL},
+  {NULL, NULL, NULL},
+  {NULL, NULL, NULL},
+  {NULL, NULL, NULL},
+  {"preview-size-values", NULL, NULL},
+  {"preview-frame-rate-values", NULL, NULL},
+  /* checked by camera_params_set_viewfinder_fps_range () */
+  {NULL, NULL, NULL},
+  {"picture-size-values", NULL, NULL},
+  {"video-size-values", NULL, NULL},
+  {"denoise-values", NULL, NULL},
+  {NULL, NULL, NULL},
+};
+
+typedef char camera_params_constraints_check[(sizeof
+        (camera_params_constraints) / sizeof (camera_params_constraints[0])
+        == CAMERA_PARAM_LAST) ? 1 : -1];
+
+struct camera_params_limit
+{
+  bool has_values;
+  std::tr1::unordered_set < std::string > values;
+  bool has_range;
+  int min;
+  int max;
+};
+
+/*
+ * The constraints found in one parameter string. It is built once and
+ * shared by all copies until one of the keys it was built from changes.
+ */
+struct camera_params_limits
+{
+  gint refcount;
+  camera_params_limit keys[CAMERA_PARAM_LAST];
+};
+
+/*
+ * Value of a CameraParamKey, parsed the first time it is asked for.
+ * value points into the arena and identifies the entry the slot was
+ * filled from so camera_params_set () knows which slot to drop.
+ */
+struct camera_params_slot
+{
+  bool parsed;
+  const char *value;            /* NULL if the key is not there */
+  int int_value;
+  float float_value;
+};
+
+/* A parsed "*-values" list: fps, width, height pairs or min, max fps pairs */
+struct camera_params_table
+{
+  bool valid;
+  bool present;
+  std::vector < int >values;
+};
+
 struct camera_params
 {
-  std::map < std::string, std::vector < std::string > >items;
+  gint refcount;
+
+  camera_params_arena *arena;
+
+  /* sorted by key */
+  std::vector < camera_params_entry > entries;
+
+  /* bytes held by values which have been replaced */
+  size_t wasted;
+
+  /* number of dirty entries */
+  unsigned dirty;
+
+  /* number of camera_params_refresh () runs */
+  unsigned refreshes;
+
+  /*
+   * What we hand to set_parameters (). Values of existing keys are
+   * replaced in place, adding a key forces a rebuild.
+   */
+  std::string serialized;
+  bool serialized_valid;
+
+  /*
+   * Parsed "*-values" lists and the caps built out of them. They stay
+   * around until one of the keys they depend on changes.
+   */
+  camera_params_table preview_sizes;
+  camera_params_table picture_sizes;
+  camera_params_table video_sizes;
+  camera_params_table fps;
+  camera_params_table fps_ranges;
+  GstCaps *viewfinder_caps;
+  GstCaps *capture_caps;
+  GstCaps *video_caps;
+
+  camera_params_limits *limits;
+
+  camera_params_slot slots[CAMERA_PARAM_LAST];
 };
 
+typedef std::vector < camera_params_entry >::iterator camera_params_iter;
+
+/* Drops the slot filled from value, NULL drops all of them */
+static void
+camera_params_invalidate_slots (struct camera_params *params,
+    const char *value)
+{
+  for (int x = 0; x < CAMERA_PARAM_LAST; x++) {
+    if (!value || params->slots[x].value == value) {
+      params->slots[x].parsed = false;
+    }
+  }
+}
+
+static void
+camera_params_arena_add_chunk (camera_params_arena * arena, size_t size)
+{
+  char *chunk = (char *) g_malloc (size);
+
+  arena->chunks.push_back (chunk);
+  arena->pos = chunk;
+  arena->left = size;
+}
+
+static camera_params_arena *
+camera_params_arena_new (size_t size)
+{
+  camera_params_arena *arena = new camera_params_arena;
+
+  arena->refcount = 1;
+  camera_params_arena_add_chunk (arena, size);
+
+  return arena;
+}
+
+static camera_params_arena *
+camera_params_arena_ref (camera_params_arena * arena)
+{
+  g_atomic_int_inc (&arena->refcount);
+
+  return arena;
+}
+
+static void
+camera_params_arena_unref (camera_params_arena * arena)
+{
+  if (!arena || !g_atomic_int_dec_and_test (&arena->refcount)) {
+    return;
+  }
+
+  for (unsigned x = 0; x < arena->chunks.size (); x++) {
+    g_free (arena->chunks[x]);
+  }
+
+  delete arena;
+}
+
+static char *
+camera_params_arena_strdup (camera_params_arena * arena, const char *str,
+    size_t len)
+{
+  char *ret;
+
+  if (len + 1 > arena->left) {
+    camera_params_arena_add_chunk (arena,
+        std::max (len + 1, (size_t) CAMERA_PARAMS_ARENA_CHUNK_SIZE));
+  }
+
+  ret = arena->pos;
+  memcpy (ret, str, len);
+  ret[len] = '\0';
+
+  arena->pos += len + 1;
+  arena->left -= len + 1;
+
+  return ret;
+}
+
+static void
+camera_params_tokenize (struct camera_params *params, char *str)
+{
+  char *key = str;
+  char *value = NULL;
+
+  for (char *p = str;; p++) {
+    char c = *p;
+
+    if (c == '=' && !value) {
+      *p = '\0';
+      value = p + 1;
+    } else if (c == ';' || c == '\0') {
+      *p = '\0';
+
+      /* items without a value are dropped */
+      if (value && value != p) {
+        camera_params_entry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.key_len = value - key - 1;
+        entry.value_len = p - value;
+        entry.offset = 0;
+        entry.dirty = false;
+        entry.refresh = 0;
+        params->entries.push_back (entry);
+      }
+
+      if (c == '\0') {
+        break;
+      }
+
+      key = p + 1;
+      value = NULL;
+    }
+  }
+
+  /* Android flattens its parameters sorted by key already */
+  for (camera_params_iter iter = params->entries.begin ();
+      iter + 1 < params->entries.end (); iter++) {
+    if (strcmp (iter->key, (iter + 1)->key) > 0) {
+      /* The first occurrence of a key wins */
+      std::stable_sort (params->entries.begin (), params->entries.end (),
+          camera_params_entry_less ());
+      break;
+    }
+  }
+
+  params->entries.erase (std::unique (params->entries.begin (),
+          params->entries.end (), camera_params_entry_equal ()),
+      params->entries.end ());
+}
+
+static camera_params_entry *
+camera_params_find (struct camera_params *params, const char *key)
+{
+  camera_params_iter iter =
+      std::lower_bound (params->entries.begin (), params->entries.end (), key,
+      camera_params_entry_less ());
+
+  if (iter == params->entries.end () || strcmp (iter->key, key)) {
+    return NULL;
+  }
+
+  return &*iter;
+}
+
+static void
+camera_params_compact (struct camera_params *params)
+{
+  camera_params_arena *arena;
+  size_t size = CAMERA_PARAMS_ARENA_CHUNK_SIZE;
+
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    size += iter->key_len + iter->value_len + 2;
+  }
+
+  arena = camera_params_arena_new (size);
+
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    iter->key = camera_params_arena_strdup (arena, iter->key, iter->key_len);
+    iter->value =
+        camera_params_arena_strdup (arena, iter->value, iter->value_len);
+  }
+
+  camera_params_arena_unref (params->arena);
+  params->arena = arena;
+  params->wasted = 0;
+
+  /* all values moved */
+  camera_params_invalidate_slots (params, NULL);
+}
+
+static void
+camera_params_invalidate_caps (GstCaps ** caps)
+{
+  if (*caps) {
+    gst_caps_unref (*caps);
+    *caps = NULL;
+  }
+}
+
+static void
+camera_params_limits_unref (camera_params_limits * limits)
+{
+  if (limits && g_atomic_int_dec_and_test (&limits->refcount)) {
+    delete limits;
+  }
+}
+
+/* "*-values", "min-*" and "max-*" keys are what limits are made of */
 static bool
-camera_params_get_fps_list (struct camera_params *params, GValue& output)
+camera_params_is_limit_key (const char *key)
 {
-  std::map < std::string, std::vector < std::string > >::iterator fps_iter =
-    params->items.find ("preview-frame-rate-values");
+  size_t len = strlen (key);
 
-  if (fps_iter == params->items.end()) {
-    return false;
+  return !strncmp (key, "min-", 4) || !strncmp (key, "max-", 4)
+      || (len > 7 && !strcmp (key + len - 7, "-values"));
+}
+
+/* Drops whatever has been built out of key, NULL means everything */
+static void
+camera_params_invalidate (struct camera_params *params, const char *key)
+{
+  if (!key || camera_params_is_limit_key (key)) {
+    camera_params_limits_unref (params->limits);
+    params->limits = NULL;
+  }
+
+  if (!key || !strcmp (key, "preview-size-values")) {
+    params->preview_sizes.valid = false;
+    camera_params_invalidate_caps (&params->viewfinder_caps);
+  }
+
+  if (!key || !strcmp (key, "preview-frame-rate-values")) {
+    params->fps.valid = false;
+    camera_params_invalidate_caps (&params->viewfinder_caps);
+    camera_params_invalidate_caps (&params->video_caps);
+  }
+
+  if (!key || !strcmp (key, "preview-fps-range-values")) {
+    params->fps_ranges.valid = false;
+    camera_params_invalidate_caps (&params->viewfinder_caps);
+  }
+
+  if (!key || !strcmp (key, "picture-size-values")) {
+    params->picture_sizes.valid = false;
+    camera_params_invalidate_caps (&params->capture_caps);
+  }
+
+  if (!key || !strcmp (key, "video-size-values")) {
+    params->video_sizes.valid = false;
+    camera_params_invalidate_caps (&params->video_caps);
+  }
+}
+
+static const camera_params_table &
+camera_params_get_fps (struct camera_params *params)
+{
+  camera_params_table & table = params->fps;
+
+  if (table.valid) {
+    return table;
   }
 
-  for (std::vector < std::string >::iterator fps = fps_iter->second.begin ();
-       fps != fps_iter->second.end (); fps++) {
+  camera_params_entry *entry =
+      camera_params_find (params, "preview-frame-rate-values");
 
-    int f = atoi ((*fps).c_str ());
+  table.valid = true;
+  table.present = entry != NULL;
+  table.values.clear ();
+
+  if (!entry) {
+    return table;
+  }
+
+  for (const char *fps = entry->value; fps; fps = strchr (fps, ',')) {
+    if (*fps == ',') {
+      fps++;
+    }
+
+    int f = atoi (fps);
 
     if (!f) {
       continue;
     }
 
+    table.values.push_back (f);
+  }
+
+  return table;
+}
+
+/* Parses "(min,max),(min,max)", skipping the malformed items */
+static const camera_params_table &
+camera_params_get_fps_ranges (struct camera_params *params)
+{
+  camera_params_table & table = params->fps_ranges;
+
+  if (table.valid) {
+    return table;
+  }
+
+  camera_params_entry *entry =
+      camera_params_find (params, "preview-fps-range-values");
+
+  table.valid = true;
+  table.present = entry != NULL;
+  table.values.clear ();
+
+  if (!entry) {
+    return table;
+  }
+
+  for (const char *range = strchr (entry->value, '('); range;
+      range = strchr (range, '(')) {
+    char *end;
+
+    int min = strtol (++range, &end, 10);
+
+    if (*end != ',') {
+      continue;
+    }
+
+    int max = strtol (end + 1, &end, 10);
+
+    if (*end != ')') {
+      continue;
+    }
+
+    if (min <= 0 || max < min) {
+      continue;
+    }
+
+    table.values.push_back (min);
+    table.values.push_back (max);
+  }
+
+  return table;
+}
+
+/* Parses a list of "WxH" items, skipping the malformed ones */
+static const camera_params_table &
+camera_params_get_sizes (struct camera_params *params, const char *key,
+    camera_params_table & table)
+{
+  if (table.valid) {
+    return table;
+  }
+
+  camera_params_entry *entry = camera_params_find (params, key);
+
+  table.valid = true;
+  table.present = entry != NULL;
+  table.values.clear ();
+
+  if (!entry) {
+    return table;
+  }
+
+  for (const char *size = entry->value; size; size = strchr (size, ',')) {
+    char *end;
+
+    if (*size == ',') {
+      size++;
+    }
+
+    int width = strtol (size, &end, 10);
+
+    if (*end != 'x') {
+      continue;
+    }
+
+    int height = strtol (end + 1, &end, 10);
+
+    if (*end != ',' && *end != '\0') {
+      continue;
+    }
+
+    if (!width || !height) {
+      continue;
+    }
+
+    table.values.push_back (width);
+    table.values.push_back (height);
+  }
+
+  return table;
+}
+
+/*
+ * ranges is optional. Fixed ranges show up as plain frame rates unless
+ * fps already lists them.
+ */
+static GstCaps *
+camera_params_build_caps (const camera_params_table & sizes,
+    const camera_params_table & fps, const camera_params_table * ranges,
+    const char *name)
+{
+  GstCaps *caps = gst_caps_new_empty ();
+  bool has_ranges = ranges && ranges->present && !ranges->values.empty ();
+
+  if (!sizes.present || (!fps.present && !has_ranges)) {
+    return caps;
+  }
+
+  GValue fps_list = G_VALUE_INIT;
+  g_value_init (&fps_list, GST_TYPE_LIST);
+
+  for (unsigned x = 0; x < fps.values.size (); x++) {
     GValue val = G_VALUE_INIT;
     g_value_init (&val, GST_TYPE_FRACTION);
-    gst_value_set_fraction (&val, f, 1);
-    gst_value_list_append_value (&output, &val);
+    gst_value_set_fraction (&val, fps.values[x], 1);
+    gst_value_list_append_value (&fps_list, &val);
   }
 
-  return true;
+  for (unsigned x = 0; has_ranges && x < ranges->values.size (); x += 2) {
+    int min = ranges->values[x];
+    int max = ranges->values[x + 1];
+    GValue val = G_VALUE_INIT;
+
+    if (min == max) {
+      if (max % 1000 == 0 && std::find (fps.values.begin (),
+              fps.values.end (), max / 1000) != fps.values.end ()) {
+        continue;
+      }
+
+      g_value_init (&val, GST_TYPE_FRACTION);
+      gst_value_set_fraction (&val, max, 1000);
+    } else {
+      g_value_init (&val, GST_TYPE_FRACTION_RANGE);
+      gst_value_set_fraction_range_full (&val, min, 1000, max, 1000);
+    }
+
+    gst_value_list_append_value (&fps_list, &val);
+    g_value_unset (&val);
+  }
+
+  for (unsigned x = 0; x < sizes.values.size (); x += 2) {
+    GstStructure *s = gst_structure_new (name,
+        "width", G_TYPE_INT, sizes.values[x],
+        "height", G_TYPE_INT, sizes.values[x + 1],
+        NULL);
+
+    gst_structure_set_value (s, "framerate", &fps_list);
+    gst_caps_append_structure (caps, s);
+  }
+
+  g_value_unset (&fps_list);
+
+  return caps;
 }
 
 struct camera_params *
@@ -67,6 +694,23 @@ camera_params_from_string (const char *str)
 {
   struct camera_params *params = new struct camera_params;
 
+  params->refcount = 1;
+  params->arena = NULL;
+  params->wasted = 0;
+  params->dirty = 0;
+  params->refreshes = 0;
+  params->serialized_valid = false;
+  params->preview_sizes.valid = false;
+  params->picture_sizes.valid = false;
+  params->video_sizes.valid = false;
+  params->fps.valid = false;
+  params->fps_ranges.valid = false;
+  params->viewfinder_caps = NULL;
+  params->capture_caps = NULL;
+  params->video_caps = NULL;
+  params->limits = NULL;
+  camera_params_invalidate_slots (params, NULL);
+
   camera_params_update (params, str);
 
   return params;
@@ -75,311 +719,680 @@ camera_params_from_string (const char *str)
 void
 camera_params_update (struct camera_params *params, const char *str)
 {
-  std::string s (str);
+  size_t len = strlen (str);
+  char *copy;
+
+  camera_params_arena_unref (params->arena);
+  params->entries.clear ();
+  params->wasted = 0;
+  params->dirty = 0;
+  params->serialized_valid = false;
+  camera_params_invalidate (params, NULL);
+  camera_params_invalidate_slots (params, NULL);
+
+  /* Leave room for the values we will set later on */
+  params->arena = camera_params_arena_new (len + 1 +
+      CAMERA_PARAMS_ARENA_CHUNK_SIZE);
+  copy = camera_params_arena_strdup (params->arena, str, len);
+  params->entries.reserve (std::count (copy, copy + len, ';') + 1);
+
+  camera_params_tokenize (params, copy);
+}
 
-  std::stringstream stream;
-  stream.str (s);
-  std::string item;
-  std::map < std::string, std::vector < std::string > >items;
+/*
+ * The copy shares the arena and the cached caps with params. Once a copy
+ * has been made params itself must not be modified anymore.
+ */
+struct camera_params *
+camera_params_copy (struct camera_params *params)
+{
+  struct camera_params *copy = new struct camera_params (*params);
 
-  while (getline (stream, item, ';')) {
-    std::string key, value;
-    std::vector < std::string > values;
-    std::stringstream i (item);
+  copy->refcount = 1;
+  camera_params_arena_ref (copy->arena);
 
-    if (!getline (i, key, '=')) {
-      continue;
-    }
+  if (copy->viewfinder_caps) {
+    gst_caps_ref (copy->viewfinder_caps);
+  }
 
-    while (getline (i, value, ',')) {
-      values.push_back (value);
-    }
+  if (copy->capture_caps) {
+    gst_caps_ref (copy->capture_caps);
+  }
 
-    if (values.size () == 0) {
-      continue;
-    }
+  if (copy->video_caps) {
+    gst_caps_ref (copy->video_caps);
+  }
 
-    items.insert (std::pair < std::string, std::vector < std::string > >(key,
-            values));
+  if (copy->limits) {
+    g_atomic_int_inc (&copy->limits->refcount);
   }
 
-  params->items = items;
+  return copy;
+}
+
+struct camera_params *
+camera_params_ref (struct camera_params *params)
+{
+  g_atomic_int_inc (&params->refcount);
+
+  return params;
 }
 
 void
-camera_params_free (struct camera_params *params)
+camera_params_unref (struct camera_params *params)
 {
+  if (!g_atomic_int_dec_and_test (&params->refcount)) {
+    return;
+  }
+
+  camera_params_arena_unref (params->arena);
+  camera_params_invalidate (params, NULL);
+
   delete params;
 }
 
 void
-to_stream (struct camera_params *params, std::stringstream & stream, char sep)
+camera_params_free (struct camera_params *params)
 {
-  std::map < std::string, std::vector < std::string > >::iterator end =
-      params->items.end ();
-  --end;
+  camera_params_unref (params);
+}
 
-  for (std::map < std::string, std::vector < std::string > >::iterator iter =
-      params->items.begin (); iter != params->items.end (); iter++) {
+static void
+camera_params_serialize (struct camera_params *params)
+{
+  size_t len = 0;
 
-    stream << iter->first << "=";
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    len += iter->key_len + iter->value_len + 2;
+  }
 
-    for (unsigned x = 0; x < iter->second.size (); x++) {
-      if (x != 0) {
-        stream << ",";
-      }
+  params->serialized.clear ();
+  params->serialized.reserve (len);
 
-      stream << iter->second[x];
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    if (iter != params->entries.begin ()) {
+      params->serialized += ';';
     }
 
-    if (iter != end) {
-      stream << sep;
-    }
+    params->serialized.append (iter->key, iter->key_len);
+    params->serialized += '=';
+    iter->offset = params->serialized.size ();
+    params->serialized.append (iter->value, iter->value_len);
   }
+
+  params->serialized_valid = true;
 }
 
 char *
 camera_params_to_string (struct camera_params *params)
 {
-  std::stringstream s;
-
-  to_stream (params, s, ';');
+  if (!params->serialized_valid) {
+    camera_params_serialize (params);
+  }
 
-  return strdup (s.str ().c_str ());
+  return strdup (params->serialized.c_str ());
 }
 
 void
 camera_params_dump (struct camera_params *params)
 {
-  std::stringstream s;
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    std::cout << iter->key << "=" << iter->value << std::endl;
+  }
+}
+
+gboolean
+camera_params_is_dirty (struct camera_params *params)
+{
+  return params->dirty != 0;
+}
+
+void
+camera_params_clear_dirty (struct camera_params *params)
+{
+  if (!params->dirty) {
+    return;
+  }
+
+  for (camera_params_iter iter = params->entries.begin ();
+      iter != params->entries.end (); iter++) {
+    iter->dirty = false;
+  }
+
+  params->dirty = 0;
+}
+
+/* Adds key in front of iter. The caller stores the value */
+static camera_params_iter
+camera_params_insert (struct camera_params *params, camera_params_iter iter,
+    const char *key, size_t key_len)
+{
+  camera_params_entry entry;
+
+  entry.key = camera_params_arena_strdup (params->arena, key, key_len);
+  entry.key_len = key_len;
+  entry.value = NULL;
+  entry.value_len = 0;
+  entry.offset = 0;
+  entry.dirty = false;
+  entry.refresh = 0;
+
+  params->serialized_valid = false;
 
-  to_stream (params, s, '\n');
+  /* New keys are rare. Simply reparse all slots */
+  camera_params_invalidate_slots (params, NULL);
 
-  std::cout << s.str () << std::endl;
+  return params->entries.insert (iter, entry);
+}
+
+static void
+camera_params_store (struct camera_params *params, camera_params_iter iter,
+    const char *val, size_t len)
+{
+  if (iter->value) {
+    if (params->serialized_valid) {
+      ptrdiff_t delta = (ptrdiff_t) len - (ptrdiff_t) iter->value_len;
+
+      params->serialized.replace (iter->offset, iter->value_len, val, len);
+
+      for (camera_params_iter next = iter + 1;
+          next != params->entries.end (); next++) {
+        next->offset += delta;
+      }
+    }
+
+    camera_params_invalidate_slots (params, iter->value);
+    params->wasted += iter->value_len + 1;
+  }
+
+  iter->value = camera_params_arena_strdup (params->arena, val, len);
+  iter->value_len = len;
+
+  camera_params_invalidate (params, iter->key);
 }
 
 void
 camera_params_set (struct camera_params *params, const char *key,
     const char *val)
 {
-  std::vector < std::string > values;
+  size_t len = strlen (val);
+  camera_params_iter iter =
+      std::lower_bound (params->entries.begin (), params->entries.end (), key,
+      camera_params_entry_less ());
+
+  if (iter != params->entries.end () && !strcmp (iter->key, key)) {
+    if (iter->value_len == len && !memcmp (iter->value, val, len)) {
+      /* nothing to do */
+      return;
+    }
+  } else {
+    iter = camera_params_insert (params, iter, key, strlen (key));
+  }
 
-  values.push_back (val);
+  camera_params_store (params, iter, val, len);
 
-  std::map < std::string, std::vector < std::string > >::iterator iter =
-      params->items.find (key);
-  if (iter != params->items.end ()) {
-    params->items.erase (iter);
+  if (!iter->dirty) {
+    iter->dirty = true;
+    params->dirty++;
   }
 
-  params->items.insert (std::pair < std::string,
-      std::vector < std::string > >(key, values));
+  if (params->wasted > CAMERA_PARAMS_ARENA_CHUNK_SIZE) {
+    camera_params_compact (params);
+  }
 }
 
-GstCaps *
-camera_params_get_viewfinder_caps (struct camera_params *params)
+static guint32
+camera_params_key_mask (const char *key)
 {
-  GValue fps_list = G_VALUE_INIT;
-  g_value_init (&fps_list, GST_TYPE_LIST);
+  for (int x = 0; x < CAMERA_PARAM_LAST; x++) {
+    if (!strcmp (camera_params_key_names[x], key)) {
+      return CAMERA_PARAM_MASK (x);
+    }
+  }
 
-  std::map < std::string, std::vector < std::string > >::iterator sizes =
-      params->items.find ("preview-size-values");
+  return CAMERA_PARAM_MASK_OTHER;
+}
 
-  if (sizes == params->items.end () || !camera_params_get_fps_list (params, fps_list)) {
-    return gst_caps_new_empty ();
-  }
+/*
+ * Merges a parameter string fetched from the HAL into params without
+ * reparsing it as a whole. Values we have not handed to the HAL yet win.
+ * Keys missing from str are kept. Only what depends on a changed key
+ * gets dropped, everything else stays parsed.
+ */
+guint32
+camera_params_refresh (struct camera_params *params, const char *str)
+{
+  guint32 changed = 0;
+  const char *next;
 
-  GstCaps *caps = gst_caps_new_empty ();
+  params->refreshes++;
 
-  for (std::vector < std::string >::iterator size = sizes->second.begin ();
-      size != sizes->second.end (); size++) {
-    std::stringstream stream;
-    stream.str (*size);
-    std::vector < std::string > d;
-    std::string item;
+  for (const char *key = str; *key; key = next) {
+    const char *end = strchr (key, ';');
 
-    while (getline (stream, item, 'x')) {
-      d.push_back (item);
+    if (!end) {
+      end = key + strlen (key);
     }
 
-    if (d.size () != 2) {
+    next = *end ? end + 1 : end;
+
+    const char *value = (const char *) memchr (key, '=', end - key);
+
+    /* items without a value are dropped */
+    if (!value || value + 1 == end) {
       continue;
     }
 
-    int width = atoi (d[0].c_str ());
-    int height = atoi (d[1].c_str ());
+    camera_params_key_ref ref = { key, (size_t) (value - key) };
+    size_t len = end - ++value;
+    camera_params_iter iter =
+        std::lower_bound (params->entries.begin (), params->entries.end (),
+        ref, camera_params_entry_less ());
+
+    if (iter != params->entries.end () && !strncmp (iter->key, key, ref.len)
+        && iter->key[ref.len] == '\0') {
+      /* The first occurrence of a key wins like in camera_params_tokenize () */
+      if (iter->refresh == params->refreshes) {
+        continue;
+      }
 
-    if (!width || !height) {
-      continue;
+      iter->refresh = params->refreshes;
+
+      if (iter->dirty) {
+        continue;
+      }
+
+      if (iter->value_len == len && !memcmp (iter->value, value, len)) {
+        continue;
+      }
+    } else {
+      iter = camera_params_insert (params, iter, key, ref.len);
+      iter->refresh = params->refreshes;
     }
 
-    // TODO: hardcoded
-    GstStructure *s = gst_structure_new ("video/x-android-buffer",
-					 "width", G_TYPE_INT, width,
-					 "height", G_TYPE_INT, height,
-					 NULL);
+    camera_params_store (params, iter, value, len);
+    changed |= camera_params_key_mask (iter->key);
+  }
 
-    gst_structure_set_value (s, "framerate", &fps_list);
-    gst_caps_append_structure (caps, s);
+  if (params->wasted > CAMERA_PARAMS_ARENA_CHUNK_SIZE) {
+    camera_params_compact (params);
   }
 
-  return caps;
+  return changed;
 }
 
 GstCaps *
-camera_params_get_capture_caps (struct camera_params * params)
+camera_params_get_viewfinder_caps (struct camera_params *params)
 {
-  std::map < std::string, std::vector < std::string > >::iterator sizes =
-      params->items.find ("picture-size-values");
-
-  if (sizes == params->items.end ()) {
-    return gst_caps_new_empty ();
+  if (!params->viewfinder_caps) {
+    // TODO: hardcoded
+    params->viewfinder_caps =
+        camera_params_build_caps (camera_params_get_sizes (params,
+            "preview-size-values", params->preview_sizes),
+        camera_params_get_fps (params), &camera_params_get_fps_ranges (params),
+        "video/x-android-buffer");
   }
 
-  GstCaps *caps = gst_caps_new_empty ();
+  return gst_caps_ref (params->viewfinder_caps);
+}
 
-  for (std::vector < std::string >::iterator size = sizes->second.begin ();
-      size != sizes->second.end (); size++) {
-    std::stringstream stream;
-    stream.str (*size);
-    std::vector < std::string > d;
-    std::string item;
+GstCaps *
+camera_params_get_capture_caps (struct camera_params * params)
+{
+  if (params->capture_caps) {
+    return gst_caps_ref (params->capture_caps);
+  }
 
-    while (getline (stream, item, 'x')) {
-      d.push_back (item);
-    }
+  const camera_params_table & sizes =
+      camera_params_get_sizes (params, "picture-size-values",
+      params->picture_sizes);
 
-    if (d.size () != 2) {
-      continue;
-    }
-
-    int width = atoi (d[0].c_str ());
-    int height = atoi (d[1].c_str ());
+  params->capture_caps = gst_caps_new_empty ();
 
-    if (!width || !height) {
-      continue;
-    }
+  for (unsigned x = 0; x < sizes.values.size (); x += 2) {
     // TODO: hardcoded structure name
     // TODO: what to set framerate to ?
     GstStructure *s = gst_structure_new ("image/jpeg",
-        "width", G_TYPE_INT, width,
-        "height", G_TYPE_INT, height,
+        "width", G_TYPE_INT, sizes.values[x],
+        "height", G_TYPE_INT, sizes.values[x + 1],
         "framerate", GST_TYPE_FRACTION, 30, 1,
         NULL);
 
-    gst_caps_append_structure (caps, s);
+    gst_caps_append_structure (params->capture_caps, s);
   }
 
-  gst_caps_do_simplify (caps);
+  gst_caps_do_simplify (params->capture_caps);
 
-  return caps;
+  return gst_caps_ref (params->capture_caps);
 }
 
-void
+/* Stores val if the HAL supports it */
+static gboolean
+camera_params_set_supported_key (struct camera_params *params,
+    CameraParamKey key, const char *val)
+{
+  if (!camera_params_is_supported (params, key, val)) {
+    return FALSE;
+  }
+
+  camera_params_set_key (params, key, val);
+
+  return TRUE;
+}
+
+gboolean
 camera_params_set_viewfinder_size (struct camera_params *params, int width,
     int height)
 {
-  std::stringstream stream;
-  stream << width << "x" << height;
+  char str[32];
+  snprintf (str, sizeof (str), "%dx%d", width, height);
 
-  camera_params_set (params, "preview-size", stream.str ().c_str ());
+  return camera_params_set_supported_key (params, CAMERA_PARAM_PREVIEW_SIZE,
+      str);
 }
 
-void
+gboolean
 camera_params_set_capture_size (struct camera_params *params, int width,
     int height)
 {
-  std::stringstream stream;
-  stream << width << "x" << height;
+  char str[32];
+  snprintf (str, sizeof (str), "%dx%d", width, height);
 
-  camera_params_set (params, "picture-size", stream.str ().c_str ());
+  return camera_params_set_supported_key (params, CAMERA_PARAM_PICTURE_SIZE,
+      str);
 }
 
-void
+gboolean
 camera_params_set_viewfinder_fps (struct camera_params *params, int fps)
 {
-  std::stringstream stream;
-  stream << fps;
-  camera_params_set (params, "preview-frame-rate", stream.str ().c_str ());
+  char str[16];
+  snprintf (str, sizeof (str), "%d", fps);
+
+  return camera_params_set_supported_key (params,
+      CAMERA_PARAM_PREVIEW_FRAME_RATE, str);
 }
 
-GstCaps *
-camera_params_get_video_caps (struct camera_params *params)
+/*
+ * A variable rate lets the HAL stretch the exposure when there is not
+ * enough light so out of the ranges topping out at fps_n/fps_d we take
+ * the one going down the furthest. Otherwise the narrowest one.
+ *
+ * The caps offer every rate within a range so when none tops out there
+ * a range around it gets capped at fps_n/fps_d, picked the same way.
+ */
+gboolean
+camera_params_set_viewfinder_fps_range (struct camera_params *params,
+    int fps_n, int fps_d, gboolean variable, int *min, int *max)
 {
-  GValue fps_list = G_VALUE_INIT;
-  g_value_init (&fps_list, GST_TYPE_LIST);
+  const camera_params_table & ranges = camera_params_get_fps_ranges (params);
+  int rate;
+  int best = -1;
 
-  std::map < std::string, std::vector < std::string > >::iterator sizes =
-      params->items.find ("video-size-values");
-
-  if (sizes == params->items.end () || !camera_params_get_fps_list (params, fps_list)) {
-    return gst_caps_new_empty ();
+  if (fps_n <= 0 || fps_d <= 0) {
+    return FALSE;
   }
 
-  GstCaps *caps = gst_caps_new_empty ();
+  rate = (int) gst_util_uint64_scale_int_round (fps_n, 1000, fps_d);
 
-  for (std::vector < std::string >::iterator size = sizes->second.begin ();
-      size != sizes->second.end (); size++) {
-    std::stringstream stream;
-    stream.str (*size);
-    std::vector < std::string > d;
-    std::string item;
+  /* Ranges topping out at rate first, then the ones around it */
+  for (int pass = 0; pass < 2 && best == -1; pass++) {
+    for (unsigned x = 0; x < ranges.values.size (); x += 2) {
+      int lo = ranges.values[x];
+      int hi = ranges.values[x + 1];
 
-    while (getline (stream, item, 'x')) {
-      d.push_back (item);
-    }
+      if (pass == 0 ? hi != rate : (lo > rate || hi < rate)) {
+        continue;
+      }
 
-    if (d.size () != 2) {
-      continue;
+      if (best == -1 || (variable ? lo < ranges.values[best]
+              : hi - lo < ranges.values[best + 1] - ranges.values[best])) {
+        best = x;
+      }
     }
+  }
 
-    int width = atoi (d[0].c_str ());
-    int height = atoi (d[1].c_str ());
+  if (best == -1) {
+    return FALSE;
+  }
 
-    if (!width || !height) {
-      continue;
-    }
+  *min = ranges.values[best];
+  *max = rate;
 
-    GstStructure *s = gst_structure_new (GST_DROID_CAM_SRC_VIDEO_CAPS_NAME,
-					 "width", G_TYPE_INT, width,
-					 "height", G_TYPE_INT, height,
-					 NULL);
-    gst_structure_set_value (s, "framerate", &fps_list);
-    gst_caps_append_structure (caps, s);
+  char str[32];
+  snprintf (str, sizeof (str), "%d,%d", *min, *max);
+
+  camera_params_set_key (params, CAMERA_PARAM_PREVIEW_FPS_RANGE, str);
+
+  return TRUE;
+}
+
+GstCaps *
+camera_params_get_video_caps (struct camera_params *params)
+{
+  if (!params->video_caps) {
+    params->video_caps =
+        camera_params_build_caps (camera_params_get_sizes (params,
+            "video-size-values", params->video_sizes),
+        camera_params_get_fps (params), NULL, CAMERA_PARAMS_VIDEO_CAPS_NAME);
   }
 
-  return caps;
+  return gst_caps_ref (params->video_caps);
 }
 
-void
+gboolean
 camera_params_set_video_size (struct camera_params *params, int width,
     int height)
 {
-  std::stringstream stream;
-  stream << width << "x" << height;
+  char str[32];
+  snprintf (str, sizeof (str), "%dx%d", width, height);
 
-  camera_params_set (params, "video-size", stream.str ().c_str ());
+  return camera_params_set_supported_key (params, CAMERA_PARAM_VIDEO_SIZE,
+      str);
 }
 
 int
 camera_params_get_int (struct camera_params *params, const char *key)
 {
-  std::map < std::string, std::vector < std::string > >::iterator iter =
-      params->items.find (key);
-  if (iter->second.size () == 0) {
+  camera_params_entry *entry = camera_params_find (params, key);
+
+  if (!entry) {
     return 0;
   }
 
-  return atoi (iter->second[0].c_str ());
+  return atoi (entry->value);
 }
 
 void
 camera_params_set_int (struct camera_params *params, const char *key, int val)
 {
-  std::stringstream stream;
-  stream << val;
+  char str[16];
+  snprintf (str, sizeof (str), "%d", val);
+
+  camera_params_set (params, key, str);
+}
+
+const char *
+camera_params_key_name (CameraParamKey key)
+{
+  return camera_params_key_names[key];
+}
+
+static const camera_params_slot &
+camera_params_get_slot (struct camera_params *params, CameraParamKey key)
+{
+  camera_params_slot & slot = params->slots[key];
+
+  if (slot.parsed) {
+    return slot;
+  }
+
+  camera_params_entry *entry =
+      camera_params_find (params, camera_params_key_names[key]);
+
+  slot.parsed = true;
+  slot.value = entry ? entry->value : NULL;
+  slot.int_value = entry ? atoi (entry->value) : 0;
+  slot.float_value = entry ? g_ascii_strtod (entry->value, NULL) : 0.0f;
+
+  return slot;
+}
+
+const char *
+camera_params_get_key (struct camera_params *params, CameraParamKey key)
+{
+  return camera_params_get_slot (params, key).value;
+}
+
+int
+camera_params_get_int_key (struct camera_params *params, CameraParamKey key)
+{
+  return camera_params_get_slot (params, key).int_value;
+}
+
+float
+camera_params_get_float_key (struct camera_params *params, CameraParamKey key)
+{
+  return camera_params_get_slot (params, key).float_value;
+}
+
+void
+camera_params_set_key (struct camera_params *params, CameraParamKey key,
+    const char *val)
+{
+  camera_params_set (params, camera_params_key_names[key], val);
+}
+
+void
+camera_params_set_int_key (struct camera_params *params, CameraParamKey key,
+    int val)
+{
+  camera_params_set_int (params, camera_params_key_names[key], val);
+}
+
+static bool
+camera_params_parse_int (const char *str, int *val)
+{
+  char *end;
+  long ret = strtol (str, &end, 10);
+
+  if (end == str || *end != '\0') {
+    return false;
+  }
+
+  *val = ret;
+
+  return true;
+}
+
+static camera_params_limits *
+camera_params_get_limits (struct camera_params *params)
+{
+  if (params->limits) {
+    return params->limits;
+  }
+
+  camera_params_limits *limits = new camera_params_limits;
+  limits->refcount = 1;
+
+  for (int x = 0; x < CAMERA_PARAM_LAST; x++) {
+    const camera_params_constraint & constraint = camera_params_constraints[x];
+    camera_params_limit & limit = limits->keys[x];
+    camera_params_entry *entry;
+
+    limit.has_values = false;
+    limit.has_range = false;
+    limit.min = 0;
+    limit.max = 0;
+
+    if (constraint.values
+        && (entry = camera_params_find (params, constraint.values))) {
+      const char *item = entry->value;
+
+      limit.has_values = true;
+
+      while (true) {
+        const char *end = strchr (item, ',');
+        if (!end) {
+          limit.values.insert (item);
+          break;
+        }
+
+        limit.values.insert (std::string (item, end - item));
+        item = end + 1;
+      }
+    }
+
+    if (constraint.max
+        && (entry = camera_params_find (params, constraint.max))) {
+      limit.has_range = camera_params_parse_int (entry->value, &limit.max);
+
+      if (constraint.min) {
+        entry = camera_params_find (params, constraint.min);
+        limit.has_range = limit.has_range && entry
+            && camera_params_parse_int (entry->value, &limit.min);
+      }
+    }
+  }
+
+  params->limits = limits;
+
+  return limits;
+}
+
+/*
+ * Checks val against what the HAL advertised for key. Keys the HAL did not
+ * advertise anything for are always supported.
+ */
+gboolean
+camera_params_is_supported (struct camera_params *params, CameraParamKey key,
+    const char *val)
+{
+  const camera_params_limit & limit =
+      camera_params_get_limits (params)->keys[key];
+
+  if (limit.has_values && limit.values.count (val) == 0) {
+    return FALSE;
+  }
+
+  if (limit.has_range) {
+    int value;
+
+    if (!camera_params_parse_int (val, &value)) {
+      return FALSE;
+    }
+
+    if (value < limit.min || value > limit.max) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/*
+ * Computes everything which is otherwise computed on demand. Afterwards
+ * none of the getters modify params and it can be read from several
+ * threads at once.
+ */
+void
+camera_params_prepare (struct camera_params *params)
+{
+  if (!params->serialized_valid) {
+    camera_params_serialize (params);
+  }
+
+  for (int x = 0; x < CAMERA_PARAM_LAST; x++) {
+    camera_params_get_slot (params, (CameraParamKey) x);
+  }
+
+  gst_caps_unref (camera_params_get_viewfinder_caps (params));
+  gst_caps_unref (camera_params_get_capture_caps (params));
+  gst_caps_unref (camera_params_get_video_caps (params));
 
-  camera_params_set (params, key, stream.str ().c_str ());
+  camera_params_get_limits (params);
 }
 
 G_END_DECLS;
@@ -25,24 +25,76 @@
 
 G_BEGIN_DECLS
 
+#define CAMERA_PARAMS_VIDEO_CAPS_NAME "video/x-raw-data"
+
 struct camera_params;
 
+/* Keys we use often enough to deserve a slot of their own */
+typedef enum {
+  CAMERA_PARAM_ZOOM,
+  CAMERA_PARAM_MAX_ZOOM,
+  CAMERA_PARAM_FLASH_MODE,
+  CAMERA_PARAM_FOCUS_MODE,
+  CAMERA_PARAM_WHITE_BALANCE,
+  CAMERA_PARAM_ISO,
+  CAMERA_PARAM_EXPOSURE_COMPENSATION,
+  CAMERA_PARAM_MIN_EXPOSURE_COMPENSATION,
+  CAMERA_PARAM_MAX_EXPOSURE_COMPENSATION,
+  CAMERA_PARAM_FOCUS_AREAS,
+  CAMERA_PARAM_METERING_AREAS,
+  CAMERA_PARAM_MAX_NUM_FOCUS_AREAS,
+  CAMERA_PARAM_MAX_NUM_METERING_AREAS,
+  CAMERA_PARAM_PREVIEW_SIZE,
+  CAMERA_PARAM_PREVIEW_FRAME_RATE,
+  CAMERA_PARAM_PREVIEW_FPS_RANGE,
+  CAMERA_PARAM_PICTURE_SIZE,
+  CAMERA_PARAM_VIDEO_SIZE,
+  CAMERA_PARAM_DENOISE,
+  CAMERA_PARAM_RECORDING_HINT,
+  CAMERA_PARAM_LAST
+} CameraParamKey;
+
+/* Sets of keys as returned by camera_params_refresh () */
+#define CAMERA_PARAM_MASK(key) (1u << (key))
+/* Any key without a CameraParamKey */
+#define CAMERA_PARAM_MASK_OTHER CAMERA_PARAM_MASK (CAMERA_PARAM_LAST)
+#define CAMERA_PARAM_MASK_ALL (CAMERA_PARAM_MASK (CAMERA_PARAM_LAST + 1) - 1)
+
 struct camera_params *camera_params_from_string(const char *str);
 void camera_params_update (struct camera_params *params, const char *str);
+guint32 camera_params_refresh (struct camera_params *params, const char *str);
 void camera_params_free(struct camera_params *params);
+struct camera_params *camera_params_copy (struct camera_params *params);
+struct camera_params *camera_params_ref (struct camera_params *params);
+void camera_params_unref (struct camera_params *params);
+void camera_params_prepare (struct camera_params *params);
 char *camera_params_to_string(struct camera_params *params);
 void camera_params_dump(struct camera_params *params);
 void camera_params_set(struct camera_params *params, const char *key, const char *val);
+gboolean camera_params_is_dirty (struct camera_params *params);
+void camera_params_clear_dirty (struct camera_params *params);
+/* The caps getters return a reference to cached caps, do not modify them */
 GstCaps *camera_params_get_viewfinder_caps (struct camera_params *params);
 GstCaps *camera_params_get_capture_caps (struct camera_params *params);
-void camera_params_set_viewfinder_size (struct camera_params *params, int width, int height);
-void camera_params_set_capture_size (struct camera_params *params, int width, int height);
-void camera_params_set_viewfinder_fps (struct camera_params *params, int fps);
+/* The size and fps setters refuse values the HAL does not list */
+gboolean camera_params_set_viewfinder_size (struct camera_params *params, int width, int height);
+gboolean camera_params_set_capture_size (struct camera_params *params, int width, int height);
+gboolean camera_params_set_viewfinder_fps (struct camera_params *params, int fps);
+/* Sets a "preview-fps-range" holding fps_n/fps_d, capped at it. Ranges are in fps * 1000 */
+gboolean camera_params_set_viewfinder_fps_range (struct camera_params *params, int fps_n, int fps_d, gboolean variable, int *min, int *max);
 GstCaps *camera_params_get_video_caps (struct camera_params *params);
-void camera_params_set_video_size (struct camera_params *params, int width, int height);
+gboolean camera_params_set_video_size (struct camera_params *params, int width, int height);
 int camera_params_get_int (struct camera_params *params, const char *key);
 void camera_params_set_int(struct camera_params *params, const char *key, int val);
 
+const char *camera_params_key_name (CameraParamKey key);
+const char *camera_params_get_key (struct camera_params *params, CameraParamKey key);
+int camera_params_get_int_key (struct camera_params *params, CameraParamKey key);
+float camera_params_get_float_key (struct camera_params *params, CameraParamKey key);
+void camera_params_set_key (struct camera_params *params, CameraParamKey key, const char *val);
+void camera_params_set_int_key (struct camera_params *params, CameraParamKey key, int val);
+gboolean camera_params_is_supported (struct camera_params *params, CameraParamKey key, const char *val);
+
 G_END_DECLS
 
 #endif /* __CAMERA_PARAMS_HH__ */
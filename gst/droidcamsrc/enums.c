@@ -18,6 +18,8 @@
  */
 
 #include "enums.h"
+#include "gstcameramemory.h"
+#include "gstcamerascheduler.h"
 
 GType
 gst_droid_cam_src_camera_device_get_type (void)
@@ -30,6 +32,8 @@ gst_droid_cam_src_camera_device_get_type (void)
           "GST_DROID_CAM_SRC_CAMERA_DEVICE_PRIMARY", "primary"},
       {GST_DROID_CAM_SRC_CAMERA_DEVICE_SECONDARY,
           "GST_DROID_CAM_SRC_CAMERA_DEVICE_SECONDARY", "secondary"},
+      {GST_DROID_CAM_SRC_CAMERA_DEVICE_EXTERNAL,
+          "GST_DROID_CAM_SRC_CAMERA_DEVICE_EXTERNAL", "external"},
       {0, NULL, NULL}
     };
 
@@ -68,3 +72,75 @@ gst_droid_cam_src_sensor_mount_angle_get_type (void)
 
   return type;
 }
+
+GType
+gst_droid_cam_src_memory_backend_get_type (void)
+{
+  static GType type = 0;
+
+  if (type == 0) {
+    static const GEnumValue values[] = {
+      {GST_CAMERA_MEMORY_BACKEND_MALLOC,
+          "GST_CAMERA_MEMORY_BACKEND_MALLOC", "malloc"},
+      {GST_CAMERA_MEMORY_BACKEND_MEMFD,
+          "GST_CAMERA_MEMORY_BACKEND_MEMFD", "memfd"},
+      {GST_CAMERA_MEMORY_BACKEND_MEMFD_HUGE,
+          "GST_CAMERA_MEMORY_BACKEND_MEMFD_HUGE", "memfd-huge"},
+      {0, NULL, NULL}
+    };
+
+    type =
+        g_enum_register_static (g_intern_static_string
+        ("GstDroidCamSrcMemoryBackend"), values);
+  }
+
+  return type;
+}
+
+GType
+gst_droid_cam_src_thread_policy_get_type (void)
+{
+  static GType type = 0;
+
+  if (type == 0) {
+    static const GEnumValue values[] = {
+      {GST_CAMERA_SCHEDULER_POLICY_NORMAL,
+          "GST_CAMERA_SCHEDULER_POLICY_NORMAL", "normal"},
+      {GST_CAMERA_SCHEDULER_POLICY_FIFO,
+          "GST_CAMERA_SCHEDULER_POLICY_FIFO", "fifo"},
+      {GST_CAMERA_SCHEDULER_POLICY_RR,
+          "GST_CAMERA_SCHEDULER_POLICY_RR", "rr"},
+      {0, NULL, NULL}
+    };
+
+    type =
+        g_enum_register_static (g_intern_static_string
+        ("GstDroidCamSrcThreadPolicy"), values);
+  }
+
+  return type;
+}
+
+GType
+gst_droid_cam_src_camera_facing_get_type (void)
+{
+  static GType type = 0;
+
+  if (type == 0) {
+    static const GEnumValue values[] = {
+      {GST_DROID_CAM_SRC_CAMERA_FACING_BACK,
+          "GST_DROID_CAM_SRC_CAMERA_FACING_BACK", "back"},
+      {GST_DROID_CAM_SRC_CAMERA_FACING_FRONT,
+          "GST_DROID_CAM_SRC_CAMERA_FACING_FRONT", "front"},
+      {GST_DROID_CAM_SRC_CAMERA_FACING_EXTERNAL,
+          "GST_DROID_CAM_SRC_CAMERA_FACING_EXTERNAL", "external"},
+      {0, NULL, NULL}
+    };
+
+    type =
+        g_enum_register_static (g_intern_static_string
+        ("GstDroidCamSrcCameraFacing"), values);
+  }
+
+  return type;
+}
@@ -26,16 +26,31 @@ G_BEGIN_DECLS
 
 #define GST_TYPE_DROID_CAM_SRC_CAMERA_DEVICE gst_droid_cam_src_camera_device_get_type ()
 #define GST_TYPE_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE gst_droid_cam_src_sensor_mount_angle_get_type ()
+#define GST_TYPE_DROID_CAM_SRC_MEMORY_BACKEND gst_droid_cam_src_memory_backend_get_type ()
+#define GST_TYPE_DROID_CAM_SRC_THREAD_POLICY gst_droid_cam_src_thread_policy_get_type ()
+#define GST_TYPE_DROID_CAM_SRC_CAMERA_FACING gst_droid_cam_src_camera_facing_get_type ()
 
 GType gst_droid_cam_src_camera_device_get_type (void);
 GType gst_droid_cam_src_sensor_mount_angle_get_type (void);
+GType gst_droid_cam_src_memory_backend_get_type (void);
+GType gst_droid_cam_src_thread_policy_get_type (void);
+GType gst_droid_cam_src_camera_facing_get_type (void);
 
 typedef enum
 {
   GST_DROID_CAM_SRC_CAMERA_DEVICE_PRIMARY = 0,
   GST_DROID_CAM_SRC_CAMERA_DEVICE_SECONDARY = 1,
+  GST_DROID_CAM_SRC_CAMERA_DEVICE_EXTERNAL = 2,
 } GstDroidCamSrcCameraDevice;
 
+/* Devices pick the first camera facing the same way */
+typedef enum
+{
+  GST_DROID_CAM_SRC_CAMERA_FACING_BACK = GST_DROID_CAM_SRC_CAMERA_DEVICE_PRIMARY,
+  GST_DROID_CAM_SRC_CAMERA_FACING_FRONT = GST_DROID_CAM_SRC_CAMERA_DEVICE_SECONDARY,
+  GST_DROID_CAM_SRC_CAMERA_FACING_EXTERNAL = GST_DROID_CAM_SRC_CAMERA_DEVICE_EXTERNAL,
+} GstDroidCamSrcCameraFacing;
+
 typedef enum {
   GST_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE_UNKNOWN = -1,
   GST_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE_0 = 0,
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcamerabuffermeta.h"
+#include <system/graphics.h>
+#include <string.h>
+
+static GQuark crop_quark;
+static GQuark meta_quark;
+
+static GstCameraBufferMeta *
+gst_camera_buffer_meta_copy (const GstCameraBufferMeta * meta)
+{
+  return g_slice_dup (GstCameraBufferMeta, meta);
+}
+
+static void
+gst_camera_buffer_meta_free (GstCameraBufferMeta * meta)
+{
+  g_slice_free (GstCameraBufferMeta, meta);
+}
+
+GType
+gst_camera_buffer_meta_get_type (void)
+{
+  static volatile gsize type = 0;
+
+  if (g_once_init_enter (&type)) {
+    GType t = g_boxed_type_register_static ("GstCameraBufferMeta",
+        (GBoxedCopyFunc) gst_camera_buffer_meta_copy,
+        (GBoxedFreeFunc) gst_camera_buffer_meta_free);
+
+    crop_quark = g_quark_from_static_string (GST_DROID_CAM_SRC_CROP_QDATA);
+    meta_quark = g_quark_from_static_string (GST_CAMERA_BUFFER_META_FIELD);
+
+    g_once_init_leave (&type, t);
+  }
+
+  return type;
+}
+
+void
+gst_camera_buffer_meta_set_layout (GstCameraBufferMeta * meta, gint format,
+    gint stride, gint height)
+{
+  gsize y_size = (gsize) stride * height;
+
+  memset (meta->offset, 0x0, sizeof (meta->offset));
+  meta->stride = stride;
+
+  switch (format) {
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+    case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+      /* Interleaved chroma right after luma */
+      meta->n_planes = 2;
+      meta->offset[1] = y_size;
+      break;
+
+    case HAL_PIXEL_FORMAT_YV12:
+      /* V then U, each with a stride of half the luma one rounded up to 16 */
+      meta->n_planes = 3;
+      meta->offset[1] = y_size;
+      meta->offset[2] = y_size + (gsize) GST_ROUND_UP_16 (stride / 2) *
+          (height / 2);
+      break;
+
+    default:
+      /* Packed or opaque */
+      meta->n_planes = 1;
+      break;
+  }
+}
+
+void
+gst_camera_buffer_meta_attach (GstBuffer * buffer,
+    const GstCameraBufferMeta * meta)
+{
+  const GstCameraBufferMeta *old = gst_camera_buffer_meta_get (buffer);
+  GstStructure *s;
+
+  /* Pool buffers keep theirs across reuse. Usually nothing changed */
+  if (old && !memcmp (old, meta, sizeof (*meta))) {
+    return;
+  }
+
+  s = gst_structure_id_new (crop_quark,
+      g_quark_from_static_string ("left"), G_TYPE_INT, meta->left,
+      g_quark_from_static_string ("top"), G_TYPE_INT, meta->top,
+      g_quark_from_static_string ("right"), G_TYPE_INT, meta->right,
+      g_quark_from_static_string ("bottom"), G_TYPE_INT, meta->bottom,
+      meta_quark, GST_TYPE_CAMERA_BUFFER_META, meta, NULL);
+
+  gst_buffer_set_qdata (buffer, crop_quark, s);
+}
+
+const GstCameraBufferMeta *
+gst_camera_buffer_meta_get (GstBuffer * buffer)
+{
+  const GstStructure *s;
+  const GValue *value;
+
+  /* Registers the quarks */
+  gst_camera_buffer_meta_get_type ();
+
+  s = gst_buffer_get_qdata (buffer, crop_quark);
+  if (!s) {
+    return NULL;
+  }
+
+  value = gst_structure_id_get_value (s, meta_quark);
+  if (!value || !G_VALUE_HOLDS (value, GST_TYPE_CAMERA_BUFFER_META)) {
+    return NULL;
+  }
+
+  return g_value_get_boxed (value);
+}
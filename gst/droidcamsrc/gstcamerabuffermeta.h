@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERA_BUFFER_META_H__
+#define __GST_CAMERA_BUFFER_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Preview buffers carry a GST_DROID_CAM_SRC_CROP_QDATA structure with the
+ * crop as "left", "top", "right" and "bottom" ints like they always did, and
+ * a GstCameraBufferMeta in its "meta" field describing the whole layout.
+ * Caps of buffers that have it carry GST_CAMERA_BUFFER_META_CAPS_FIELD.
+ *
+ * Downstream elements get this header and libgstcamerabuffermeta-0.10 from
+ * the gstcamerabuffermeta-0.10 pkg-config module and read the meta with
+ * gst_camera_buffer_meta_get (). The library owns the boxed type so the
+ * plugin and its readers agree on it. GstCameraBufferMeta is part of the
+ * ABI: fields are never reordered, resized or removed, and adding one bumps
+ * the library version.
+ */
+#define GST_DROID_CAM_SRC_CROP_QDATA "GstDroidCamSrcCropData"
+#define GST_CAMERA_BUFFER_META_FIELD "meta"
+#define GST_CAMERA_BUFFER_META_CAPS_FIELD "buffer-meta"
+
+#define GST_CAMERA_BUFFER_META_MAX_PLANES 3
+
+#define GST_TYPE_CAMERA_BUFFER_META (gst_camera_buffer_meta_get_type ())
+
+typedef struct {
+  /* Crop rectangle. right and bottom are exclusive */
+  gint left;
+  gint top;
+  gint right;
+  gint bottom;
+
+  /* Of the first plane, in pixels */
+  gint stride;
+
+  /* Byte offsets of the planes from the start of the buffer */
+  gint n_planes;
+  gsize offset[GST_CAMERA_BUFFER_META_MAX_PLANES];
+
+  /* Sensor mount angle. Same as orientation-angle in the caps */
+  gint orientation;
+} GstCameraBufferMeta;
+
+GType gst_camera_buffer_meta_get_type (void);
+
+/* Fills in the planes of a gralloc buffer of the given HAL pixel format */
+void gst_camera_buffer_meta_set_layout (GstCameraBufferMeta * meta,
+    gint format, gint stride, gint height);
+
+/* Attaches meta to buffer unless it already carries the same */
+void gst_camera_buffer_meta_attach (GstBuffer * buffer,
+    const GstCameraBufferMeta * meta);
+
+/* NULL if buffer has none. Valid as long as buffer is */
+const GstCameraBufferMeta *gst_camera_buffer_meta_get (GstBuffer * buffer);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_BUFFER_META_H__ */
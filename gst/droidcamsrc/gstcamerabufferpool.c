@@ -22,12 +22,16 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "gstcamerabufferpool.h"
+#include "gstdroidcamsrc.h"
 #include <gst/gst.h>
 #include <gst/gstnativebuffer.h>
+#include <string.h>
 
 static void gst_camera_buffer_pool_finalize (GstCameraBufferPool * pool);
 static gboolean gst_camera_buffer_pool_resurrect_buffer (void *data,
     GstNativeBuffer * buffer);
+static void gst_camera_buffer_pool_account (GstCameraBufferPool * pool,
+    GstNativeBuffer * buffer, gboolean add);
 static gboolean gst_camera_buffer_pool_free_buffer (void *data,
     GstNativeBuffer * buffer);
 
@@ -41,6 +45,10 @@ GST_DEBUG_CATEGORY_STATIC (droidcambufferpool_debug);
 
 #define MIN_UNDEQUEUED_BUFFER_COUNT 2
 
+/* What we go down to rather than fail when max_bytes is tight: one buffer
+ * for the HAL on top of what it has to leave with us */
+#define MIN_BUFFER_COUNT (MIN_UNDEQUEUED_BUFFER_COUNT + 1)
+
 /* Maximum amount of time we wait for the application/pipeline to finish rendering */
 #define MAX_DEQUEUE_TIMEOUT_MS 33
 
@@ -85,16 +93,6 @@ gst_camera_buffer_pool_unlock_hal_queue (GstCameraBufferPool * pool)
   g_mutex_unlock (&pool->hal_lock);
 }
 
-void
-gst_camera_buffer_pool_unlock_app_queue (GstCameraBufferPool * pool)
-{
-  GST_LOG_OBJECT (pool, "unlock app queue");
-
-  g_mutex_lock (&pool->app_lock);
-  g_cond_signal (&pool->app_cond);
-  g_mutex_unlock (&pool->app_lock);
-}
-
 static gboolean
 gst_camera_buffer_pool_free_buffer (void *data, GstNativeBuffer * buffer)
 {
@@ -136,6 +134,15 @@ gst_camera_buffer_pool_resurrect_buffer (void *data, GstNativeBuffer * buffer)
     goto unlock_and_out;
   }
 
+  /* Held by the app while we shrank. Nobody is waiting for it */
+  if (pool->shrunk) {
+    GST_INFO_OBJECT (pool, "destroying idle buffer %p", buffer);
+    g_ptr_array_remove (pool->buffers, buffer);
+    gst_camera_buffer_pool_account (pool, buffer, FALSE);
+    ret = gst_camera_buffer_pool_free_buffer (pool, buffer);
+    goto unlock_and_out;
+  }
+
   gst_buffer_ref (GST_BUFFER (buffer));
   GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_PUSHED);
 
@@ -155,6 +162,219 @@ unlock_and_out:
   return ret;
 }
 
+/* What gralloc needs for one buffer, give or take vendor padding */
+static guint64
+gst_camera_buffer_pool_buffer_size (GstCameraBufferPool * pool, int stride)
+{
+  guint64 size = (guint64) stride * pool->height;
+
+  switch (pool->format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+      return size * 4;
+    case HAL_PIXEL_FORMAT_RGB_888:
+      return size * 3;
+    case HAL_PIXEL_FORMAT_RGB_565:
+    case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+      return size * 2;
+    default:
+      /* The HAL previews in some 4:2:0 format */
+      return size * 3 / 2;
+  }
+}
+
+/* with buffers_lock */
+static void
+gst_camera_buffer_pool_account (GstCameraBufferPool * pool,
+    GstNativeBuffer * buffer, gboolean add)
+{
+  guint64 size = gst_camera_buffer_pool_buffer_size (pool,
+      gst_native_buffer_get_stride (buffer));
+
+  if (add) {
+    pool->bytes += size;
+    pool->peak_bytes = MAX (pool->peak_bytes, pool->bytes);
+  } else {
+    pool->bytes -= MIN (pool->bytes, size);
+  }
+
+  GST_DEBUG_OBJECT (pool, "pool holds %" G_GUINT64_FORMAT " bytes in %d "
+      "buffers, peak %" G_GUINT64_FORMAT, pool->bytes, pool->buffers->len,
+      pool->peak_bytes);
+}
+
+/*
+ * with buffers_lock. Whether another buffer fits in max_bytes. Buffers we
+ * have tell how big the next one will be, gralloc might pad the first one.
+ */
+static gboolean
+gst_camera_buffer_pool_fits_unlocked (GstCameraBufferPool * pool)
+{
+  guint64 size;
+
+  if (!pool->max_bytes) {
+    return TRUE;
+  }
+
+  if (pool->buffers->len > 0) {
+    size = pool->bytes / pool->buffers->len;
+  } else {
+    size = gst_camera_buffer_pool_buffer_size (pool, pool->width);
+  }
+
+  return pool->bytes + size <= pool->max_bytes;
+}
+
+void
+gst_camera_buffer_pool_set_max_bytes (GstCameraBufferPool * pool,
+    guint64 max_bytes)
+{
+  g_mutex_lock (&pool->buffers_lock);
+
+  GST_DEBUG_OBJECT (pool, "max bytes %" G_GUINT64_FORMAT, max_bytes);
+
+  /* Applies to the next allocation. What we have stays */
+  pool->max_bytes = max_bytes;
+
+  g_mutex_unlock (&pool->buffers_lock);
+}
+
+void
+gst_camera_buffer_pool_get_bytes (GstCameraBufferPool * pool,
+    guint64 * bytes, guint64 * peak_bytes)
+{
+  g_mutex_lock (&pool->buffers_lock);
+
+  if (bytes) {
+    *bytes = pool->bytes;
+  }
+
+  if (peak_bytes) {
+    *peak_bytes = pool->peak_bytes;
+  }
+
+  g_mutex_unlock (&pool->buffers_lock);
+}
+
+/* with lock */
+static void
+gst_camera_buffer_pool_unschedule_idle_unlocked (GstCameraBufferPool * pool)
+{
+  if (pool->idle_id) {
+    gst_clock_id_unschedule (pool->idle_id);
+    gst_clock_id_unref (pool->idle_id);
+    pool->idle_id = NULL;
+  }
+}
+
+/* with lock */
+static void
+gst_camera_buffer_pool_shrink_unlocked (GstCameraBufferPool * pool)
+{
+  int count = 0;
+
+  /* Same order as resurrecting a buffer, which can happen right now */
+  g_mutex_lock (&pool->buffers_lock);
+  g_mutex_lock (&pool->hal_lock);
+
+  /*
+   * With preview stopped whatever is in hal queue is referenced by neither
+   * the HAL nor the app. Dequeueing allocates again once preview restarts.
+   */
+  while (pool->hal_queue->length > 0) {
+    GstNativeBuffer *buffer = g_queue_pop_head (pool->hal_queue);
+
+    gst_native_buffer_set_finalize_callback (buffer,
+        gst_camera_buffer_pool_free_buffer, pool);
+
+    g_ptr_array_remove (pool->buffers, buffer);
+    gst_camera_buffer_pool_account (pool, buffer, FALSE);
+
+    gst_buffer_unref (GST_BUFFER (buffer));
+
+    ++count;
+  }
+
+  pool->shrunk = TRUE;
+
+  GST_DEBUG_OBJECT (pool, "released %d idle buffers, %d still held", count,
+      pool->buffers->len);
+
+  g_mutex_unlock (&pool->hal_lock);
+  g_mutex_unlock (&pool->buffers_lock);
+}
+
+static gboolean
+gst_camera_buffer_pool_idle_timeout (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data)
+{
+  GstCameraBufferPool *pool = (GstCameraBufferPool *) user_data;
+
+  GST_CAMERA_BUFFER_POOL_LOCK (pool);
+
+  /* Preview might have been restarted while we waited for the lock */
+  if (pool->idle_id == id) {
+    gst_clock_id_unref (pool->idle_id);
+    pool->idle_id = NULL;
+
+    GST_INFO_OBJECT (pool, "preview idle for %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (pool->idle_timeout));
+
+    gst_camera_buffer_pool_shrink_unlocked (pool);
+  }
+
+  GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
+
+  return TRUE;
+}
+
+void
+gst_camera_buffer_pool_set_idle_timeout (GstCameraBufferPool * pool,
+    GstClockTime timeout)
+{
+  GST_CAMERA_BUFFER_POOL_LOCK (pool);
+
+  GST_DEBUG_OBJECT (pool, "idle timeout %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (timeout));
+
+  /* Applies the next time preview stops */
+  pool->idle_timeout = timeout;
+
+  GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
+}
+
+void
+gst_camera_buffer_pool_set_idle (GstCameraBufferPool * pool, gboolean idle)
+{
+  GST_CAMERA_BUFFER_POOL_LOCK (pool);
+
+  GST_DEBUG_OBJECT (pool, "idle: %d", idle);
+
+  gst_camera_buffer_pool_unschedule_idle_unlocked (pool);
+
+  if (!idle) {
+    g_mutex_lock (&pool->buffers_lock);
+    pool->shrunk = FALSE;
+    g_mutex_unlock (&pool->buffers_lock);
+  } else if (GST_CLOCK_TIME_IS_VALID (pool->idle_timeout)) {
+    pool->idle_id = gst_clock_new_single_shot_id (pool->idle_clock,
+        gst_clock_get_time (pool->idle_clock) + pool->idle_timeout);
+
+    /* The callback keeps the pool alive, unscheduling drops that */
+    if (gst_clock_id_wait_async_full (pool->idle_id,
+            gst_camera_buffer_pool_idle_timeout,
+            gst_camera_buffer_pool_ref (pool),
+            (GDestroyNotify) gst_mini_object_unref) != GST_CLOCK_OK) {
+      GST_WARNING_OBJECT (pool, "failed to schedule idle timeout");
+      gst_camera_buffer_pool_unschedule_idle_unlocked (pool);
+    }
+  }
+
+  GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
+}
+
 /* with buffers_lock */
 static gboolean
 gst_camera_buffer_pool_allocate_and_add_unlocked (GstCameraBufferPool * pool)
@@ -191,7 +411,8 @@ gst_camera_buffer_pool_allocate_and_add_unlocked (GstCameraBufferPool * pool)
       "height", G_TYPE_INT, pool->height,
       "framerate", GST_TYPE_FRACTION, pool->fps_n, pool->fps_d,
       "format", G_TYPE_INT, pool->format,
-      "orientation-angle", G_TYPE_INT, pool->orientation, NULL);
+      "orientation-angle", G_TYPE_INT, pool->orientation,
+      GST_CAMERA_BUFFER_META_CAPS_FIELD, G_TYPE_BOOLEAN, TRUE, NULL);
 
   GST_DEBUG_OBJECT (pool, "setting buffer caps to %" GST_PTR_FORMAT, caps);
 
@@ -202,6 +423,7 @@ gst_camera_buffer_pool_allocate_and_add_unlocked (GstCameraBufferPool * pool)
       gst_camera_buffer_pool_resurrect_buffer, pool);
 
   g_ptr_array_add (pool->buffers, buffer);
+  gst_camera_buffer_pool_account (pool, buffer, TRUE);
 
   g_mutex_lock (&pool->hal_lock);
 
@@ -232,6 +454,9 @@ gst_camera_buffer_pool_set_buffers_geometry (struct preview_stream_ops *w,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_SET_BUFFERS_GEOMETRY, width,
+      height, format);
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set buffers geometry from %dx%d@0x%x to %dx%d@0x%x",
@@ -268,6 +493,8 @@ gst_camera_buffer_pool_set_buffer_count (struct preview_stream_ops *w,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_SET_BUFFER_COUNT, count, 0, 0);
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set buffer count from %d to %d", pool->count, count);
@@ -299,6 +526,12 @@ gst_camera_buffer_pool_set_crop (struct preview_stream_ops *w, int left,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  if (G_UNLIKELY (pool->trace)) {
+    /* Four of them do not fit in args */
+    gst_hal_trace_record (pool->trace, GST_HAL_TRACE_SET_CROP, left, top,
+        right, bottom, 0);
+  }
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set crop");
@@ -329,6 +562,8 @@ gst_camera_buffer_pool_set_usage (struct preview_stream_ops *w, int usage)
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_SET_USAGE, usage, 0, 0);
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set usage from 0x%x to 0x%x", pool->usage, usage);
@@ -360,6 +595,9 @@ gst_camera_buffer_pool_set_swap_interval (struct preview_stream_ops *w,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_SET_SWAP_INTERVAL, interval, 0,
+      0);
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set swap interval");
@@ -411,9 +649,37 @@ gst_camera_buffer_pool_dequeue_buffer (struct preview_stream_ops *w,
 
   g_mutex_lock (&pool->buffers_lock);
   while (pool->buffers->len < pool->count) {
+    if (!gst_camera_buffer_pool_fits_unlocked (pool)) {
+      if (pool->buffers->len >= MIN_BUFFER_COUNT) {
+        /*
+         * The HAL has to make do with fewer than it asked for. Dequeueing
+         * more than that times out so say why the preview stutters.
+         */
+        if (pool->short_count != pool->buffers->len) {
+          pool->short_count = pool->buffers->len;
+          GST_ELEMENT_WARNING (pool->src, RESOURCE, NO_SPACE_LEFT,
+              ("Camera preview uses fewer buffers than the camera wants."),
+              ("max-pool-bytes (%" G_GUINT64_FORMAT " bytes) allows %d of "
+                  "the %d buffers the HAL asked for", pool->max_bytes,
+                  pool->buffers->len, pool->count));
+        }
+
+        GST_LOG_OBJECT (pool, "max bytes allows %d of %d buffers",
+            pool->buffers->len, pool->count);
+        break;
+      }
+
+      GST_ELEMENT_ERROR (pool->src, RESOURCE, NO_SPACE_LEFT,
+          ("Not enough memory allowed for the camera preview."),
+          ("%d buffers need more than max-pool-bytes (%" G_GUINT64_FORMAT
+              " bytes) allows. Have %" G_GUINT64_FORMAT " bytes in %d buffers",
+              MIN_BUFFER_COUNT, pool->max_bytes, pool->bytes,
+              pool->buffers->len));
+      goto nomem;
+    }
+
     if (!gst_camera_buffer_pool_allocate_and_add_unlocked (pool)) {
-      GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
-      return -ENOMEM;
+      goto nomem;
     }
   }
 
@@ -455,6 +721,7 @@ gst_camera_buffer_pool_dequeue_buffer (struct preview_stream_ops *w,
   if (!buff) {
     /* TODO: Not really sure what to do here */
     GST_WARNING_OBJECT (pool, "no buffer");
+    GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_DEQUEUE_BUFFER, -EINVAL, 0, 0);
     return -EINVAL;
   }
 
@@ -465,7 +732,56 @@ gst_camera_buffer_pool_dequeue_buffer (struct preview_stream_ops *w,
 
   GST_DEBUG_OBJECT (pool, "dequeueing buffer %p", buff);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_DEQUEUE_BUFFER, 0, 0, 0);
+
   return 0;
+
+nomem:
+  g_mutex_unlock (&pool->buffers_lock);
+  GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_DEQUEUE_BUFFER, -ENOMEM, 0, 0);
+  return -ENOMEM;
+}
+
+/*
+ * with pool lock
+ * How long the frame captured at time took. A variable rate preview gets
+ * the interval between the last frames, kept within what the fps range
+ * allows and smoothed so a late callback does not show.
+ */
+static GstClockTime
+gst_camera_buffer_pool_get_frame_duration (GstCameraBufferPool * pool,
+    GstClockTime time)
+{
+  GstClockTime interval;
+
+  if (pool->min_buffer_duration == pool->max_buffer_duration
+      || !GST_CLOCK_TIME_IS_VALID (pool->min_buffer_duration)
+      || !GST_CLOCK_TIME_IS_VALID (pool->max_buffer_duration)) {
+    return pool->buffer_duration;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (time)) {
+    return pool->frame_interval;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (pool->last_buffer_time)
+      && time > pool->last_buffer_time) {
+    interval = CLAMP (time - pool->last_buffer_time, pool->min_buffer_duration,
+        pool->max_buffer_duration);
+
+    if (GST_CLOCK_TIME_IS_VALID (pool->frame_interval)) {
+      pool->frame_interval = (pool->frame_interval * 7 + interval) / 8;
+    } else {
+      pool->frame_interval = interval;
+    }
+  } else if (!GST_CLOCK_TIME_IS_VALID (pool->frame_interval)) {
+    pool->frame_interval = pool->buffer_duration;
+  }
+
+  pool->last_buffer_time = time;
+
+  return pool->frame_interval;
 }
 
 /* with pool lock */
@@ -474,7 +790,8 @@ gst_camera_buffer_pool_set_buffer_metadata (GstCameraBufferPool * pool,
     GstNativeBuffer * buffer)
 {
   GstBuffer *buff = GST_BUFFER (buffer);
-  GstStructure *crop = NULL;
+  GstCameraBufferMeta meta;
+  GstClockTime duration = pool->buffer_duration;
 
   GST_DEBUG_OBJECT (pool, "set buffer metadata");
 
@@ -488,45 +805,36 @@ gst_camera_buffer_pool_set_buffer_metadata (GstCameraBufferPool * pool,
   g_return_if_fail (pool->last_timestamp == 0);
 
   if (!pool->last_timestamp) {
-    GstClock *clock;
     GstClockTime timestamp;
-    GstClockTime base_time;
-
-    GST_OBJECT_LOCK (pool->src);
-    clock = GST_ELEMENT_CLOCK (pool->src);
-    base_time = pool->src->base_time;
 
-    if (clock) {
-      timestamp = gst_clock_get_time (clock) - pool->src->base_time;
-    } else {
-      timestamp = GST_CLOCK_TIME_NONE;
-    }
+    timestamp =
+        gst_droid_cam_src_get_running_time ((GstDroidCamSrc *) pool->src);
 
-    GST_OBJECT_UNLOCK (pool->src);
+    duration = gst_camera_buffer_pool_get_frame_duration (pool, timestamp);
 
-    if (timestamp > pool->buffer_duration) {
-      timestamp -= pool->buffer_duration;
+    if (timestamp > duration) {
+      timestamp -= duration;
     }
 
     GST_BUFFER_TIMESTAMP (buff) = timestamp;
 
     GST_LOG_OBJECT (pool, "buffer timestamp set to %" GST_TIME_FORMAT,
         GST_TIME_ARGS (timestamp));
-
-    GST_LOG_OBJECT (pool, "base time is now %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (base_time));
   }
 
-  GST_BUFFER_DURATION (buff) = pool->buffer_duration;
+  GST_BUFFER_DURATION (buff) = duration;
 
-  crop = gst_structure_new (GST_DROID_CAM_SRC_CROP_QDATA,
-      "left", G_TYPE_INT, pool->left,
-      "top", G_TYPE_INT, pool->top,
-      "right", G_TYPE_INT, pool->right,
-      "bottom", G_TYPE_INT, pool->bottom, NULL);
+  /* Zeroed so padding compares equal too */
+  memset (&meta, 0x0, sizeof (meta));
+  meta.left = pool->left;
+  meta.top = pool->top;
+  meta.right = pool->right;
+  meta.bottom = pool->bottom;
+  meta.orientation = pool->orientation;
+  gst_camera_buffer_meta_set_layout (&meta, pool->format,
+      gst_native_buffer_get_stride (buffer), pool->height);
 
-  gst_buffer_set_qdata (buff,
-      g_quark_from_string (GST_DROID_CAM_SRC_CROP_QDATA), crop);
+  gst_camera_buffer_meta_attach (buff, &meta);
 }
 
 static int
@@ -536,6 +844,8 @@ gst_camera_buffer_pool_enqueue_buffer (struct preview_stream_ops *w,
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
   GstNativeBuffer *buff = gst_camera_buffer_pool_get_buffer (buffer);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_ENQUEUE_BUFFER, 0, 0, 0);
+
   GST_LOG_OBJECT (pool, "enqueue buffer %p", buff);
 
   gst_buffer_unref (GST_BUFFER (buff));
@@ -565,9 +875,10 @@ gst_camera_buffer_pool_enqueue_buffer (struct preview_stream_ops *w,
     GST_BUFFER_FLAG_SET (buff, GST_BUFFER_FLAG_PUSHED);
     g_queue_push_tail (pool->app_queue, buff);
 
-    g_cond_signal (&pool->app_cond);
-
     g_mutex_unlock (&pool->app_lock);
+
+    gst_camera_scheduler_wakeup (pool->scheduler,
+        GST_CAMERA_SCHEDULER_VIEWFINDER);
   }
 
   GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
@@ -582,6 +893,8 @@ gst_camera_buffer_pool_cancel_buffer (struct preview_stream_ops *w,
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
   GstNativeBuffer *buff = gst_camera_buffer_pool_get_buffer (buffer);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_CANCEL_BUFFER, 0, 0, 0);
+
   GST_DEBUG_OBJECT (pool, "cancel buffer: %p", buff);
 
   gst_buffer_unref (GST_BUFFER (buff));
@@ -595,6 +908,8 @@ gst_camera_buffer_pool_lock_buffer (struct preview_stream_ops *w,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  GST_HAL_TRACE (pool->trace, GST_HAL_TRACE_LOCK_BUFFER, 0, 0, 0);
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   /* TODO: What should we do here ? */
@@ -611,6 +926,11 @@ gst_camera_buffer_pool_set_timestamp (struct preview_stream_ops *w,
 {
   GstCameraBufferPool *pool = gst_camera_buffer_pool_get (w);
 
+  if (G_UNLIKELY (pool->trace)) {
+    gst_hal_trace_record (pool->trace, GST_HAL_TRACE_SET_TIMESTAMP, 0, 0, 0, 0,
+        timestamp);
+  }
+
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   GST_DEBUG_OBJECT (pool, "set timestamp");
@@ -629,11 +949,17 @@ static void
 gst_camera_buffer_pool_init (GstCameraBufferPool * pool)
 {
   pool->buffer_duration = GST_CLOCK_TIME_NONE;
+  pool->min_buffer_duration = GST_CLOCK_TIME_NONE;
+  pool->max_buffer_duration = GST_CLOCK_TIME_NONE;
+  pool->frame_interval = GST_CLOCK_TIME_NONE;
+  pool->last_buffer_time = GST_CLOCK_TIME_NONE;
   pool->flushing = TRUE;
   pool->frames = 0;
   pool->fps_n = 0;
   pool->fps_d = 0;
   pool->orientation = -1;
+  pool->idle_timeout = GST_CLOCK_TIME_NONE;
+  pool->idle_clock = gst_system_clock_obtain ();
 
   g_mutex_init (&pool->lock);
 
@@ -646,7 +972,6 @@ gst_camera_buffer_pool_init (GstCameraBufferPool * pool)
 
   pool->app_queue = g_queue_new ();
   g_mutex_init (&pool->app_lock);
-  g_cond_init (&pool->app_cond);
 
   pool->window.set_buffer_count = gst_camera_buffer_pool_set_buffer_count;
   pool->window.set_buffers_geometry =
@@ -685,11 +1010,11 @@ gst_camera_buffer_pool_finalize (GstCameraBufferPool * pool)
   g_queue_free (pool->hal_queue);
 
   g_mutex_clear (&pool->app_lock);
-  g_cond_clear (&pool->app_cond);
   g_queue_free (pool->app_queue);
 
   gst_gralloc_unref (pool->gralloc);
   gst_object_unref (pool->src);
+  gst_object_unref (pool->idle_clock);
 
   g_mutex_clear (&pool->lock);
 
@@ -740,6 +1065,10 @@ gst_camera_buffer_pool_clear (GstCameraBufferPool * pool)
   GST_DEBUG_OBJECT (pool, "clear");
 
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
+
+  /* The next frame does not follow the last one we got */
+  pool->last_buffer_time = GST_CLOCK_TIME_NONE;
+  pool->frame_interval = GST_CLOCK_TIME_NONE;
   g_mutex_lock (&pool->hal_lock);
   g_mutex_lock (&pool->buffers_lock);
 
@@ -761,6 +1090,7 @@ gst_camera_buffer_pool_clear (GstCameraBufferPool * pool)
           gst_camera_buffer_pool_free_buffer, pool);
 
       g_ptr_array_remove (pool->buffers, buffer);
+      gst_camera_buffer_pool_account (pool, buffer, FALSE);
 
       /*
        * Unref the buffer so it gets destroyed either now or when the app is done with it
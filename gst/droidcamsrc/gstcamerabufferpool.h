@@ -24,6 +24,9 @@
 #include <gst/gstminiobject.h>
 #include <hardware/camera.h>
 #include <gst/gstgralloc.h>
+#include "gsthaltrace.h"
+#include "gstcamerascheduler.h"
+#include "gstcamerabuffermeta.h"
 
 
 G_BEGIN_DECLS
@@ -41,8 +44,6 @@ typedef struct _GstCameraBufferPoolClass GstCameraBufferPoolClass;
 #define GST_CAMERA_BUFFER_POOL_LOCK(p) g_mutex_lock (&p->lock)
 #define GST_CAMERA_BUFFER_POOL_UNLOCK(p) g_mutex_unlock (&p->lock)
 
-#define GST_DROID_CAM_SRC_CROP_QDATA "GstDroidCamSrcCropData"
-
 struct _GstCameraBufferPool {
   GstMiniObject parent;
 
@@ -54,6 +55,25 @@ struct _GstCameraBufferPool {
   GPtrArray *buffers;
   GMutex buffers_lock;
 
+  /* gralloc memory held in buffers, protected by buffers_lock */
+  guint64 bytes;
+  guint64 peak_bytes;
+  /* 0 for no limit */
+  guint64 max_bytes;
+  /* Buffers max_bytes held the HAL to when we last warned, or 0 */
+  int short_count;
+
+  /*
+   * Released idle buffers while preview was stopped. Buffers coming back
+   * are not kept either. Protected by buffers_lock.
+   */
+  gboolean shrunk;
+
+  /* How long preview has to be stopped before shrinking, protected by lock */
+  GstClockTime idle_timeout;
+  GstClock *idle_clock;
+  GstClockID idle_id;
+
   /* Queue for HAL */
   GQueue *hal_queue;
   GCond hal_cond;
@@ -62,7 +82,8 @@ struct _GstCameraBufferPool {
   /* Queue for APP */
   GQueue *app_queue;
   GMutex app_lock;
-  GCond app_cond;
+  /* Told when app_queue gets a buffer */
+  GstCameraScheduler *scheduler;
 
   struct preview_stream_ops window;
 
@@ -86,9 +107,19 @@ struct _GstCameraBufferPool {
   gboolean flushing;
 
   GstClockTime buffer_duration;
+  /* Frame intervals the HAL may use. Both are buffer_duration unless the
+   * preview runs at a variable rate */
+  GstClockTime min_buffer_duration;
+  GstClockTime max_buffer_duration;
+  /* Smoothed interval between the last frames */
+  GstClockTime frame_interval;
+  GstClockTime last_buffer_time;
   int fps_n;
   int fps_d;
   int orientation;
+
+  /* Set by the element while the camera is open and traced */
+  GstHalTrace *trace;
 };
 
 struct _GstCameraBufferPoolClass {
@@ -100,9 +131,15 @@ GType           gst_camera_buffer_pool_get_type           (void);
 GstCameraBufferPool *gst_camera_buffer_pool_new (GstElement * src, GstGralloc * gralloc);
 
 void gst_camera_buffer_pool_unlock_hal_queue (GstCameraBufferPool * pool);
-void gst_camera_buffer_pool_unlock_app_queue (GstCameraBufferPool * pool);
 void gst_camera_buffer_pool_drain_app_queue (GstCameraBufferPool * pool);
 void gst_camera_buffer_pool_clear (GstCameraBufferPool * pool);
+
+void gst_camera_buffer_pool_set_max_bytes (GstCameraBufferPool * pool, guint64 max_bytes);
+void gst_camera_buffer_pool_get_bytes (GstCameraBufferPool * pool, guint64 * bytes, guint64 * peak_bytes);
+
+void gst_camera_buffer_pool_set_idle_timeout (GstCameraBufferPool * pool, GstClockTime timeout);
+/* Once idle for the timeout, buffers neither the HAL nor the app hold are released */
+void gst_camera_buffer_pool_set_idle (GstCameraBufferPool * pool, gboolean idle);
 G_INLINE_FUNC GstCameraBufferPool *gst_camera_buffer_pool_ref (GstCameraBufferPool * pool);
 G_INLINE_FUNC void gst_camera_buffer_pool_unref (GstCameraBufferPool * pool);
 
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcameraeventqueue.h"
+
+/*
+ * A Treiber stack. The consumer never pops a single node, it swaps the
+ * whole stack out, so there is no ABA to worry about.
+ */
+
+void
+gst_camera_event_queue_init (GstCameraEventQueue * queue)
+{
+  queue->head = NULL;
+}
+
+void
+gst_camera_event_queue_push (GstCameraEventQueue * queue, GstEvent * event)
+{
+  GList *node = g_list_alloc ();
+  gpointer head;
+
+  node->data = event;
+
+  do {
+    head = g_atomic_pointer_get (&queue->head);
+    node->next = head;
+  } while (!g_atomic_pointer_compare_and_exchange (&queue->head, head, node));
+}
+
+GList *
+gst_camera_event_queue_take (GstCameraEventQueue * queue)
+{
+  GList *events;
+  GList *node;
+  gpointer head;
+
+  do {
+    head = g_atomic_pointer_get (&queue->head);
+    if (!head) {
+      return NULL;
+    }
+  } while (!g_atomic_pointer_compare_and_exchange (&queue->head, head, NULL));
+
+  /* Only next was set by push () so reverse by hand to fix prev up too */
+  events = NULL;
+  for (node = head; node;) {
+    GList *next = node->next;
+
+    node->next = events;
+    node->prev = NULL;
+    if (events) {
+      events->prev = node;
+    }
+
+    events = node;
+    node = next;
+  }
+
+  return events;
+}
+
+void
+gst_camera_event_queue_clear (GstCameraEventQueue * queue)
+{
+  GList *events = gst_camera_event_queue_take (queue);
+
+  g_list_free_full (events, (GDestroyNotify) gst_event_unref);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERA_EVENT_QUEUE_H__
+#define __GST_CAMERA_EVENT_QUEUE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Serialized events waiting for the next viewfinder buffer. Any thread can
+ * push. Only the streaming thread drains it, and it has to check the queue
+ * once per frame, so checking is a single atomic read.
+ */
+typedef struct {
+  /* Newest first */
+  volatile gpointer head;
+} GstCameraEventQueue;
+
+void gst_camera_event_queue_init (GstCameraEventQueue * queue);
+
+void gst_camera_event_queue_push (GstCameraEventQueue * queue,
+    GstEvent * event);
+
+static inline gboolean
+gst_camera_event_queue_is_empty (GstCameraEventQueue * queue)
+{
+  return g_atomic_pointer_get (&queue->head) == NULL;
+}
+
+/* The events in the order they were pushed. Free with g_list_free () */
+GList *gst_camera_event_queue_take (GstCameraEventQueue * queue);
+
+/* Drops whatever is queued */
+void gst_camera_event_queue_clear (GstCameraEventQueue * queue);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_EVENT_QUEUE_H__ */
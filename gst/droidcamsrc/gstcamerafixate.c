@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcamerafixate.h"
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * A 4:3 size next to a 16:9 one costs about as much as a size twice the
+ * target: the HAL has to crop or scale one of them on every frame.
+ */
+#define ASPECT_WEIGHT                 4.0
+
+/* Too small is worse than too big: it shows */
+#define UNDERSIZE_WEIGHT              2.0
+
+/* Collects the values a field can take. Ranges contribute their best fit */
+static void
+gst_camera_fixate_field_values (const GstStructure * s, const gchar * field,
+    gint target, GArray * values)
+{
+  const GValue *val = gst_structure_get_value (s, field);
+  guint x;
+
+  if (!val) {
+    return;
+  }
+
+  if (G_VALUE_HOLDS_INT (val)) {
+    gint v = g_value_get_int (val);
+    g_array_append_val (values, v);
+  } else if (GST_VALUE_HOLDS_INT_RANGE (val)) {
+    gint v = CLAMP (target, gst_value_get_int_range_min (val),
+        gst_value_get_int_range_max (val));
+    g_array_append_val (values, v);
+  } else if (GST_VALUE_HOLDS_LIST (val)) {
+    for (x = 0; x < gst_value_list_get_size (val); x++) {
+      const GValue *item = gst_value_list_get_value (val, x);
+
+      if (G_VALUE_HOLDS_INT (item)) {
+        gint v = g_value_get_int (item);
+        g_array_append_val (values, v);
+      } else if (GST_VALUE_HOLDS_INT_RANGE (item)) {
+        gint v = CLAMP (target, gst_value_get_int_range_min (item),
+            gst_value_get_int_range_max (item));
+        g_array_append_val (values, v);
+      }
+    }
+  }
+}
+
+/*
+ * gst_structure_fixate_field_nearest_fraction () skips the ranges in a
+ * list. A range holding the target wins over any single frame rate.
+ */
+static void
+gst_camera_fixate_framerate (GstStructure * s, gint fps_n, gint fps_d)
+{
+  const GValue *val = gst_structure_get_value (s, "framerate");
+  GValue target = { 0, };
+  guint x;
+
+  if (!val || !GST_VALUE_HOLDS_LIST (val)) {
+    gst_structure_fixate_field_nearest_fraction (s, "framerate", fps_n, fps_d);
+    return;
+  }
+
+  g_value_init (&target, GST_TYPE_FRACTION);
+  gst_value_set_fraction (&target, fps_n, fps_d);
+
+  for (x = 0; x < gst_value_list_get_size (val); x++) {
+    const GValue *item = gst_value_list_get_value (val, x);
+
+    if (GST_VALUE_HOLDS_FRACTION_RANGE (item)
+        && gst_value_compare (gst_value_get_fraction_range_min (item),
+            &target) != GST_VALUE_GREATER_THAN
+        && gst_value_compare (gst_value_get_fraction_range_max (item),
+            &target) != GST_VALUE_LESS_THAN) {
+      gst_structure_set_value (s, "framerate", &target);
+      break;
+    }
+  }
+
+  g_value_unset (&target);
+
+  gst_structure_fixate_field_nearest_fraction (s, "framerate", fps_n, fps_d);
+}
+
+static void
+gst_camera_fixate_score (const GstCameraFixateTarget * target, gint width,
+    gint height, gint fps_n, gint fps_d, GstCameraFixateResult * res)
+{
+  gdouble rate = (gdouble) width * height * fps_n / fps_d;
+  gdouble target_rate = (gdouble) target->width * target->height * target->fps;
+
+  res->width = width;
+  res->height = height;
+  res->fps_n = fps_n;
+  res->fps_d = fps_d;
+
+  if (target->ref_width > 0 && target->ref_height > 0) {
+    res->aspect_cost = ASPECT_WEIGHT *
+        fabs (log (((gdouble) width * target->ref_height) /
+            ((gdouble) height * target->ref_width)));
+  } else {
+    res->aspect_cost = 0.0;
+  }
+
+  if (rate >= target_rate) {
+    res->size_cost = (rate - target_rate) / target_rate;
+  } else {
+    res->size_cost = UNDERSIZE_WEIGHT * (target_rate - rate) / rate;
+  }
+
+  res->cost = res->aspect_cost + res->size_cost;
+}
+
+static void
+gst_camera_fixate_nearest (GstStructure * s,
+    const GstCameraFixateTarget * target)
+{
+  gst_structure_fixate_field_nearest_int (s, "width", target->width);
+  gst_structure_fixate_field_nearest_int (s, "height", target->height);
+  gst_camera_fixate_framerate (s, target->fps, 1);
+}
+
+gboolean
+gst_camera_fixate_caps (GstCaps * caps, const GstCameraFixateTarget * target,
+    GstCameraFixateResult * result)
+{
+  GArray *widths = g_array_new (FALSE, FALSE, sizeof (gint));
+  GArray *heights = g_array_new (FALSE, FALSE, sizeof (gint));
+  GstCameraFixateResult best;
+  gint best_index = 0;
+  guint candidates = 0;
+  gint x;
+
+  memset (&best, 0x0, sizeof (best));
+
+  for (x = 0; x < gst_caps_get_size (caps); x++) {
+    GstStructure *s = gst_structure_copy (gst_caps_get_structure (caps, x));
+    gint fps_n = target->fps;
+    gint fps_d = 1;
+    guint w, h;
+
+    /* Every size in a structure comes with the same frame rates */
+    gst_camera_fixate_framerate (s, target->fps, 1);
+    if (!gst_structure_get_fraction (s, "framerate", &fps_n, &fps_d)
+        || fps_n <= 0 || fps_d <= 0) {
+      fps_n = target->fps;
+      fps_d = 1;
+    }
+
+    g_array_set_size (widths, 0);
+    g_array_set_size (heights, 0);
+    gst_camera_fixate_field_values (s, "width", target->width, widths);
+    gst_camera_fixate_field_values (s, "height", target->height, heights);
+
+    /* Caps simplification only merges structures differing in one field */
+    for (w = 0; w < widths->len; w++) {
+      for (h = 0; h < heights->len; h++) {
+        GstCameraFixateResult res;
+        gint width = g_array_index (widths, gint, w);
+        gint height = g_array_index (heights, gint, h);
+
+        if (width <= 0 || height <= 0) {
+          continue;
+        }
+
+        gst_camera_fixate_score (target, width, height, fps_n, fps_d, &res);
+
+        if (candidates++ == 0 || res.cost < best.cost) {
+          best = res;
+          best_index = x;
+        }
+      }
+    }
+
+    gst_structure_free (s);
+  }
+
+  g_array_free (widths, TRUE);
+  g_array_free (heights, TRUE);
+
+  if (candidates == 0) {
+    gst_caps_truncate (caps);
+    gst_camera_fixate_nearest (gst_caps_get_structure (caps, 0), target);
+    return FALSE;
+  }
+
+  for (x = gst_caps_get_size (caps) - 1; x >= 0; x--) {
+    if (x != best_index) {
+      gst_caps_remove_structure (caps, x);
+    }
+  }
+
+  gst_structure_set (gst_caps_get_structure (caps, 0),
+      "width", G_TYPE_INT, best.width, "height", G_TYPE_INT, best.height,
+      NULL);
+  gst_camera_fixate_framerate (gst_caps_get_structure (caps, 0), best.fps_n,
+      best.fps_d);
+
+  best.candidates = candidates;
+  *result = best;
+
+  return TRUE;
+}
+
+gboolean
+gst_camera_fixate_parse_size (const gchar * str, gint * width, gint * height)
+{
+  return str && sscanf (str, "%dx%d", width, height) == 2 && *width > 0
+      && *height > 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERA_FIXATE_H__
+#define __GST_CAMERA_FIXATE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* What a pad would like to end up with */
+typedef struct {
+  gint width;
+  gint height;
+  gint fps;
+
+  /* Size of the stream this one is paired with, 0x0 if not known */
+  gint ref_width;
+  gint ref_height;
+} GstCameraFixateTarget;
+
+/* Why a size was picked */
+typedef struct {
+  gint width;
+  gint height;
+  gint fps_n;
+  gint fps_d;
+
+  guint candidates;
+  gdouble cost;
+  gdouble aspect_cost;
+  gdouble size_cost;
+} GstCameraFixateResult;
+
+/*
+ * Reduces caps to the structure holding the cheapest size and fixates width,
+ * height and framerate. Cost is how far the aspect ratio is from the paired
+ * stream plus how far the pixel rate is from the target, with sizes below
+ * the target costing more than sizes above it. Returns FALSE if caps have no
+ * sizes to score; they are then fixated to the nearest target values.
+ */
+gboolean gst_camera_fixate_caps (GstCaps * caps,
+    const GstCameraFixateTarget * target, GstCameraFixateResult * result);
+
+gboolean gst_camera_fixate_parse_size (const gchar * str, gint * width,
+    gint * height);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_FIXATE_H__ */
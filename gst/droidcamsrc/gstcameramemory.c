@@ -24,25 +24,45 @@
 #include "gstcameramemory.h"
 #include <glib.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <stdio.h>              /* perror() */
 #include <unistd.h>             /* getpagesize() */
+#include <errno.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+/* Transparent huge pages on shmem are 2MB on all the platforms we care about */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 typedef struct
 {
   camera_memory_t mem;
   int fd;
+  gboolean owns_fd;
   size_t buf_size;
   guint num_bufs;
-  void *data;
+  size_t map_size;
+  GstCameraMemoryBackend backend;
 } GstCameraMemory;
 
 static gboolean gst_camera_memory_get_mmap (GstCameraMemory * mem);
 static gboolean gst_camera_memory_get_malloc (GstCameraMemory * mem);
+static gboolean gst_camera_memory_get_memfd (GstCameraMemory * mem);
 static void gst_camera_memory_release (struct camera_memory *mem);
 
 camera_memory_t *
 gst_camera_memory_get (int fd, size_t buf_size, unsigned int num_bufs,
     void *data)
+{
+  return gst_camera_memory_get_full (fd, buf_size, num_bufs,
+      GST_CAMERA_MEMORY_BACKEND_MALLOC);
+}
+
+camera_memory_t *
+gst_camera_memory_get_full (int fd, size_t buf_size, unsigned int num_bufs,
+    GstCameraMemoryBackend backend)
 {
   GstCameraMemory *mem = g_slice_new0 (GstCameraMemory);
   gboolean res;
@@ -51,15 +71,26 @@ gst_camera_memory_get (int fd, size_t buf_size, unsigned int num_bufs,
   size = ((size + pagesize - 1) & ~(pagesize - 1));
 
   mem->fd = fd;
+  mem->owns_fd = FALSE;
   mem->buf_size = buf_size;
   mem->num_bufs = num_bufs;
-  mem->data = data;
+  mem->map_size = size;
+  mem->backend = backend;
   mem->mem.size = size;
   mem->mem.handle = mem;
   mem->mem.release = gst_camera_memory_release;
 
   if (fd != -1) {
     res = gst_camera_memory_get_mmap (mem);
+  } else if (backend != GST_CAMERA_MEMORY_BACKEND_MALLOC) {
+    res = gst_camera_memory_get_memfd (mem);
+
+    if (!res) {
+      /* Old kernels do not have memfd_create() so we fall back to the heap */
+      mem->backend = GST_CAMERA_MEMORY_BACKEND_MALLOC;
+      mem->map_size = size;
+      res = gst_camera_memory_get_malloc (mem);
+    }
   } else {
     res = gst_camera_memory_get_malloc (mem);
   }
@@ -97,6 +128,88 @@ gst_camera_memory_get_malloc (GstCameraMemory * mem)
   return TRUE;
 }
 
+static int
+gst_camera_memory_memfd_create (const char *name)
+{
+#ifdef __NR_memfd_create
+  return syscall (__NR_memfd_create, name, MFD_CLOEXEC);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static gboolean
+gst_camera_memory_get_memfd (GstCameraMemory * mem)
+{
+  int flags = MAP_SHARED;
+  gboolean huge = mem->backend == GST_CAMERA_MEMORY_BACKEND_MEMFD_HUGE;
+  size_t page_size = getpagesize ();
+  size_t x;
+
+  mem->fd = gst_camera_memory_memfd_create ("droidcamsrc");
+  if (mem->fd < 0) {
+    perror ("memfd_create");
+    mem->fd = -1;
+    return FALSE;
+  }
+
+  mem->owns_fd = TRUE;
+
+  if (huge) {
+    /* Huge pages can only back fully aligned ranges */
+    mem->map_size =
+        ((mem->map_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+  }
+
+  if (ftruncate (mem->fd, mem->map_size) != 0) {
+    perror ("ftruncate");
+    goto error;
+  }
+#ifdef MAP_POPULATE
+  /* Pre-faulting must happen after madvise() or we end up with small pages */
+  if (!huge) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+
+  mem->mem.data =
+      mmap (0, mem->map_size, PROT_READ | PROT_WRITE, flags, mem->fd, 0);
+  if (mem->mem.data == MAP_FAILED) {
+    perror ("mmap");
+    goto error;
+  }
+
+  if (huge) {
+#ifdef MADV_HUGEPAGE
+    if (madvise (mem->mem.data, mem->map_size, MADV_HUGEPAGE) != 0) {
+      perror ("madvise");
+    }
+#endif
+  }
+#ifdef MAP_POPULATE
+  if (!(flags & MAP_POPULATE))
+#endif
+  {
+    /*
+     * Touch every page so the HAL does not stall on its first write. madvise()
+     * succeeding does not mean we got huge pages (shmem THP is off by default)
+     * and touching a huge page again is free.
+     */
+    for (x = 0; x < mem->map_size; x += page_size) {
+      ((volatile char *) mem->mem.data)[x] = 0;
+    }
+  }
+
+  return TRUE;
+
+error:
+  close (mem->fd);
+  mem->fd = -1;
+  mem->owns_fd = FALSE;
+  return FALSE;
+}
+
 static void
 gst_camera_memory_release (struct camera_memory *mem)
 {
@@ -105,7 +218,11 @@ gst_camera_memory_release (struct camera_memory *mem)
   if (cm->fd < 0) {
     g_slice_free1 (cm->mem.size, cm->mem.data);
   } else {
-    munmap (cm->mem.data, cm->mem.size);
+    munmap (cm->mem.data, cm->map_size);
+  }
+
+  if (cm->owns_fd) {
+    close (cm->fd);
   }
 
   g_slice_free (GstCameraMemory, cm);
@@ -113,6 +230,44 @@ gst_camera_memory_release (struct camera_memory *mem)
   mem = NULL;
 }
 
+int
+gst_camera_memory_get_fd (const camera_memory_t * data, int index,
+    gsize * offset)
+{
+  GstCameraMemory *cm = (GstCameraMemory *) data->handle;
+
+  if (cm->fd < 0 || index >= cm->num_bufs) {
+    return -1;
+  }
+
+  *offset = index * cm->buf_size;
+
+  return cm->fd;
+}
+
+void
+gst_camera_memory_attach_fd (GstBuffer * buffer, const camera_memory_t * data,
+    int index)
+{
+  GstCameraMemory *cm = (GstCameraMemory *) data->handle;
+  GstStructure *s;
+  gsize offset;
+  int fd;
+
+  fd = gst_camera_memory_get_fd (data, index, &offset);
+  if (fd < 0) {
+    return;
+  }
+
+  s = gst_structure_new (GST_CAMERA_MEMORY_FD_QDATA,
+      "fd", G_TYPE_INT, fd,
+      "offset", G_TYPE_UINT64, (guint64) offset,
+      "size", G_TYPE_UINT64, (guint64) cm->buf_size, NULL);
+
+  gst_buffer_set_qdata (buffer,
+      g_quark_from_static_string (GST_CAMERA_MEMORY_FD_QDATA), s);
+}
+
 void *
 gst_camera_memory_get_data (const camera_memory_t * data, int index, int *size)
 {
@@ -20,17 +20,42 @@
 #ifndef __GST_CAMERA_MEMORY_H__
 #define __GST_CAMERA_MEMORY_H__
 
-#include <glib.h>
+#include <gst/gst.h>
 #include <hardware/camera.h>
 
 G_BEGIN_DECLS
 
+typedef enum {
+  GST_CAMERA_MEMORY_BACKEND_MALLOC = 0,
+  GST_CAMERA_MEMORY_BACKEND_MEMFD = 1,
+  GST_CAMERA_MEMORY_BACKEND_MEMFD_HUGE = 2,
+} GstCameraMemoryBackend;
+
 camera_memory_t *gst_camera_memory_get (int fd, size_t buf_size,
     unsigned int num_bufs, void *data);
 
+camera_memory_t *gst_camera_memory_get_full (int fd, size_t buf_size,
+    unsigned int num_bufs, GstCameraMemoryBackend backend);
+
 void *gst_camera_memory_get_data (const camera_memory_t *data,
     int index, int * size);
 
+/*
+ * Buffers with data in an fd backed camera memory carry a
+ * GST_CAMERA_MEMORY_FD_QDATA structure with the "fd" and the "offset" and
+ * "size" of the data in it. The fd is open as long as the buffer lives,
+ * dup () it to hand it to another process.
+ */
+#define GST_CAMERA_MEMORY_FD_QDATA "GstCameraMemoryFd"
+
+/* -1 if data has no fd. offset is where buffer index starts in it */
+int gst_camera_memory_get_fd (const camera_memory_t *data, int index,
+    gsize * offset);
+
+/* Does nothing if data has no fd */
+void gst_camera_memory_attach_fd (GstBuffer * buffer,
+    const camera_memory_t *data, int index);
+
 G_END_DECLS
 
 #endif /* __GST_CAMERA_MEMORY_H__  */
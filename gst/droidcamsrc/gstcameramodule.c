@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gstcameramodule.h"
+#include "enums.h"
+
+GST_DEBUG_CATEGORY_STATIC (droidcammodule_debug);
+#define GST_CAT_DEFAULT droidcammodule_debug
+
+/* The probe shared by every element. Holds a reference */
+static GstCameraModule *cached_module = NULL;
+static GMutex cache_lock;
+
+static GstCameraModule *
+gst_camera_module_probe (GError ** error)
+{
+  GstCameraModule *module;
+  struct camera_info info;
+  int num_of_cameras;
+  int err;
+  int x;
+
+  module = g_slice_new0 (GstCameraModule);
+  module->refcount = 1;
+  module->cameras = g_array_new (FALSE, TRUE, sizeof (GstCameraModuleCamera));
+  g_mutex_init (&module->lock);
+
+  module->gralloc = gst_gralloc_new ();
+  if (!module->gralloc) {
+    g_set_error (error, GST_LIBRARY_ERROR, GST_LIBRARY_ERROR_INIT,
+        "Could not initialize gralloc");
+    goto error;
+  }
+
+  err =
+      hw_get_module (CAMERA_HARDWARE_MODULE_ID,
+      (const hw_module_t **) &module->hwmod);
+  if (err != 0) {
+    g_set_error (error, GST_LIBRARY_ERROR, GST_LIBRARY_ERROR_INIT,
+        "Could not get camera handle: %d", err);
+    goto error;
+  }
+
+  if (module->hwmod->module_api_version < HARDWARE_DEVICE_API_VERSION (0, 0)
+      || module->hwmod->module_api_version > HARDWARE_DEVICE_API_VERSION (1,
+          0xFF)) {
+    g_set_error (error, GST_LIBRARY_ERROR, GST_LIBRARY_ERROR_INIT,
+        "Unknown camera API version 0x%x", module->hwmod->module_api_version);
+    goto error;
+  }
+
+  module->cam = (camera_module_t *) module->hwmod;
+
+  num_of_cameras = module->cam->get_number_of_cameras ();
+  GST_INFO ("number of cameras: %d", num_of_cameras);
+
+  for (x = 0; x < num_of_cameras; x++) {
+    GstCameraModuleCamera camera = { 0 };
+
+    err = module->cam->get_camera_info (x, &info);
+    if (err != 0) {
+      GST_WARNING ("Error %d getting camera %d info", err, x);
+      continue;
+    }
+
+    /* Now we have info. Let's fill our structs */
+    if (info.facing == CAMERA_FACING_BACK) {
+      camera.facing = GST_DROID_CAM_SRC_CAMERA_FACING_BACK;
+    } else if (info.facing == CAMERA_FACING_FRONT) {
+      camera.facing = GST_DROID_CAM_SRC_CAMERA_FACING_FRONT;
+    } else {
+      camera.facing = GST_DROID_CAM_SRC_CAMERA_FACING_EXTERNAL;
+    }
+
+    camera.id = x;
+    camera.orientation = info.orientation;
+
+    g_array_append_val (module->cameras, camera);
+
+    GST_INFO ("camera %d facing %d with orientation %d", x, info.facing,
+        info.orientation);
+  }
+
+  return module;
+
+error:
+  gst_camera_module_unref (module);
+  return NULL;
+}
+
+GstCameraModule *
+gst_camera_module_obtain (GError ** error)
+{
+  GstCameraModule *module = NULL;
+
+  GST_DEBUG_CATEGORY_INIT (droidcammodule_debug, "droidcammodule", 0,
+      "Android camera module cache");
+
+  /* Held while probing so concurrent elements wait for the one probe */
+  g_mutex_lock (&cache_lock);
+
+  if (!cached_module) {
+    GST_DEBUG ("probing camera module");
+    cached_module = gst_camera_module_probe (error);
+  }
+
+  if (cached_module) {
+    module = gst_camera_module_ref (cached_module);
+  }
+
+  g_mutex_unlock (&cache_lock);
+
+  return module;
+}
+
+GstCameraModule *
+gst_camera_module_ref (GstCameraModule * module)
+{
+  g_atomic_int_inc (&module->refcount);
+
+  return module;
+}
+
+void
+gst_camera_module_unref (GstCameraModule * module)
+{
+  if (!g_atomic_int_dec_and_test (&module->refcount)) {
+    return;
+  }
+
+  GST_DEBUG ("freeing camera module %p", module);
+
+  /* libhardware has no way to unload hwmod. Loading it again is cheap */
+  if (module->gralloc) {
+    gst_gralloc_unref (module->gralloc);
+  }
+
+  g_array_free (module->cameras, TRUE);
+  g_mutex_clear (&module->lock);
+
+  g_slice_free (GstCameraModule, module);
+}
+
+void
+gst_camera_module_invalidate (void)
+{
+  GstCameraModule *module;
+
+  g_mutex_lock (&cache_lock);
+  module = cached_module;
+  cached_module = NULL;
+  g_mutex_unlock (&cache_lock);
+
+  GST_DEBUG ("invalidating camera module %p", module);
+
+  if (module) {
+    gst_camera_module_unref (module);
+  }
+}
+
+void
+gst_camera_module_get_cameras (GstCameraModule * module, GArray * cameras)
+{
+  g_mutex_lock (&module->lock);
+
+  g_array_set_size (cameras, 0);
+  g_array_append_vals (cameras, module->cameras->data, module->cameras->len);
+
+  g_mutex_unlock (&module->lock);
+}
+
+void
+gst_camera_module_set_capabilities (GstCameraModule * module, int id,
+    guint capabilities)
+{
+  guint x;
+
+  g_mutex_lock (&module->lock);
+
+  for (x = 0; x < module->cameras->len; x++) {
+    GstCameraModuleCamera *camera =
+        &g_array_index (module->cameras, GstCameraModuleCamera, x);
+
+    if (camera->id == id) {
+      camera->capabilities = capabilities;
+      camera->capabilities_known = TRUE;
+      break;
+    }
+  }
+
+  g_mutex_unlock (&module->lock);
+}
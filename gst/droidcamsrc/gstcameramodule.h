@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERA_MODULE_H__
+#define __GST_CAMERA_MODULE_H__
+
+#include <gst/gst.h>
+#include <hardware/camera.h>
+#include "gst/gstgralloc.h"
+
+G_BEGIN_DECLS
+
+/* What a camera supports, learned the first time it is opened */
+#define GST_CAMERA_MODULE_CAP_DENOISE      (1 << 0)
+#define GST_CAMERA_MODULE_CAP_TORCH        (1 << 1)
+
+typedef struct {
+  /* Sensor mount angle */
+  int orientation;
+
+  /* id used for open() call */
+  int id;
+
+  /* GstDroidCamSrcCameraFacing */
+  int facing;
+
+  gboolean capabilities_known;
+  guint capabilities;
+} GstCameraModuleCamera;
+
+/*
+ * The camera HAL module, what it says about its cameras and a gralloc to
+ * allocate preview buffers with. Probing is slow on some HALs so every
+ * element shares the one probe until it is invalidated.
+ */
+typedef struct {
+  struct hw_module_t *hwmod;
+  camera_module_t *cam;
+  GstGralloc *gralloc;
+
+  /*< private >*/
+  gint refcount;
+
+  /* GstCameraModuleCamera in HAL order. Capabilities are filled in later */
+  GArray *cameras;
+  GMutex lock;
+} GstCameraModule;
+
+/* Probes the module unless that was done already. NULL with error if it fails */
+GstCameraModule *gst_camera_module_obtain (GError ** error);
+GstCameraModule *gst_camera_module_ref (GstCameraModule * module);
+void gst_camera_module_unref (GstCameraModule * module);
+
+/* Makes the next gst_camera_module_obtain () probe again. Holders keep theirs */
+void gst_camera_module_invalidate (void);
+
+/* Replaces the contents of cameras with GstCameraModuleCamera entries */
+void gst_camera_module_get_cameras (GstCameraModule * module, GArray * cameras);
+void gst_camera_module_set_capabilities (GstCameraModule * module, int id,
+    guint capabilities);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_MODULE_H__ */
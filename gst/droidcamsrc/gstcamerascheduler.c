@@ -0,0 +1,664 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* pthread_setaffinity_np () */
+#endif
+
+#include "gstcamerascheduler.h"
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (droidcamscheduler_debug);
+#define GST_CAT_DEFAULT droidcamscheduler_debug
+
+#define NUM_SOURCES GST_CAMERA_SCHEDULER_NUM_SOURCES
+
+static const gchar *const source_names[NUM_SOURCES] = {
+  "viewfinder",
+  "video",
+  "image",
+};
+
+typedef struct {
+  GstCameraSchedulerDispatch dispatch;
+  gpointer data;
+
+  int fd;
+  gboolean running;
+  /* The fd fired since the last dispatch said the queue was empty */
+  gboolean pending;
+  /* So a dispatch pausing itself does not undo a start () racing with it */
+  guint starts;
+
+  /* First wakeup not dispatched yet or GST_CLOCK_TIME_NONE */
+  GstClockTime woken;
+  GstCameraSchedulerLatency latency;
+} GstCameraSchedulerEntry;
+
+/* What the thread had before we touched it. Task pool threads get reused */
+typedef struct {
+  int policy;
+  struct sched_param param;
+  int nice;
+  gboolean have_affinity;
+  cpu_set_t affinity;
+} GstCameraSchedulerThreadParams;
+
+struct _GstCameraScheduler {
+  GstElement *element;
+
+  GstTask *task;
+  GStaticRecMutex task_lock;
+
+  /* Protects everything below */
+  GMutex lock;
+  GCond cond;
+
+  GstCameraSchedulerEntry sources[NUM_SOURCES];
+
+  /* Wakes the thread up for shutdown */
+  int control_fd;
+
+  gboolean started;
+  gboolean shutting_down;
+  GThread *thread;
+  /* The source being dispatched or -1 */
+  gint dispatching;
+
+  GstCameraSchedulerPolicy policy;
+  gint priority;
+  guint64 affinity;
+  /* The thread is left alone until someone asks for something */
+  gboolean have_thread_params;
+  gboolean thread_params_changed;
+  GstCameraSchedulerThreadParams saved;
+};
+
+static void gst_camera_scheduler_loop (gpointer data);
+static void gst_camera_scheduler_enter_thread (GstTask * task,
+    GThread * thread, gpointer data);
+static void gst_camera_scheduler_leave_thread (GstTask * task,
+    GThread * thread, gpointer data);
+
+static GstTaskThreadCallbacks thread_callbacks = {
+  gst_camera_scheduler_enter_thread,
+  gst_camera_scheduler_leave_thread,
+};
+
+GstCameraScheduler *
+gst_camera_scheduler_new (GstElement * element)
+{
+  GstCameraScheduler *sched;
+  int x;
+
+  GST_DEBUG_CATEGORY_INIT (droidcamscheduler_debug, "droidscheduler", 0,
+      "Android camera streaming thread");
+
+  sched = g_slice_new0 (GstCameraScheduler);
+  sched->element = element;
+
+  g_static_rec_mutex_init (&sched->task_lock);
+  sched->task = gst_task_create (gst_camera_scheduler_loop, sched);
+  gst_task_set_lock (sched->task, &sched->task_lock);
+  gst_task_set_thread_callbacks (sched->task, &thread_callbacks, sched, NULL);
+
+  g_mutex_init (&sched->lock);
+  g_cond_init (&sched->cond);
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    sched->sources[x].fd = -1;
+    sched->sources[x].woken = GST_CLOCK_TIME_NONE;
+  }
+
+  sched->control_fd = -1;
+  sched->dispatching = -1;
+
+  return sched;
+}
+
+void
+gst_camera_scheduler_free (GstCameraScheduler * sched)
+{
+  gst_camera_scheduler_shutdown (sched);
+
+  gst_object_unref (sched->task);
+  g_static_rec_mutex_free (&sched->task_lock);
+
+  g_mutex_clear (&sched->lock);
+  g_cond_clear (&sched->cond);
+
+  g_slice_free (GstCameraScheduler, sched);
+}
+
+void
+gst_camera_scheduler_set_dispatch (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source, GstCameraSchedulerDispatch dispatch,
+    gpointer data)
+{
+  g_mutex_lock (&sched->lock);
+  sched->sources[source].dispatch = dispatch;
+  sched->sources[source].data = data;
+  g_mutex_unlock (&sched->lock);
+}
+
+static void
+gst_camera_scheduler_close_fd (int *fd)
+{
+  if (*fd != -1) {
+    close (*fd);
+    *fd = -1;
+  }
+}
+
+/* with lock */
+static void
+gst_camera_scheduler_close_fds (GstCameraScheduler * sched)
+{
+  int x;
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    gst_camera_scheduler_close_fd (&sched->sources[x].fd);
+  }
+
+  gst_camera_scheduler_close_fd (&sched->control_fd);
+}
+
+/* with lock */
+static gboolean
+gst_camera_scheduler_open_fds (GstCameraScheduler * sched)
+{
+  int x;
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    sched->sources[x].fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sched->sources[x].fd == -1) {
+      goto error;
+    }
+  }
+
+  sched->control_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sched->control_fd == -1) {
+    goto error;
+  }
+
+  return TRUE;
+
+error:
+  GST_ERROR_OBJECT (sched->element, "failed to create eventfd: %s",
+      g_strerror (errno));
+  gst_camera_scheduler_close_fds (sched);
+  return FALSE;
+}
+
+static void
+gst_camera_scheduler_kick (int fd)
+{
+  guint64 one = 1;
+
+  /* Can only fail if the counter is about to overflow: it is set anyway */
+  if (fd != -1 && write (fd, &one, sizeof (one)) != sizeof (one)) {
+    GST_LOG ("eventfd write failed: %s", g_strerror (errno));
+  }
+}
+
+static void
+gst_camera_scheduler_clear (int fd)
+{
+  guint64 count;
+
+  if (read (fd, &count, sizeof (count)) != sizeof (count)) {
+    GST_LOG ("eventfd read failed: %s", g_strerror (errno));
+  }
+}
+
+gboolean
+gst_camera_scheduler_start (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source)
+{
+  int x;
+
+  g_mutex_lock (&sched->lock);
+
+  if (!sched->started) {
+    GST_DEBUG_OBJECT (sched->element, "starting streaming thread");
+
+    for (x = 0; x < NUM_SOURCES; x++) {
+      memset (&sched->sources[x].latency, 0x0,
+          sizeof (sched->sources[x].latency));
+    }
+
+    if (!gst_camera_scheduler_open_fds (sched)) {
+      g_mutex_unlock (&sched->lock);
+      return FALSE;
+    }
+
+    if (!gst_task_start (sched->task)) {
+      GST_ERROR_OBJECT (sched->element, "failed to start streaming thread");
+      gst_camera_scheduler_close_fds (sched);
+      g_mutex_unlock (&sched->lock);
+      return FALSE;
+    }
+
+    sched->started = TRUE;
+  }
+
+  GST_DEBUG_OBJECT (sched->element, "starting %s", source_names[source]);
+
+  sched->sources[source].running = TRUE;
+  sched->sources[source].starts++;
+
+  /* Whatever got queued while we were stopped */
+  gst_camera_scheduler_kick (sched->sources[source].fd);
+
+  g_mutex_unlock (&sched->lock);
+
+  return TRUE;
+}
+
+void
+gst_camera_scheduler_pause (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source)
+{
+  GST_DEBUG_OBJECT (sched->element, "pausing %s", source_names[source]);
+
+  g_mutex_lock (&sched->lock);
+  sched->sources[source].running = FALSE;
+  sched->sources[source].pending = FALSE;
+  sched->sources[source].woken = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&sched->lock);
+}
+
+void
+gst_camera_scheduler_stop (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source)
+{
+  GST_DEBUG_OBJECT (sched->element, "stopping %s", source_names[source]);
+
+  g_mutex_lock (&sched->lock);
+
+  sched->sources[source].running = FALSE;
+  sched->sources[source].pending = FALSE;
+  sched->sources[source].woken = GST_CLOCK_TIME_NONE;
+
+  /* A dispatch function stopping itself can not wait for itself */
+  if (sched->thread != g_thread_self ()) {
+    while (sched->dispatching == source) {
+      g_cond_wait (&sched->cond, &sched->lock);
+    }
+  }
+
+  g_mutex_unlock (&sched->lock);
+
+  GST_DEBUG_OBJECT (sched->element, "stopped %s", source_names[source]);
+}
+
+void
+gst_camera_scheduler_wakeup (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source)
+{
+  GstCameraSchedulerEntry *entry = &sched->sources[source];
+
+  g_mutex_lock (&sched->lock);
+
+  if (entry->running && !GST_CLOCK_TIME_IS_VALID (entry->woken)) {
+    entry->woken = gst_util_get_timestamp ();
+  }
+
+  gst_camera_scheduler_kick (entry->fd);
+
+  g_mutex_unlock (&sched->lock);
+}
+
+void
+gst_camera_scheduler_shutdown (GstCameraScheduler * sched)
+{
+  int x;
+
+  g_mutex_lock (&sched->lock);
+
+  if (!sched->started) {
+    g_mutex_unlock (&sched->lock);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (sched->element, "stopping streaming thread");
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    sched->sources[x].running = FALSE;
+    sched->sources[x].pending = FALSE;
+    sched->sources[x].woken = GST_CLOCK_TIME_NONE;
+  }
+
+  sched->shutting_down = TRUE;
+
+  /* The task has to be stopping before poll () returns or it loops again */
+  gst_task_stop (sched->task);
+  gst_camera_scheduler_kick (sched->control_fd);
+
+  g_mutex_unlock (&sched->lock);
+
+  gst_task_join (sched->task);
+
+  g_mutex_lock (&sched->lock);
+  gst_camera_scheduler_close_fds (sched);
+  sched->thread = NULL;
+  sched->shutting_down = FALSE;
+  sched->started = FALSE;
+  g_mutex_unlock (&sched->lock);
+
+  GST_DEBUG_OBJECT (sched->element, "stopped streaming thread");
+}
+
+void
+gst_camera_scheduler_set_thread_params (GstCameraScheduler * sched,
+    GstCameraSchedulerPolicy policy, gint priority, guint64 affinity)
+{
+  g_mutex_lock (&sched->lock);
+
+  sched->policy = policy;
+  sched->priority = priority;
+  sched->affinity = affinity;
+  sched->have_thread_params = TRUE;
+  sched->thread_params_changed = TRUE;
+
+  /* Only the thread can renice itself */
+  gst_camera_scheduler_kick (sched->control_fd);
+
+  g_mutex_unlock (&sched->lock);
+}
+
+void
+gst_camera_scheduler_get_latency (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source, GstCameraSchedulerLatency * latency)
+{
+  g_mutex_lock (&sched->lock);
+  *latency = sched->sources[source].latency;
+  g_mutex_unlock (&sched->lock);
+}
+
+static pid_t
+gst_camera_scheduler_gettid (void)
+{
+  return syscall (__NR_gettid);
+}
+
+/* with lock, from the thread */
+static void
+gst_camera_scheduler_set_nice (GstCameraScheduler * sched, int nice)
+{
+  if (setpriority (PRIO_PROCESS, gst_camera_scheduler_gettid (), nice) != 0) {
+    GST_WARNING_OBJECT (sched->element, "failed to set nice level %d: %s",
+        nice, g_strerror (errno));
+  }
+}
+
+/* with lock, from the thread */
+static void
+gst_camera_scheduler_set_policy (GstCameraScheduler * sched, int policy,
+    const struct sched_param *param)
+{
+  int err = pthread_setschedparam (pthread_self (), policy, param);
+
+  if (err != 0) {
+    GST_WARNING_OBJECT (sched->element,
+        "failed to set scheduling policy %d priority %d: %s", policy,
+        param->sched_priority, g_strerror (err));
+  }
+}
+
+/* with lock, from the thread */
+static void
+gst_camera_scheduler_set_affinity (GstCameraScheduler * sched,
+    const cpu_set_t * set)
+{
+  int err = pthread_setaffinity_np (pthread_self (), sizeof (*set), set);
+
+  if (err != 0) {
+    GST_WARNING_OBJECT (sched->element, "failed to set CPU affinity: %s",
+        g_strerror (err));
+  }
+}
+
+/* with lock, from the thread */
+static void
+gst_camera_scheduler_apply_thread_params (GstCameraScheduler * sched)
+{
+  GstCameraSchedulerThreadParams *saved = &sched->saved;
+  struct sched_param param;
+  cpu_set_t set;
+  int policy;
+  int x;
+
+  sched->thread_params_changed = FALSE;
+
+  GST_DEBUG_OBJECT (sched->element,
+      "policy %d, priority %d, affinity 0x%" G_GINT64_MODIFIER "x",
+      sched->policy, sched->priority, sched->affinity);
+
+  memset (&param, 0x0, sizeof (param));
+
+  if (sched->policy == GST_CAMERA_SCHEDULER_POLICY_NORMAL) {
+    gst_camera_scheduler_set_policy (sched, SCHED_OTHER, &param);
+    gst_camera_scheduler_set_nice (sched, CLAMP (sched->priority, -20, 19));
+  } else {
+    policy = sched->policy == GST_CAMERA_SCHEDULER_POLICY_FIFO ?
+        SCHED_FIFO : SCHED_RR;
+    param.sched_priority = CLAMP (sched->priority,
+        sched_get_priority_min (policy), sched_get_priority_max (policy));
+    gst_camera_scheduler_set_policy (sched, policy, &param);
+  }
+
+  if (sched->affinity) {
+    CPU_ZERO (&set);
+    for (x = 0; x < 64 && x < CPU_SETSIZE; x++) {
+      if (sched->affinity & (G_GUINT64_CONSTANT (1) << x)) {
+        CPU_SET (x, &set);
+      }
+    }
+
+    gst_camera_scheduler_set_affinity (sched, &set);
+  } else if (saved->have_affinity) {
+    gst_camera_scheduler_set_affinity (sched, &saved->affinity);
+  }
+}
+
+static void
+gst_camera_scheduler_enter_thread (GstTask * task, GThread * thread,
+    gpointer data)
+{
+  GstCameraScheduler *sched = (GstCameraScheduler *) data;
+  GstCameraSchedulerThreadParams *saved = &sched->saved;
+
+  g_mutex_lock (&sched->lock);
+
+  sched->thread = thread;
+
+  pthread_getschedparam (pthread_self (), &saved->policy, &saved->param);
+
+  errno = 0;
+  saved->nice = getpriority (PRIO_PROCESS, gst_camera_scheduler_gettid ());
+  if (errno != 0) {
+    saved->nice = 0;
+  }
+
+  saved->have_affinity = pthread_getaffinity_np (pthread_self (),
+      sizeof (saved->affinity), &saved->affinity) == 0;
+
+  if (sched->have_thread_params) {
+    gst_camera_scheduler_apply_thread_params (sched);
+  }
+
+  g_mutex_unlock (&sched->lock);
+}
+
+static void
+gst_camera_scheduler_leave_thread (GstTask * task, GThread * thread,
+    gpointer data)
+{
+  GstCameraScheduler *sched = (GstCameraScheduler *) data;
+  GstCameraSchedulerThreadParams *saved = &sched->saved;
+
+  g_mutex_lock (&sched->lock);
+
+  /* Give the pool its thread back the way it was */
+  if (sched->have_thread_params) {
+    gst_camera_scheduler_set_policy (sched, saved->policy, &saved->param);
+    if (saved->policy == SCHED_OTHER) {
+      gst_camera_scheduler_set_nice (sched, saved->nice);
+    }
+
+    if (saved->have_affinity) {
+      gst_camera_scheduler_set_affinity (sched, &saved->affinity);
+    }
+  }
+
+  g_mutex_unlock (&sched->lock);
+}
+
+static void
+gst_camera_scheduler_loop (gpointer data)
+{
+  GstCameraScheduler *sched = (GstCameraScheduler *) data;
+  struct pollfd fds[NUM_SOURCES + 1];
+  GstCameraSchedulerEntry *entry;
+  GstCameraSchedulerResult res;
+  guint starts;
+  int timeout = -1;
+  int x;
+
+  g_mutex_lock (&sched->lock);
+
+  if (G_UNLIKELY (sched->thread_params_changed)) {
+    gst_camera_scheduler_apply_thread_params (sched);
+  }
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    fds[x].fd = sched->sources[x].fd;
+    fds[x].events = POLLIN;
+    fds[x].revents = 0;
+
+    /* Pick up new wakeups but do not sleep if there is work left */
+    if (sched->sources[x].running && sched->sources[x].pending) {
+      timeout = 0;
+    }
+  }
+
+  fds[NUM_SOURCES].fd = sched->control_fd;
+  fds[NUM_SOURCES].events = POLLIN;
+  fds[NUM_SOURCES].revents = 0;
+
+  g_mutex_unlock (&sched->lock);
+
+  if (poll (fds, NUM_SOURCES + 1, timeout) == -1) {
+    if (errno != EINTR) {
+      GST_ERROR_OBJECT (sched->element, "poll failed: %s",
+          g_strerror (errno));
+      gst_task_pause (sched->task);
+    }
+
+    return;
+  }
+
+  g_mutex_lock (&sched->lock);
+
+  for (x = 0; x < NUM_SOURCES; x++) {
+    if (fds[x].revents & POLLIN) {
+      gst_camera_scheduler_clear (fds[x].fd);
+      sched->sources[x].pending = sched->sources[x].running;
+    }
+  }
+
+  if (fds[NUM_SOURCES].revents & POLLIN) {
+    gst_camera_scheduler_clear (fds[NUM_SOURCES].fd);
+  }
+
+  if (sched->shutting_down) {
+    g_mutex_unlock (&sched->lock);
+    return;
+  }
+
+  /* Highest priority first, one buffer at a time */
+  for (x = 0; x < NUM_SOURCES; x++) {
+    if (sched->sources[x].running && sched->sources[x].pending) {
+      break;
+    }
+  }
+
+  if (x == NUM_SOURCES) {
+    g_mutex_unlock (&sched->lock);
+    return;
+  }
+
+  entry = &sched->sources[x];
+  starts = entry->starts;
+  sched->dispatching = x;
+
+  if (GST_CLOCK_TIME_IS_VALID (entry->woken)) {
+    GstClockTime latency = gst_util_get_timestamp () - entry->woken;
+
+    entry->woken = GST_CLOCK_TIME_NONE;
+    entry->latency.count++;
+    entry->latency.total += latency;
+    entry->latency.max = MAX (entry->latency.max, latency);
+  }
+
+  g_mutex_unlock (&sched->lock);
+
+  GST_LOG_OBJECT (sched->element, "dispatching %s", source_names[x]);
+
+  res = entry->dispatch (entry->data);
+
+  g_mutex_lock (&sched->lock);
+
+  sched->dispatching = -1;
+
+  switch (res) {
+    case GST_CAMERA_SCHEDULER_IDLE:
+      entry->pending = FALSE;
+      break;
+
+    case GST_CAMERA_SCHEDULER_BUSY:
+      break;
+
+    case GST_CAMERA_SCHEDULER_PAUSE:
+      if (entry->starts == starts) {
+        GST_DEBUG_OBJECT (sched->element, "%s paused itself",
+            source_names[x]);
+        entry->running = FALSE;
+        entry->pending = FALSE;
+      }
+      break;
+  }
+
+  g_cond_broadcast (&sched->cond);
+
+  g_mutex_unlock (&sched->lock);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_CAMERA_SCHEDULER_H__
+#define __GST_CAMERA_SCHEDULER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/*
+ * One streaming thread pushes for all the source pads. Each pad is a
+ * source with an eventfd the HAL callbacks kick when they queue something.
+ * When several sources have work the one listed first goes first.
+ *
+ * The viewfinder goes first so preview latency stays the same while
+ * capturing. A recording frame goes back to the HAL when downstream drops
+ * the buffer, not when it is pushed, so waiting behind a viewfinder frame
+ * does not keep it from the HAL for long. A push blocking downstream
+ * still holds the thread whatever the order is.
+ */
+typedef enum {
+  GST_CAMERA_SCHEDULER_VIEWFINDER,
+  GST_CAMERA_SCHEDULER_VIDEO,
+  GST_CAMERA_SCHEDULER_IMAGE,
+  GST_CAMERA_SCHEDULER_NUM_SOURCES
+} GstCameraSchedulerSource;
+
+typedef enum {
+  /* The queue is empty. Wait for the next wakeup */
+  GST_CAMERA_SCHEDULER_IDLE,
+  /* More is queued */
+  GST_CAMERA_SCHEDULER_BUSY,
+  /* Do not dispatch again until the source is started again */
+  GST_CAMERA_SCHEDULER_PAUSE,
+} GstCameraSchedulerResult;
+
+typedef enum {
+  /* SCHED_OTHER. The priority is a nice level */
+  GST_CAMERA_SCHEDULER_POLICY_NORMAL,
+  /* Real time. The priority is a SCHED_FIFO/SCHED_RR priority */
+  GST_CAMERA_SCHEDULER_POLICY_FIFO,
+  GST_CAMERA_SCHEDULER_POLICY_RR,
+} GstCameraSchedulerPolicy;
+
+/* How long a source waited between being woken up and being dispatched */
+typedef struct {
+  guint64 count;
+  GstClockTime total;
+  GstClockTime max;
+} GstCameraSchedulerLatency;
+
+/* Pushes at most one buffer. Called from the streaming thread */
+typedef GstCameraSchedulerResult (* GstCameraSchedulerDispatch) (gpointer data);
+
+typedef struct _GstCameraScheduler GstCameraScheduler;
+
+GstCameraScheduler *gst_camera_scheduler_new (GstElement * element);
+void gst_camera_scheduler_free (GstCameraScheduler * sched);
+
+void gst_camera_scheduler_set_dispatch (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source, GstCameraSchedulerDispatch dispatch,
+    gpointer data);
+
+/* Starts the thread too if it is not running. FALSE if that failed */
+gboolean gst_camera_scheduler_start (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source);
+
+/*
+ * Stops dispatching source. pause () returns right away and can be called
+ * with the stream lock of the pad held, stop () also waits for a running
+ * dispatch to finish and, like gst_pad_stop_task (), can not.
+ */
+void gst_camera_scheduler_pause (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source);
+void gst_camera_scheduler_stop (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source);
+
+/* Tells the thread source has something queued. Safe from any thread */
+void gst_camera_scheduler_wakeup (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source);
+
+/* Stops all sources and joins the thread */
+void gst_camera_scheduler_shutdown (GstCameraScheduler * sched);
+
+/*
+ * Applied by the thread itself when it starts or, if it is running, the next
+ * time it wakes up. affinity is a mask of CPUs, 0 leaves it alone. Failures
+ * (usually missing privileges) are only warned about.
+ */
+void gst_camera_scheduler_set_thread_params (GstCameraScheduler * sched,
+    GstCameraSchedulerPolicy policy, gint priority, guint64 affinity);
+
+/* Since the thread was last started */
+void gst_camera_scheduler_get_latency (GstCameraScheduler * sched,
+    GstCameraSchedulerSource source, GstCameraSchedulerLatency * latency);
+
+G_END_DECLS
+
+#endif /* __GST_CAMERA_SCHEDULER_H__ */
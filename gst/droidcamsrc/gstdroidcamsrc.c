@@ -31,6 +31,7 @@
 #undef GST_USE_UNSTABLE_API
 #endif /* GST_USE_UNSTABLE_API */
 #include <stdlib.h>
+#include <string.h>
 #include <gst/gstnativebuffer.h>
 #include "cameraparams.h"
 #include <gst/video/video.h>
@@ -39,13 +40,27 @@
 #include "gstimgsrcpad.h"
 #include "gstvidsrcpad.h"
 #include "gstphotoiface.h"
+#include "gstcamerafixate.h"
 
 #define DEFAULT_CAMERA_DEVICE         0
+#define DEFAULT_CAMERA_INDEX          -1
 #define DEFAULT_MODE                  MODE_IMAGE
 #define DEFAULT_VIDEO_METADATA        TRUE
 #define DEFAULT_IMAGE_NOISE_REDUCTION TRUE
 #define DEFAULT_MAX_ZOOM              10.0
 #define DEFAULT_VIDEO_TORCH           FALSE
+#define DEFAULT_MEMORY_BACKEND        GST_CAMERA_MEMORY_BACKEND_MALLOC
+#define DEFAULT_THREAD_POLICY         GST_CAMERA_SCHEDULER_POLICY_NORMAL
+#define DEFAULT_THREAD_PRIORITY       0
+#define DEFAULT_THREAD_AFFINITY       0
+#define DEFAULT_MAX_POOL_BYTES        0
+#define DEFAULT_POOL_IDLE_TIMEOUT     5000
+
+/* Overrides the default of the memory-backend property */
+#define MEMORY_BACKEND_ENV            "GST_DROID_CAM_SRC_MEMORY_BACKEND"
+
+/* Default of the hal-trace-location property */
+#define HAL_TRACE_ENV                 "GST_DROID_CAM_SRC_HAL_TRACE"
 
 GST_DEBUG_CATEGORY_STATIC (droidcam_debug);
 #define GST_CAT_DEFAULT droidcam_debug
@@ -89,6 +104,10 @@ static const GstQueryType *gst_droid_cam_src_get_query_types (GstElement *
     element);
 static gboolean gst_droid_cam_src_query (GstElement * element,
     GstQuery * query);
+static gboolean gst_droid_cam_src_set_clock (GstElement * element,
+    GstClock * clock);
+static void gst_droid_cam_src_update_clock (GstDroidCamSrc * src);
+static void gst_droid_cam_src_release_clocks (GstDroidCamSrc * src);
 
 static gboolean gst_droid_cam_src_setup_pipeline (GstDroidCamSrc * src);
 static gboolean gst_droid_cam_src_set_callbacks (GstDroidCamSrc * src);
@@ -96,15 +115,26 @@ static gboolean gst_droid_cam_src_set_camera_params (GstDroidCamSrc * src);
 static gboolean gst_droid_cam_src_open_segment (GstDroidCamSrc * src,
     GstPad * pad);
 static void gst_droid_cam_src_update_segment (GstDroidCamSrc * src,
-    GstBuffer * buffer);
+    GstPad * pad, GstBuffer * buffer);
+static void gst_droid_cam_src_reset_positions (GstDroidCamSrc * src);
+static void gst_droid_cam_src_sync_segment (GstDroidCamSrc * src);
 static void gst_droid_cam_src_tear_down_pipeline (GstDroidCamSrc * src);
 static gboolean gst_droid_cam_src_probe_camera (GstDroidCamSrc * src);
+static GstDroidCamSrcCameraInfo
+    * gst_droid_cam_src_get_camera_info_unlocked (GstDroidCamSrc * src);
+static gboolean gst_droid_cam_src_has_camera_capability (GstDroidCamSrc * src,
+    guint capability);
+static void gst_droid_cam_src_start_hal_trace (GstDroidCamSrc * src);
+static void gst_droid_cam_src_stop_hal_trace (GstDroidCamSrc * src);
 
 static gboolean gst_droid_cam_src_start_pipeline (GstDroidCamSrc * src);
 static void gst_droid_cam_src_stop_pipeline (GstDroidCamSrc * src);
 
 static void gst_droid_cam_src_start_capture (GstDroidCamSrc * src);
 static void gst_droid_cam_src_stop_capture (GstDroidCamSrc * src);
+static void gst_droid_cam_src_begin_params (GstDroidCamSrc * src);
+static void gst_droid_cam_src_commit_params (GstDroidCamSrc * src);
+static void gst_droid_cam_src_invalidate_module_cache (GstDroidCamSrc * src);
 
 static gboolean gst_droid_cam_src_flush_buffers (GstDroidCamSrc * src);
 static gboolean gst_droid_cam_src_start_image_capture_unlocked (GstDroidCamSrc *
@@ -114,6 +144,10 @@ static gboolean gst_droid_cam_src_start_video_capture_unlocked (GstDroidCamSrc *
 static void gst_droid_cam_src_stop_video_capture (GstDroidCamSrc * src);
 static void gst_droid_cam_src_apply_image_noise_reduction (GstDroidCamSrc *
     src);
+static void gst_droid_cam_src_apply_thread_params (GstDroidCamSrc * src);
+static void gst_droid_cam_src_apply_pool_idle_timeout (GstDroidCamSrc * src);
+static GstStructure *gst_droid_cam_src_get_scheduling_latency (GstDroidCamSrc *
+    src);
 
 static void gst_droid_cam_src_data_callback (int32_t msg_type,
     const camera_memory_t * mem, unsigned int index,
@@ -132,6 +166,9 @@ static void gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
 
 static gboolean gst_droid_cam_src_finish_capture (GstDroidCamSrc * src);
 static void gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src);
+static void gst_droid_cam_src_refresh_camera_params (GstDroidCamSrc * src);
+static void gst_droid_cam_src_camera_params_changed (GstDroidCamSrc * src,
+    guint32 changed);
 
 #if 0
 static void gst_droid_cam_src_set_recording_hint (GstDroidCamSrc * src,
@@ -147,6 +184,9 @@ static void gst_droid_cam_src_send_message (GstDroidCamSrc * src,
 static void gst_droid_cam_src_adjust_video_torch (GstDroidCamSrc * src);
 static gboolean gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src,
     GstEvent * event);
+static camera_memory_t *gst_droid_cam_src_request_memory (int fd,
+    size_t buf_size, unsigned int num_bufs, void *user);
+static GstCameraMemoryBackend gst_droid_cam_src_default_memory_backend (void);
 
 GST_BOILERPLATE_FULL (GstDroidCamSrc, gst_droid_cam_src, GstBin,
     GST_TYPE_BIN, gst_droid_cam_src_boilerplate_init);
@@ -156,6 +196,9 @@ enum
   /* action signals */
   START_CAPTURE_SIGNAL,
   STOP_CAPTURE_SIGNAL,
+  BEGIN_PARAMS_SIGNAL,
+  COMMIT_PARAMS_SIGNAL,
+  INVALIDATE_MODULE_CACHE_SIGNAL,
   /* emit signals */
   LAST_SIGNAL
 };
@@ -228,6 +271,7 @@ gst_droid_cam_src_class_init (GstDroidCamSrcClass * klass)
   element_class->get_query_types =
       GST_DEBUG_FUNCPTR (gst_droid_cam_src_get_query_types);
   element_class->query = GST_DEBUG_FUNCPTR (gst_droid_cam_src_query);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_droid_cam_src_set_clock);
 
   g_object_class_install_property (gobject_class, PROP_CAMERA_DEVICE,
       g_param_spec_enum ("camera-device", "Camera device",
@@ -235,6 +279,25 @@ gst_droid_cam_src_class_init (GstDroidCamSrcClass * klass)
           GST_TYPE_DROID_CAM_SRC_CAMERA_DEVICE,
           DEFAULT_CAMERA_DEVICE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_CAMERA_INDEX,
+      g_param_spec_int ("camera-index", "Camera index",
+          "HAL index of the camera to use, -1 for the first camera facing "
+          "the way camera-device says. Reads back the camera in use",
+          -1, G_MAXINT, DEFAULT_CAMERA_INDEX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CAMERA_FACING,
+      g_param_spec_enum ("camera-facing", "Camera facing",
+          "Which way the selected camera faces",
+          GST_TYPE_DROID_CAM_SRC_CAMERA_FACING,
+          GST_DROID_CAM_SRC_CAMERA_FACING_BACK,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_NUM_CAMERAS,
+      g_param_spec_uint ("num-cameras", "Number of cameras",
+          "How many cameras the HAL described. Known from READY on",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_MODE,
       g_param_spec_enum ("mode", "Mode",
           "The capture mode (still image capture or video recording)",
@@ -276,6 +339,72 @@ gst_droid_cam_src_class_init (GstDroidCamSrcClass * klass)
           "Sets torch light on or off for video recording",
           DEFAULT_VIDEO_TORCH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MEMORY_BACKEND,
+      g_param_spec_enum ("memory-backend", "Memory backend",
+          "Backing store for memory requested by camera HAL. "
+          "Default can be overridden via " MEMORY_BACKEND_ENV,
+          GST_TYPE_DROID_CAM_SRC_MEMORY_BACKEND,
+          DEFAULT_MEMORY_BACKEND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HAL_TRACE_LOCATION,
+      g_param_spec_string ("hal-trace-location", "HAL trace location",
+          "File to record camera HAL calls and callbacks to when the camera "
+          "is opened. Default can be set via " HAL_TRACE_ENV,
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREAD_POLICY,
+      g_param_spec_enum ("thread-policy", "Thread policy",
+          "Scheduling policy of the streaming thread. Real time policies "
+          "need CAP_SYS_NICE or RLIMIT_RTPRIO",
+          GST_TYPE_DROID_CAM_SRC_THREAD_POLICY,
+          DEFAULT_THREAD_POLICY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREAD_PRIORITY,
+      g_param_spec_int ("thread-priority", "Thread priority",
+          "Nice level (-20 to 19) of the streaming thread for the normal "
+          "policy, real time priority (1 to 99) otherwise",
+          -20, 99, DEFAULT_THREAD_PRIORITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THREAD_AFFINITY,
+      g_param_spec_uint64 ("thread-affinity", "Thread affinity",
+          "Mask of CPUs the streaming thread may run on. 0 for any",
+          0, G_MAXUINT64, DEFAULT_THREAD_AFFINITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCHEDULING_LATENCY,
+      g_param_spec_boxed ("scheduling-latency", "Scheduling latency",
+          "Time from a buffer being queued until the streaming thread got "
+          "to it, per pad, since the thread was last started",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_POOL_BYTES,
+      g_param_spec_uint64 ("max-pool-bytes", "Maximum pool bytes",
+          "Most graphics memory preview buffers may take, 0 for no limit. "
+          "Fewer buffers than the HAL asks for are allocated to stay within "
+          "it, down to a minimum the HAL can work with",
+          0, G_MAXUINT64, DEFAULT_MAX_POOL_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_BYTES,
+      g_param_spec_uint64 ("pool-bytes", "Pool bytes",
+          "Graphics memory preview buffers take now",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PEAK_POOL_BYTES,
+      g_param_spec_uint64 ("peak-pool-bytes", "Peak pool bytes",
+          "Most graphics memory preview buffers took since the camera was "
+          "opened", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_IDLE_TIMEOUT,
+      g_param_spec_uint ("pool-idle-timeout", "Pool idle timeout",
+          "Milliseconds preview has to be stopped before preview buffers "
+          "nobody holds are released, 0 to keep them. They are allocated "
+          "again when preview restarts",
+          0, G_MAXUINT, DEFAULT_POOL_IDLE_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_photo_iface_add_properties (gobject_class);
 
   droidcamsrc_signals[START_CAPTURE_SIGNAL] =
@@ -291,6 +420,27 @@ gst_droid_cam_src_class_init (GstDroidCamSrcClass * klass)
       G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
       G_CALLBACK (gst_droid_cam_src_stop_capture),
       NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
+  droidcamsrc_signals[BEGIN_PARAMS_SIGNAL] =
+      g_signal_new_class_handler ("begin-params",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_CALLBACK (gst_droid_cam_src_begin_params),
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
+  droidcamsrc_signals[COMMIT_PARAMS_SIGNAL] =
+      g_signal_new_class_handler ("commit-params",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_CALLBACK (gst_droid_cam_src_commit_params),
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
+  droidcamsrc_signals[INVALIDATE_MODULE_CACHE_SIGNAL] =
+      g_signal_new_class_handler ("invalidate-module-cache",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_CALLBACK (gst_droid_cam_src_invalidate_module_cache),
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
 }
 
 static void
@@ -298,6 +448,7 @@ gst_droid_cam_src_init (GstDroidCamSrc * src, GstDroidCamSrcClass * gclass)
 {
   GST_OBJECT_FLAG_SET (src, GST_ELEMENT_IS_SOURCE);
 
+  src->module = NULL;
   src->gralloc = NULL;
   src->cam = NULL;
   src->dev = NULL;
@@ -305,11 +456,19 @@ gst_droid_cam_src_init (GstDroidCamSrc * src, GstDroidCamSrcClass * gclass)
   src->cam_dev = NULL;
   src->user_camera_device = DEFAULT_CAMERA_DEVICE;
   src->camera_device = DEFAULT_CAMERA_DEVICE;
+  src->user_camera_index = DEFAULT_CAMERA_INDEX;
+  src->camera_index = -1;
+  src->cameras =
+      g_array_new (FALSE, TRUE, sizeof (GstDroidCamSrcCameraInfo));
   src->mode = DEFAULT_MODE;
   src->video_metadata = DEFAULT_VIDEO_METADATA;
+  src->memory_backend = gst_droid_cam_src_default_memory_backend ();
+  src->hal_trace_location = g_strdup (g_getenv (HAL_TRACE_ENV));
+  src->hal_trace = NULL;
   src->pool = NULL;
   src->camera_params = NULL;
-  src->events = NULL;
+  src->camera_params_lock = 0;
+  gst_camera_event_queue_init (&src->events);
   src->settings = gst_camera_settings_new ();
   src->image_noise_reduction = DEFAULT_IMAGE_NOISE_REDUCTION;
   src->max_zoom = DEFAULT_MAX_ZOOM;
@@ -319,23 +478,23 @@ gst_droid_cam_src_init (GstDroidCamSrc * src, GstDroidCamSrcClass * gclass)
   src->ev_comp_step = 0.0;
 
   gst_segment_init (&src->segment, GST_FORMAT_TIME);
+  gst_droid_cam_src_reset_positions (src);
 
   src->capturing = FALSE;
   g_mutex_init (&src->capturing_mutex);
 
   src->image_renegotiate = TRUE;
   src->video_renegotiate = TRUE;
+  memset (&src->image_negotiation, 0x0, sizeof (src->image_negotiation));
+  memset (&src->video_negotiation, 0x0, sizeof (src->video_negotiation));
 
   g_mutex_init (&src->params_lock);
+  src->params_batch = 0;
 
   g_mutex_init (&src->img_lock);
-  g_cond_init (&src->img_cond);
-  src->img_task_running = FALSE;
   src->img_queue = g_queue_new ();
 
-  src->video_task_running = FALSE;
   g_mutex_init (&src->video_lock);
-  g_cond_init (&src->video_cond);
   src->video_queue = g_queue_new ();
 
   src->pushed_video_frames = 0;
@@ -350,13 +509,6 @@ gst_droid_cam_src_init (GstDroidCamSrc * src, GstDroidCamSrcClass * gclass)
   g_mutex_init (&src->num_video_frames_lock);
   g_cond_init (&src->num_video_frames_cond);
 
-  src->device_info[0].orientation =
-      GST_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE_UNKNOWN;
-  src->device_info[0].id = -1;
-  src->device_info[1].orientation =
-      GST_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE_UNKNOWN;
-  src->device_info[1].id = -1;
-
   gst_photo_iface_init_settings (src);
 
   src->vfsrc = gst_vf_src_pad_new (&vfsrc_template,
@@ -370,6 +522,19 @@ gst_droid_cam_src_init (GstDroidCamSrc * src, GstDroidCamSrcClass * gclass)
   src->vidsrc = gst_vid_src_pad_new (&vidsrc_template,
       GST_BASE_CAMERA_SRC_VIDEO_PAD_NAME);
   gst_element_add_pad (GST_ELEMENT (src), src->vidsrc);
+
+  src->scheduler = gst_camera_scheduler_new (GST_ELEMENT (src));
+  src->thread_policy = DEFAULT_THREAD_POLICY;
+  src->thread_priority = DEFAULT_THREAD_PRIORITY;
+  src->thread_affinity = DEFAULT_THREAD_AFFINITY;
+  src->max_pool_bytes = DEFAULT_MAX_POOL_BYTES;
+  src->pool_idle_timeout = DEFAULT_POOL_IDLE_TIMEOUT;
+  gst_camera_scheduler_set_dispatch (src->scheduler,
+      GST_CAMERA_SCHEDULER_VIEWFINDER, gst_vf_src_pad_dispatch, src->vfsrc);
+  gst_camera_scheduler_set_dispatch (src->scheduler,
+      GST_CAMERA_SCHEDULER_VIDEO, gst_vid_src_pad_dispatch, src->vidsrc);
+  gst_camera_scheduler_set_dispatch (src->scheduler,
+      GST_CAMERA_SCHEDULER_IMAGE, gst_img_src_pad_dispatch, src->imgsrc);
 }
 
 static void
@@ -377,23 +542,20 @@ gst_droid_cam_src_finalize (GObject * object)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (object);
 
-  if (src->events) {
-    g_list_foreach (src->events, (GFunc) gst_event_unref, NULL);
-    g_list_free (src->events);
-    src->events = NULL;
-  }
+  gst_camera_event_queue_clear (&src->events);
 
   g_mutex_clear (&src->params_lock);
 
   g_mutex_clear (&src->capturing_mutex);
 
+  gst_camera_scheduler_free (src->scheduler);
+  src->scheduler = NULL;
+
   g_mutex_clear (&src->img_lock);
-  g_cond_clear (&src->img_cond);
 
   g_queue_free_full (src->img_queue, (GDestroyNotify) gst_buffer_unref);
 
   g_mutex_clear (&src->video_lock);
-  g_cond_clear (&src->video_cond);
   g_queue_free (src->video_queue);
 
   g_mutex_clear (&src->pushed_video_frames_lock);
@@ -408,6 +570,19 @@ gst_droid_cam_src_finalize (GObject * object)
   gst_camera_settings_destroy (src->settings);
   src->settings = NULL;
 
+  gst_droid_cam_src_clear_negotiation (&src->image_negotiation);
+  gst_droid_cam_src_clear_negotiation (&src->video_negotiation);
+
+  g_free (src->hal_trace_location);
+
+  g_array_free (src->cameras, TRUE);
+
+  gst_droid_cam_src_release_clocks (src);
+  if (src->ts_clock) {
+    gst_object_unref (src->ts_clock);
+    src->ts_clock = NULL;
+  }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -426,6 +601,31 @@ gst_droid_cam_src_get_property (GObject * object, guint prop_id,
       g_value_set_enum (value, src->camera_device);
       break;
 
+    case PROP_CAMERA_INDEX:
+    case PROP_CAMERA_FACING:{
+      GstDroidCamSrcCameraInfo *info;
+
+      GST_OBJECT_LOCK (src);
+      info = gst_droid_cam_src_get_camera_info_unlocked (src);
+
+      if (prop_id == PROP_CAMERA_FACING) {
+        g_value_set_enum (value, info ? info->facing : src->user_camera_device);
+      } else if (src->camera_index != -1) {
+        g_value_set_int (value, info->id);
+      } else {
+        g_value_set_int (value, src->user_camera_index);
+      }
+
+      GST_OBJECT_UNLOCK (src);
+      break;
+    }
+
+    case PROP_NUM_CAMERAS:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint (value, src->cameras->len);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
     case PROP_MODE:
       g_value_set_enum (value, src->mode);
       break;
@@ -438,10 +638,16 @@ gst_droid_cam_src_get_property (GObject * object, guint prop_id,
       g_value_set_boolean (value, !src->capturing);
       break;
 
-    case PROP_SENSOR_MOUNT_ANGLE:
-      g_value_set_enum (value,
-          src->device_info[src->camera_device].orientation);
+    case PROP_SENSOR_MOUNT_ANGLE:{
+      GstDroidCamSrcCameraInfo *info;
+
+      GST_OBJECT_LOCK (src);
+      info = gst_droid_cam_src_get_camera_info_unlocked (src);
+      g_value_set_enum (value, info ? info->orientation :
+          GST_DROID_CAM_SRC_SENSOR_MOUNT_ANGLE_UNKNOWN);
+      GST_OBJECT_UNLOCK (src);
       break;
+    }
 
     case PROP_IMAGE_NOISE_REDUCTION:
       g_value_set_boolean (value, src->image_noise_reduction);
@@ -455,6 +661,55 @@ gst_droid_cam_src_get_property (GObject * object, guint prop_id,
       g_value_set_boolean (value, src->video_torch);
       break;
 
+    case PROP_MEMORY_BACKEND:
+      g_value_set_enum (value, src->memory_backend);
+      break;
+
+    case PROP_HAL_TRACE_LOCATION:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value, src->hal_trace_location);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
+    case PROP_THREAD_POLICY:
+      g_value_set_enum (value, src->thread_policy);
+      break;
+
+    case PROP_THREAD_PRIORITY:
+      g_value_set_int (value, src->thread_priority);
+      break;
+
+    case PROP_THREAD_AFFINITY:
+      g_value_set_uint64 (value, src->thread_affinity);
+      break;
+
+    case PROP_SCHEDULING_LATENCY:
+      g_value_take_boxed (value,
+          gst_droid_cam_src_get_scheduling_latency (src));
+      break;
+
+    case PROP_MAX_POOL_BYTES:
+      g_value_set_uint64 (value, src->max_pool_bytes);
+      break;
+
+    case PROP_POOL_BYTES:
+    case PROP_PEAK_POOL_BYTES:{
+      guint64 bytes = 0;
+      guint64 peak_bytes = 0;
+
+      if (src->pool) {
+        gst_camera_buffer_pool_get_bytes (src->pool, &bytes, &peak_bytes);
+      }
+
+      g_value_set_uint64 (value,
+          prop_id == PROP_POOL_BYTES ? bytes : peak_bytes);
+      break;
+    }
+
+    case PROP_POOL_IDLE_TIMEOUT:
+      g_value_set_uint (value, src->pool_idle_timeout);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -480,14 +735,22 @@ gst_droid_cam_src_set_property (GObject * object, guint prop_id,
 
       break;
 
+    case PROP_CAMERA_INDEX:
+      GST_OBJECT_LOCK (src);
+      src->user_camera_index = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
     case PROP_MODE:
       src->mode = g_value_get_enum (value);
+      gst_droid_cam_src_begin_params (src);
       gst_photo_iface_update_focus_mode (src);
       gst_droid_cam_src_apply_image_noise_reduction (src);
       gst_droid_cam_src_adjust_video_torch (src);
 #if 0
       gst_droid_cam_src_set_recording_hint (src, TRUE);
 #endif
+      gst_droid_cam_src_commit_params (src);
       break;
 
     case PROP_VIDEO_METADATA:
@@ -504,6 +767,50 @@ gst_droid_cam_src_set_property (GObject * object, guint prop_id,
       gst_droid_cam_src_adjust_video_torch (src);
       break;
 
+    case PROP_MEMORY_BACKEND:
+      /* Applies to memory requested after this point */
+      GST_OBJECT_LOCK (src);
+      src->memory_backend = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
+    case PROP_HAL_TRACE_LOCATION:
+      /* Applies the next time the camera is opened */
+      GST_OBJECT_LOCK (src);
+      g_free (src->hal_trace_location);
+      src->hal_trace_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
+    case PROP_THREAD_POLICY:
+      src->thread_policy = g_value_get_enum (value);
+      gst_droid_cam_src_apply_thread_params (src);
+      break;
+
+    case PROP_THREAD_PRIORITY:
+      src->thread_priority = g_value_get_int (value);
+      gst_droid_cam_src_apply_thread_params (src);
+      break;
+
+    case PROP_THREAD_AFFINITY:
+      src->thread_affinity = g_value_get_uint64 (value);
+      gst_droid_cam_src_apply_thread_params (src);
+      break;
+
+    case PROP_MAX_POOL_BYTES:
+      src->max_pool_bytes = g_value_get_uint64 (value);
+      if (src->pool) {
+        gst_camera_buffer_pool_set_max_bytes (src->pool, src->max_pool_bytes);
+      }
+      break;
+
+    case PROP_POOL_IDLE_TIMEOUT:
+      src->pool_idle_timeout = g_value_get_uint (value);
+      if (src->pool) {
+        gst_droid_cam_src_apply_pool_idle_timeout (src);
+      }
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -515,30 +822,49 @@ gst_droid_cam_src_setup_pipeline (GstDroidCamSrc * src)
 {
   int err = 0;
   int id;
+  int orientation;
   gchar *cam_id = NULL;
   gchar *params = NULL;
+  struct camera_params *camera_params;
+  GstDroidCamSrcCameraInfo *info;
 
-  GST_DEBUG_OBJECT (src, "setup pipeline for camera %d", src->camera_device);
+  GST_OBJECT_LOCK (src);
 
   src->camera_device = src->user_camera_device;
+  info = gst_droid_cam_src_get_camera_info_unlocked (src);
+  if (!info) {
+    GST_OBJECT_UNLOCK (src);
 
-  id = src->device_info[src->camera_device].id;
-  if (id == -1) {
-    GST_ELEMENT_ERROR (src, LIBRARY, INIT,
-        ("failed to open camera device %d because it's not been detected",
-            src->camera_device), (NULL));
+    if (src->user_camera_index != -1) {
+      GST_ELEMENT_ERROR (src, LIBRARY, INIT,
+          ("failed to open camera %d because it's not been detected",
+              src->user_camera_index), (NULL));
+    } else {
+      GST_ELEMENT_ERROR (src, LIBRARY, INIT,
+          ("failed to open camera device %d because it's not been detected",
+              src->camera_device), (NULL));
+    }
     goto cleanup;
   }
 
-  /* We assume camera id 0 is back and 1 is front */
+  src->camera_index = info - (GstDroidCamSrcCameraInfo *) src->cameras->data;
+  src->camera_device = info->facing;
+  id = info->id;
+  orientation = info->orientation;
+
+  GST_OBJECT_UNLOCK (src);
+
+  GST_DEBUG_OBJECT (src, "setup pipeline for camera %d", id);
+
+  gst_droid_cam_src_start_hal_trace (src);
+
   cam_id = g_strdup_printf ("%i", id);
   err = src->cam->common.methods->open (src->hwmod, cam_id, &src->cam_dev);
   g_free (cam_id);
 
   if (err != 0) {
     GST_ELEMENT_ERROR (src, LIBRARY, INIT,
-        ("failed to open camera device %d: %d", src->camera_device, err),
-        (NULL));
+        ("failed to open camera %d: %d", id, err), (NULL));
     goto cleanup;
   }
 
@@ -546,7 +872,12 @@ gst_droid_cam_src_setup_pipeline (GstDroidCamSrc * src)
 
   g_mutex_lock (&src->params_lock);
   params = src->dev->ops->get_parameters (src->dev);
-  src->camera_params = camera_params_from_string (params);
+
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_hal_trace_record_string (src->hal_trace, GST_HAL_TRACE_PARAMS, params);
+  }
+
+  camera_params = camera_params_from_string (params);
   if (src->dev->ops->put_parameters) {
     src->dev->ops->put_parameters (src->dev, params);
   } else {
@@ -554,12 +885,43 @@ gst_droid_cam_src_setup_pipeline (GstDroidCamSrc * src)
   }
   g_mutex_unlock (&src->params_lock);
 
-  gst_photo_iface_init_ev_comp (src);
+  GST_OBJECT_LOCK (src);
+  gst_droid_cam_src_publish_camera_params (src, camera_params);
+
+  /* The parameter value lists do not change while the module is loaded */
+  if (!info->capabilities_known) {
+    info->capabilities = 0;
+
+    if (camera_params_is_supported (camera_params, CAMERA_PARAM_DENOISE,
+            "denoise-on")) {
+      info->capabilities |= GST_CAMERA_MODULE_CAP_DENOISE;
+    }
+
+    if (camera_params_is_supported (camera_params, CAMERA_PARAM_FLASH_MODE,
+            "torch")) {
+      info->capabilities |= GST_CAMERA_MODULE_CAP_TORCH;
+    }
+
+    info->capabilities_known = TRUE;
+
+    GST_INFO_OBJECT (src, "camera %d capabilities 0x%x", id,
+        info->capabilities);
+
+    /* Instances probing later do not need to find out again */
+    gst_camera_module_set_capabilities (src->module, id, info->capabilities);
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  gst_droid_cam_src_camera_params_changed (src, CAMERA_PARAM_MASK_ALL);
   gst_photo_iface_settings_to_params (src);
 
-  /* TODO: If we end up with a device with 1 camera then this will break. */
-  if (src->camera_device == 0) {
+  if (gst_droid_cam_src_has_camera_capability (src,
+          GST_CAMERA_MODULE_CAP_DENOISE)) {
     gst_droid_cam_src_apply_image_noise_reduction (src);
+  }
+
+  if (gst_droid_cam_src_has_camera_capability (src,
+          GST_CAMERA_MODULE_CAP_TORCH)) {
     gst_droid_cam_src_adjust_video_torch (src);
   }
 
@@ -568,7 +930,7 @@ gst_droid_cam_src_setup_pipeline (GstDroidCamSrc * src)
   }
 
   GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
-  src->pool->orientation = src->device_info[src->camera_device].orientation;
+  src->pool->orientation = orientation;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
   return TRUE;
@@ -581,80 +943,89 @@ cleanup:
 static gboolean
 gst_droid_cam_src_probe_camera (GstDroidCamSrc * src)
 {
-  int err;
-  int num_of_cameras;
-  struct camera_info info;
-  int x;
+  GError *error = NULL;
 
   GST_DEBUG_OBJECT (src, "probe camera");
 
-  src->gralloc = gst_gralloc_new ();
-  if (!src->gralloc) {
-    GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("Could not initialize gralloc"),
-        (NULL));
+  src->module = gst_camera_module_obtain (&error);
+  if (!src->module) {
+    GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("%s", error->message), (NULL));
+    g_error_free (error);
     goto cleanup;
   }
 
+  src->hwmod = src->module->hwmod;
+  src->cam = src->module->cam;
+  src->gralloc = gst_gralloc_ref (src->module->gralloc);
+
   src->pool = gst_camera_buffer_pool_new (GST_ELEMENT (src), src->gralloc);
+  src->pool->scheduler = src->scheduler;
+  gst_camera_buffer_pool_set_max_bytes (src->pool, src->max_pool_bytes);
+  gst_droid_cam_src_apply_pool_idle_timeout (src);
 
-  err =
-      hw_get_module (CAMERA_HARDWARE_MODULE_ID,
-      (const hw_module_t **) &src->hwmod);
-  if (err != 0) {
-    GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("Could not get camera handle: %d",
-            err), (NULL));
-    goto cleanup;
-  }
+  GST_OBJECT_LOCK (src);
+  gst_camera_module_get_cameras (src->module, src->cameras);
+  GST_OBJECT_UNLOCK (src);
 
-  if (src->hwmod->module_api_version < HARDWARE_DEVICE_API_VERSION (0, 0)
-      || src->hwmod->module_api_version > HARDWARE_DEVICE_API_VERSION (1, 0xFF)) {
-    GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("Unknown camera API version 0x%x",
-            src->hwmod->module_api_version), (NULL));
-    goto cleanup;
-  }
+  GST_INFO_OBJECT (src, "number of cameras: %d", src->cameras->len);
 
-  src->cam = (camera_module_t *) src->hwmod;
+  g_object_notify (G_OBJECT (src), "num-cameras");
+  g_object_notify (G_OBJECT (src), "sensor-mount-angle");
 
-  num_of_cameras = src->cam->get_number_of_cameras ();
-  GST_INFO_OBJECT (src, "number of cameras: %d", num_of_cameras);
+  return TRUE;
 
-  if (num_of_cameras > 2) {
-    GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("number of cameras is more than 2"),
-        (NULL));
-    goto cleanup;
+cleanup:
+  gst_droid_cam_src_tear_down_pipeline (src);
+  return FALSE;
+}
+
+/*
+ * with object lock. The camera in use or, if none is, the one setting up
+ * would pick. NULL if there is no such camera.
+ */
+static GstDroidCamSrcCameraInfo *
+gst_droid_cam_src_get_camera_info_unlocked (GstDroidCamSrc * src)
+{
+  guint x;
+
+  if (src->camera_index != -1) {
+    return &g_array_index (src->cameras, GstDroidCamSrcCameraInfo,
+        src->camera_index);
   }
 
-  for (x = 0; x < num_of_cameras; x++) {
-    int dev;
-    err = src->cam->get_camera_info (x, &info);
-    if (err != 0) {
-      GST_WARNING_OBJECT (src, "Error %d getting camera %d info", err, x);
-      continue;
-    }
+  for (x = 0; x < src->cameras->len; x++) {
+    GstDroidCamSrcCameraInfo *info =
+        &g_array_index (src->cameras, GstDroidCamSrcCameraInfo, x);
 
-    /* Now we have info. Let's fill our structs */
-    if (info.facing == CAMERA_FACING_BACK) {
-      dev = 0;
-    } else if (info.facing == CAMERA_FACING_FRONT) {
-      dev = 1;
-    } else {
-      GST_WARNING_OBJECT (src, "Unknown camera %d", x);
-      continue;
+    if (src->user_camera_index != -1) {
+      if (info->id == src->user_camera_index) {
+        return info;
+      }
+    } else if (info->facing == src->user_camera_device) {
+      return info;
     }
+  }
 
-    src->device_info[dev].id = x;
-    src->device_info[dev].orientation = info.orientation;
+  return NULL;
+}
 
-    GST_INFO_OBJECT (src, "camera %d with orientation %d", x, info.orientation);
-  }
+/* Whether the camera in use supports capability */
+static gboolean
+gst_droid_cam_src_has_camera_capability (GstDroidCamSrc * src,
+    guint capability)
+{
+  gboolean ret = FALSE;
 
-  g_object_notify (G_OBJECT (src), "sensor-mount-angle");
+  GST_OBJECT_LOCK (src);
 
-  return TRUE;
+  if (src->camera_index != -1) {
+    ret = (g_array_index (src->cameras, GstDroidCamSrcCameraInfo,
+            src->camera_index).capabilities & capability) != 0;
+  }
 
-cleanup:
-  gst_droid_cam_src_tear_down_pipeline (src);
-  return FALSE;
+  GST_OBJECT_UNLOCK (src);
+
+  return ret;
 }
 
 static void
@@ -667,7 +1038,15 @@ gst_droid_cam_src_tear_down_pipeline (GstDroidCamSrc * src)
     src->cam_dev = NULL;
   }
 
+  GST_OBJECT_LOCK (src);
+  src->camera_index = -1;
+  GST_OBJECT_UNLOCK (src);
+
+  gst_droid_cam_src_stop_hal_trace (src);
+
   if (src->pool) {
+    /* Drops the reference a pending idle timeout holds */
+    gst_camera_buffer_pool_set_idle (src->pool, FALSE);
     gst_camera_buffer_pool_unref (src->pool);
     src->pool = NULL;
   }
@@ -677,14 +1056,87 @@ gst_droid_cam_src_tear_down_pipeline (GstDroidCamSrc * src)
     src->gralloc = NULL;
   }
 
-  if (src->camera_params) {
-    camera_params_free (src->camera_params);
-    src->camera_params = NULL;
-  }
+  GST_OBJECT_LOCK (src);
+  gst_droid_cam_src_publish_camera_params (src, NULL);
+  GST_OBJECT_UNLOCK (src);
 
   src->hwmod = NULL;
   src->cam = NULL;
   src->dev = NULL;
+
+  if (src->module) {
+    gst_camera_module_unref (src->module);
+    src->module = NULL;
+  }
+}
+
+static void
+gst_droid_cam_src_start_hal_trace (GstDroidCamSrc * src)
+{
+  gchar *location;
+  GError *error = NULL;
+
+  if (src->hal_trace) {
+    /* Still recording since the camera was last opened */
+    return;
+  }
+
+  GST_OBJECT_LOCK (src);
+  location = g_strdup (src->hal_trace_location);
+  GST_OBJECT_UNLOCK (src);
+
+  if (!location || !location[0]) {
+    g_free (location);
+    return;
+  }
+
+  src->hal_trace = gst_hal_trace_new (location, &error);
+  if (!src->hal_trace) {
+    GST_ELEMENT_WARNING (src, RESOURCE, OPEN_WRITE,
+        ("Could not record HAL trace"), ("%s", error->message));
+    g_error_free (error);
+  } else {
+    GST_INFO_OBJECT (src, "recording HAL trace to %s", location);
+  }
+
+  g_free (location);
+
+  GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
+  src->pool->trace = src->hal_trace;
+  GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
+}
+
+/* Only once the camera is closed so no callback can be in flight */
+static void
+gst_droid_cam_src_stop_hal_trace (GstDroidCamSrc * src)
+{
+  if (!src->hal_trace) {
+    return;
+  }
+
+  if (src->pool) {
+    GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
+    src->pool->trace = NULL;
+    GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
+  }
+
+  gst_hal_trace_free (src->hal_trace);
+  src->hal_trace = NULL;
+}
+
+static void
+gst_droid_cam_src_trace_data (GstDroidCamSrc * src, GstHalTraceEvent event,
+    int32_t msg_type, const camera_memory_t * mem, unsigned int index,
+    int64_t timestamp)
+{
+  int size = 0;
+
+  if (mem) {
+    gst_camera_memory_get_data (mem, index, &size);
+  }
+
+  gst_hal_trace_record (src->hal_trace, event, msg_type, index, 0, size,
+      timestamp);
 }
 
 static gboolean
@@ -696,7 +1148,8 @@ gst_droid_cam_src_set_callbacks (GstDroidCamSrc * src)
 
   src->dev->ops->set_callbacks (src->dev, gst_droid_cam_src_notify_callback,
       gst_droid_cam_src_data_callback,
-      gst_droid_cam_src_data_timestamp_callback, gst_camera_memory_get, src);
+      gst_droid_cam_src_data_timestamp_callback,
+      gst_droid_cam_src_request_memory, src);
 
   err = src->dev->ops->set_preview_window (src->dev, &src->pool->window);
 
@@ -708,22 +1161,88 @@ gst_droid_cam_src_set_callbacks (GstDroidCamSrc * src)
   return TRUE;
 }
 
+static GstCameraMemoryBackend
+gst_droid_cam_src_default_memory_backend (void)
+{
+  const gchar *env = g_getenv (MEMORY_BACKEND_ENV);
+  GEnumClass *klass;
+  GEnumValue *value;
+  GstCameraMemoryBackend backend = DEFAULT_MEMORY_BACKEND;
+
+  if (!env) {
+    return backend;
+  }
+
+  klass = g_type_class_ref (GST_TYPE_DROID_CAM_SRC_MEMORY_BACKEND);
+  value = g_enum_get_value_by_nick (klass, env);
+  if (value) {
+    backend = value->value;
+  } else {
+    GST_WARNING ("unknown memory backend %s", env);
+  }
+
+  g_type_class_unref (klass);
+
+  return backend;
+}
+
+static camera_memory_t *
+gst_droid_cam_src_request_memory (int fd, size_t buf_size,
+    unsigned int num_bufs, void *user)
+{
+  GstDroidCamSrc *src = (GstDroidCamSrc *) user;
+  GstCameraMemoryBackend backend;
+
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_hal_trace_record (src->hal_trace, GST_HAL_TRACE_REQUEST_MEMORY, fd,
+        num_bufs, 0, buf_size, 0);
+  }
+
+  GST_OBJECT_LOCK (src);
+  backend = src->memory_backend;
+  GST_OBJECT_UNLOCK (src);
+
+  GST_DEBUG_OBJECT (src, "request memory: fd %d, %u buffers of size %"
+      G_GSIZE_FORMAT ", backend %d", fd, num_bufs, buf_size, backend);
+
+  return gst_camera_memory_get_full (fd, buf_size, num_bufs, backend);
+}
+
 static gboolean
 gst_droid_cam_src_set_camera_params (GstDroidCamSrc * src)
 {
   int err;
   gchar *params;
+  struct camera_params *camera_params;
   gboolean ret = TRUE;
 
-  // TODO: locking
+  GST_OBJECT_LOCK (src);
+  if (!src->camera_params) {
+    /* setup_pipeline () will apply our settings */
+    GST_OBJECT_UNLOCK (src);
+    return TRUE;
+  }
 
-  GST_DEBUG_OBJECT (src, "set params");
+  if (!camera_params_is_dirty (src->camera_params)) {
+    GST_OBJECT_UNLOCK (src);
+    GST_LOG_OBJECT (src, "params unchanged");
+    return TRUE;
+  }
 
-  GST_OBJECT_LOCK (src);
   params = camera_params_to_string (src->camera_params);
+  camera_params = gst_droid_cam_src_edit_camera_params (src);
+  camera_params_clear_dirty (camera_params);
+  gst_droid_cam_src_publish_camera_params (src, camera_params);
   GST_OBJECT_UNLOCK (src);
 
+  GST_DEBUG_OBJECT (src, "set params");
+
   g_mutex_lock (&src->params_lock);
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_hal_trace_record_string (src->hal_trace, GST_HAL_TRACE_SET_PARAMS,
+        params);
+  }
+
   err = src->dev->ops->set_parameters (src->dev, params);
   free (params);
   g_mutex_unlock (&src->params_lock);
@@ -732,11 +1251,176 @@ gst_droid_cam_src_set_camera_params (GstDroidCamSrc * src)
     GST_ELEMENT_ERROR (src, LIBRARY, INIT,
         ("Could not set camera parameters: %d", err), (NULL));
     ret = FALSE;
+
+    /*
+     * The snapshot went clean before the HAL saw it. Take back what the HAL
+     * refused or setting the same value again would be a no-op.
+     */
+    gst_droid_cam_src_refresh_camera_params (src);
+  }
+
+  return ret;
+}
+
+struct camera_params *
+gst_droid_cam_src_get_camera_params (GstDroidCamSrc * src)
+{
+  struct camera_params *params;
+
+  /* Keeps a writer from dropping the snapshot before we have our ref */
+  g_bit_lock (&src->camera_params_lock, 0);
+  params = g_atomic_pointer_get (&src->camera_params);
+  if (params) {
+    camera_params_ref (params);
+  }
+  g_bit_unlock (&src->camera_params_lock, 0);
+
+  return params;
+}
+
+/* Must be called with the object lock held */
+struct camera_params *
+gst_droid_cam_src_edit_camera_params (GstDroidCamSrc * src)
+{
+  if (!src->camera_params) {
+    return NULL;
+  }
+
+  return camera_params_copy (src->camera_params);
+}
+
+/* Must be called with the object lock held. Takes ownership of params */
+void
+gst_droid_cam_src_publish_camera_params (GstDroidCamSrc * src,
+    struct camera_params *params)
+{
+  struct camera_params *old;
+
+  if (params) {
+    camera_params_prepare (params);
+  }
+
+  g_bit_lock (&src->camera_params_lock, 0);
+  old = src->camera_params;
+  g_atomic_pointer_set (&src->camera_params, params);
+  g_bit_unlock (&src->camera_params_lock, 0);
+
+  if (old) {
+    camera_params_unref (old);
+  }
+}
+
+/* Must be called with the object lock held */
+gboolean
+gst_droid_cam_src_set_camera_param (GstDroidCamSrc * src, CameraParamKey key,
+    const gchar * value)
+{
+  struct camera_params *params;
+  const char *old;
+
+  if (!src->camera_params) {
+    return FALSE;
+  }
+
+  if (!camera_params_is_supported (src->camera_params, key, value)) {
+    GST_WARNING_OBJECT (src, "%s=%s is not supported by the camera",
+        camera_params_key_name (key), value);
+    return FALSE;
+  }
+
+  old = camera_params_get_key (src->camera_params, key);
+  if (old && !strcmp (old, value)) {
+    /* No need for a new snapshot */
+    return TRUE;
+  }
+
+  params = camera_params_copy (src->camera_params);
+  camera_params_set_key (params, key, value);
+  gst_droid_cam_src_publish_camera_params (src, params);
+
+  return TRUE;
+}
+
+/* Size the camera is set to for the preview, pictures or video */
+gboolean
+gst_droid_cam_src_get_camera_size (GstDroidCamSrc * src, CameraParamKey key,
+    gint * width, gint * height)
+{
+  struct camera_params *params = gst_droid_cam_src_get_camera_params (src);
+  gboolean ret = FALSE;
+
+  if (params) {
+    ret = gst_camera_fixate_parse_size (camera_params_get_key (params, key),
+        width, height);
+    camera_params_unref (params);
   }
 
   return ret;
 }
 
+static gboolean
+gst_droid_cam_src_peer_caps_equal (GstCaps * a, GstCaps * b)
+{
+  if (!a || !b) {
+    return a == b;
+  }
+
+  return gst_caps_is_equal (a, b);
+}
+
+/* Returns a reference to the caps negotiated last time if they still apply */
+GstCaps *
+gst_droid_cam_src_lookup_negotiation (GstDroidCamSrc * src,
+    GstDroidCamSrcNegotiation * negotiation, GstCaps * peer)
+{
+  GstCaps *caps = NULL;
+  gint width = 0, height = 0;
+
+  gst_droid_cam_src_get_camera_size (src, CAMERA_PARAM_PREVIEW_SIZE, &width,
+      &height);
+
+  GST_OBJECT_LOCK (src);
+
+  if (negotiation->caps && negotiation->camera_index == src->camera_index
+      && negotiation->preview_width == width
+      && negotiation->preview_height == height
+      && gst_droid_cam_src_peer_caps_equal (negotiation->peer, peer)) {
+    caps = gst_caps_ref (negotiation->caps);
+  }
+
+  GST_OBJECT_UNLOCK (src);
+
+  return caps;
+}
+
+void
+gst_droid_cam_src_store_negotiation (GstDroidCamSrc * src,
+    GstDroidCamSrcNegotiation * negotiation, GstCaps * peer, GstCaps * caps)
+{
+  gint width = 0, height = 0;
+
+  gst_droid_cam_src_get_camera_size (src, CAMERA_PARAM_PREVIEW_SIZE, &width,
+      &height);
+
+  GST_OBJECT_LOCK (src);
+
+  negotiation->preview_width = width;
+  negotiation->preview_height = height;
+
+  gst_caps_replace (&negotiation->peer, peer);
+  gst_caps_replace (&negotiation->caps, caps);
+  negotiation->camera_index = src->camera_index;
+
+  GST_OBJECT_UNLOCK (src);
+}
+
+static void
+gst_droid_cam_src_clear_negotiation (GstDroidCamSrcNegotiation * negotiation)
+{
+  gst_caps_replace (&negotiation->peer, NULL);
+  gst_caps_replace (&negotiation->caps, NULL);
+}
+
 static gboolean
 gst_droid_cam_src_open_segment (GstDroidCamSrc * src, GstPad * pad)
 {
@@ -744,24 +1428,89 @@ gst_droid_cam_src_open_segment (GstDroidCamSrc * src, GstPad * pad)
 
   GST_DEBUG_OBJECT (src, "open segment");
 
-  event = gst_event_new_new_segment_full (FALSE,
-      src->segment.rate, src->segment.applied_rate, src->segment.format,
-      src->segment.start, src->segment.duration, src->segment.time);
+  gst_droid_cam_src_sync_segment (src);
+
+  event = gst_event_new_new_segment_full (FALSE,
+      src->segment.rate, src->segment.applied_rate, src->segment.format,
+      src->segment.start, src->segment.duration, src->segment.time);
+
+  return gst_pad_push_event (pad, event);
+}
+
+static GstDroidCamSrcPosition *
+gst_droid_cam_src_get_position (GstDroidCamSrc * src, GstPad * pad)
+{
+  if (pad == src->vfsrc) {
+    return &src->positions[GST_CAMERA_SCHEDULER_VIEWFINDER];
+  } else if (pad == src->imgsrc) {
+    return &src->positions[GST_CAMERA_SCHEDULER_IMAGE];
+  } else {
+    return &src->positions[GST_CAMERA_SCHEDULER_VIDEO];
+  }
+}
+
+/* Called for every buffer so it only bumps the pad position */
+static void
+gst_droid_cam_src_update_segment (GstDroidCamSrc * src, GstPad * pad,
+    GstBuffer * buffer)
+{
+  GstDroidCamSrcPosition *position = gst_droid_cam_src_get_position (src, pad);
+
+  if (!GST_BUFFER_TIMESTAMP_IS_VALID (buffer)) {
+    return;
+  }
+
+  g_atomic_int_inc (&position->seq);
+  position->last_stop = GST_BUFFER_TIMESTAMP (buffer);
+  if (GST_BUFFER_DURATION_IS_VALID (buffer)) {
+    position->last_stop += GST_BUFFER_DURATION (buffer);
+  }
+  g_atomic_int_inc (&position->seq);
+}
+
+static void
+gst_droid_cam_src_reset_positions (GstDroidCamSrc * src)
+{
+  int x;
 
-  return gst_pad_push_event (pad, event);
+  /* Nothing is pushing */
+  for (x = 0; x < GST_CAMERA_SCHEDULER_NUM_SOURCES; x++) {
+    g_atomic_int_inc (&src->positions[x].seq);
+    src->positions[x].last_stop = GST_CLOCK_TIME_NONE;
+    g_atomic_int_inc (&src->positions[x].seq);
+  }
 }
 
+/* Moves the segment on to where the furthest pad got */
 static void
-gst_droid_cam_src_update_segment (GstDroidCamSrc * src, GstBuffer * buffer)
+gst_droid_cam_src_sync_segment (GstDroidCamSrc * src)
 {
-  gint64 position;
+  GstDroidCamSrcPosition *position;
+  GstClockTime last_stop = GST_CLOCK_TIME_NONE;
+  GstClockTime pos;
+  gint seq;
+  int x;
+
+  for (x = 0; x < GST_CAMERA_SCHEDULER_NUM_SOURCES; x++) {
+    position = &src->positions[x];
+
+    do {
+      seq = g_atomic_int_get (&position->seq);
+      pos = position->last_stop;
+    } while ((seq & 1) || g_atomic_int_get (&position->seq) != seq);
 
-  GST_LOG_OBJECT (src, "update segment");
+    if (GST_CLOCK_TIME_IS_VALID (pos)
+        && (!GST_CLOCK_TIME_IS_VALID (last_stop) || pos > last_stop)) {
+      last_stop = pos;
+    }
+  }
 
-  position = GST_BUFFER_TIMESTAMP (buffer) + GST_BUFFER_DURATION (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (last_stop)) {
+    return;
+  }
 
   GST_OBJECT_LOCK (src);
-  gst_segment_set_last_stop (&src->segment, src->segment.format, position);
+  gst_segment_set_last_stop (&src->segment, src->segment.format, last_stop);
   GST_OBJECT_UNLOCK (src);
 }
 
@@ -794,6 +1543,9 @@ gst_droid_cam_src_change_state (GstElement * element, GstStateChange transition)
       break;
 
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      /* Our parent has just given us a new base time */
+      gst_droid_cam_src_update_clock (src);
+
       if (!gst_droid_cam_src_start_pipeline (src)) {
         ret = GST_STATE_CHANGE_FAILURE;
       }
@@ -832,16 +1584,32 @@ gst_droid_cam_src_change_state (GstElement * element, GstStateChange transition)
       break;
 
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* Our pads are inactive so nothing is being pushed anymore */
+      gst_camera_scheduler_shutdown (src->scheduler);
+
+      /* Cheap unless the peers or the camera changed. See *_negotiation () */
       src->image_renegotiate = TRUE;
       src->video_renegotiate = TRUE;
       /* TODO: is this the right thing to do? */
       /* TODO: do we need locking here? */
       src->capturing = FALSE;
       gst_segment_init (&src->segment, GST_FORMAT_TIME);
+      gst_droid_cam_src_reset_positions (src);
       break;
 
     case GST_STATE_CHANGE_READY_TO_NULL:
       gst_droid_cam_src_tear_down_pipeline (src);
+      /* No more callbacks */
+      gst_droid_cam_src_release_clocks (src);
+
+      /* Do not let a forgotten commit-params hold back the next camera */
+      GST_OBJECT_LOCK (src);
+      if (src->params_batch != 0) {
+        GST_WARNING_OBJECT (src, "%d begin-params without commit-params",
+            src->params_batch);
+        src->params_batch = 0;
+      }
+      GST_OBJECT_UNLOCK (src);
       break;
 
     default:
@@ -858,6 +1626,88 @@ out:
   return ret;
 }
 
+static gboolean
+gst_droid_cam_src_set_clock (GstElement * element, GstClock * clock)
+{
+  GstDroidCamSrc *src = GST_DROID_CAM_SRC (element);
+  gboolean ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->set_clock (element, clock);
+
+  gst_droid_cam_src_update_clock (src);
+
+  return ret;
+}
+
+/* Takes a snapshot of our clock and base time for the HAL callbacks */
+static void
+gst_droid_cam_src_update_clock (GstDroidCamSrc * src)
+{
+  GstClock *clock;
+  GstClock *old;
+
+  GST_OBJECT_LOCK (src);
+
+  clock = GST_ELEMENT_CLOCK (src);
+  if (clock) {
+    gst_object_ref (clock);
+  }
+
+  old = src->ts_clock;
+
+  /* Odd while the snapshot is being written */
+  g_atomic_int_inc (&src->clock_seq);
+  src->ts_clock = clock;
+  src->ts_base_time = GST_ELEMENT (src)->base_time;
+  g_atomic_int_inc (&src->clock_seq);
+
+  GST_DEBUG_OBJECT (src, "clock %" GST_PTR_FORMAT ", base time %"
+      GST_TIME_FORMAT, clock, GST_TIME_ARGS (src->ts_base_time));
+
+  if (old == clock) {
+    gst_object_unref (old);
+  } else if (old) {
+    /* A callback might be asking it for the time right now */
+    src->old_clocks = g_slist_prepend (src->old_clocks, old);
+  }
+
+  GST_OBJECT_UNLOCK (src);
+}
+
+static void
+gst_droid_cam_src_release_clocks (GstDroidCamSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  g_slist_free_full (src->old_clocks, (GDestroyNotify) gst_object_unref);
+  src->old_clocks = NULL;
+  GST_OBJECT_UNLOCK (src);
+}
+
+/*
+ * Clock time minus base time, or GST_CLOCK_TIME_NONE without a clock. Called
+ * for every frame from the HAL callbacks so it does not lock anything.
+ */
+GstClockTime
+gst_droid_cam_src_get_running_time (GstDroidCamSrc * src)
+{
+  GstClock *clock;
+  GstClockTime base_time;
+  gint seq;
+
+  /* The atomic reads are full barriers so the plain read stays between them */
+  do {
+    seq = g_atomic_int_get (&src->clock_seq);
+    clock = g_atomic_pointer_get (&src->ts_clock);
+    base_time = src->ts_base_time;
+  } while ((seq & 1) || g_atomic_int_get (&src->clock_seq) != seq);
+
+  if (!clock) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return gst_clock_get_time (clock) - base_time;
+}
+
 static gboolean
 gst_droid_cam_src_send_event (GstElement * element, GstEvent * event)
 {
@@ -884,10 +1734,9 @@ gst_droid_cam_src_send_event (GstElement * element, GstEvent * event)
       src->pool->flushing = TRUE;
       GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-      gst_camera_buffer_pool_unlock_app_queue (src->pool);
-
       GST_PAD_STREAM_LOCK (src->vfsrc);
-      gst_pad_pause_task (src->vfsrc);
+      gst_camera_scheduler_pause (src->scheduler,
+          GST_CAMERA_SCHEDULER_VIEWFINDER);
       GST_PAD_STREAM_UNLOCK (src->vfsrc);
 
       ret = gst_pad_push_event (src->vfsrc, event);
@@ -921,9 +1770,7 @@ gst_droid_cam_src_send_event (GstElement * element, GstEvent * event)
       } else if (GST_EVENT_IS_SERIALIZED (event)) {
         GST_DEBUG_OBJECT (src, "queueing event %p", event);
 
-        GST_OBJECT_LOCK (src);
-        src->events = g_list_append (src->events, event);
-        GST_OBJECT_UNLOCK (src);
+        gst_camera_event_queue_push (&src->events, event);
         event = NULL;
 
       } else {
@@ -952,6 +1799,7 @@ gst_droid_cam_src_get_query_types (GstElement * element)
   static const GstQueryType query_types[] = {
     GST_QUERY_LATENCY,
     GST_QUERY_FORMATS,
+    GST_QUERY_POSITION,
     0
   };
 
@@ -965,6 +1813,7 @@ gst_droid_cam_src_query (GstElement * element, GstQuery * query)
 {
   gboolean ret = TRUE;
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (element);
+  GstClockTime min_latency, max_latency;
 
   GST_DEBUG_OBJECT (src, "query");
 
@@ -988,9 +1837,15 @@ gst_droid_cam_src_query (GstElement * element, GstQuery * query)
         break;
       }
 
+      /*
+       * A variable rate preview can hold on to every buffer for as long
+       * as the slowest frame takes
+       */
+      min_latency = src->pool->buffer_duration;
+      max_latency = src->pool->count * src->pool->max_buffer_duration;
+
       GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
-      gst_query_set_latency (query, TRUE, src->pool->buffer_duration,
-          src->pool->count * src->pool->buffer_duration);
+      gst_query_set_latency (query, TRUE, min_latency, max_latency);
 
       GST_DEBUG_OBJECT (src, "latency query result %" GST_PTR_FORMAT, query);
 
@@ -1002,6 +1857,27 @@ gst_droid_cam_src_query (GstElement * element, GstQuery * query)
       ret = TRUE;
       break;
 
+    case GST_QUERY_POSITION:{
+      GstFormat format;
+      gint64 position;
+
+      gst_query_parse_position (query, &format, NULL);
+      if (format != GST_FORMAT_TIME) {
+        ret = FALSE;
+        break;
+      }
+
+      gst_droid_cam_src_sync_segment (src);
+
+      GST_OBJECT_LOCK (src);
+      position = src->segment.last_stop;
+      GST_OBJECT_UNLOCK (src);
+
+      gst_query_set_position (query, GST_FORMAT_TIME, position);
+      ret = TRUE;
+      break;
+    }
+
     default:
       ret = FALSE;
       break;
@@ -1033,6 +1909,10 @@ gst_droid_cam_src_start_pipeline (GstDroidCamSrc * src)
   gst_droid_cam_src_set_recording_hint (src, FALSE);
 #endif
 
+  /* Anything released while preview was stopped gets allocated again */
+  gst_camera_buffer_pool_set_idle (src->pool, FALSE);
+
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_START_PREVIEW, 0, 0, 0);
   err = src->dev->ops->start_preview (src->dev);
   if (err != 0) {
     GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("Could not start camera: %d", err),
@@ -1049,7 +1929,7 @@ gst_droid_cam_src_start_pipeline (GstDroidCamSrc * src)
   }
 #endif
 
-  gst_droid_cam_src_update_max_zoom (src);
+  gst_droid_cam_src_refresh_camera_params (src);
 
   return TRUE;
 }
@@ -1059,10 +1939,13 @@ gst_droid_cam_src_stop_pipeline (GstDroidCamSrc * src)
 {
   GST_DEBUG_OBJECT (src, "stop pipeline");
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_STOP_PREVIEW, 0, 0, 0);
   src->dev->ops->stop_preview (src->dev);
 
   /* TODO: Not sure this is correct */
   gst_camera_buffer_pool_unlock_hal_queue (src->pool);
+
+  gst_camera_buffer_pool_set_idle (src->pool, TRUE);
 }
 
 static void
@@ -1141,6 +2024,75 @@ gst_droid_cam_src_stop_capture (GstDroidCamSrc * src)
   }
 }
 
+/*
+ * Parameters changed between begin-params and the matching commit-params
+ * are sent to the HAL with a single set_parameters () call.
+ * Batches can be nested; only the outermost commit talks to the HAL.
+ */
+static void
+gst_droid_cam_src_begin_params (GstDroidCamSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  ++src->params_batch;
+  GST_DEBUG_OBJECT (src, "begin params (depth %d)", src->params_batch);
+  GST_OBJECT_UNLOCK (src);
+}
+
+static void
+gst_droid_cam_src_commit_params (GstDroidCamSrc * src)
+{
+  gint depth;
+
+  GST_OBJECT_LOCK (src);
+  if (src->params_batch == 0) {
+    GST_OBJECT_UNLOCK (src);
+    GST_WARNING_OBJECT (src, "commit params without begin params");
+    return;
+  }
+
+  depth = --src->params_batch;
+  GST_OBJECT_UNLOCK (src);
+
+  GST_DEBUG_OBJECT (src, "commit params (depth %d)", depth);
+
+  if (depth == 0) {
+    gst_droid_cam_src_set_camera_params (src);
+  }
+}
+
+/*
+ * For settings the app changes: waits for the outermost commit-params while
+ * a batch is open. Negotiation and capturing need the HAL to have their
+ * parameters and call set_camera_params directly, taking along anything the
+ * batch changed so far.
+ */
+gboolean
+gst_droid_cam_src_set_camera_params_deferred (GstDroidCamSrc * src)
+{
+  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean deferred;
+
+  GST_OBJECT_LOCK (src);
+  deferred = src->params_batch > 0;
+  GST_OBJECT_UNLOCK (src);
+
+  if (deferred) {
+    GST_LOG_OBJECT (src, "deferring params");
+    return TRUE;
+  }
+
+  return klass->set_camera_params (src);
+}
+
+static void
+gst_droid_cam_src_invalidate_module_cache (GstDroidCamSrc * src)
+{
+  GST_DEBUG_OBJECT (src, "invalidate module cache");
+
+  /* Instances out of NULL keep what they probed until they get back there */
+  gst_camera_module_invalidate ();
+}
+
 static gboolean
 gst_droid_cam_src_flush_buffers (GstDroidCamSrc * src)
 {
@@ -1151,19 +2103,11 @@ gst_droid_cam_src_flush_buffers (GstDroidCamSrc * src)
   src->pool->flushing = TRUE;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-  gst_camera_buffer_pool_unlock_app_queue (src->pool);
-
-  /* task has been paused by now */
-  GST_PAD_STREAM_LOCK (src->vfsrc);
-  GST_PAD_STREAM_UNLOCK (src->vfsrc);
-
-  gst_pad_stop_task (src->vfsrc);
+  /* Returns once the viewfinder is no longer being pushed */
+  gst_camera_scheduler_stop (src->scheduler, GST_CAMERA_SCHEDULER_VIEWFINDER);
 
   /* clear any pending events */
-  GST_OBJECT_LOCK (src);
-  g_list_free_full (src->events, (GDestroyNotify) gst_event_unref);
-  src->events = NULL;
-  GST_OBJECT_UNLOCK (src);
+  gst_camera_event_queue_clear (&src->events);
 
   gst_camera_buffer_pool_drain_app_queue (src->pool);
 
@@ -1190,6 +2134,11 @@ gst_droid_cam_src_start_image_capture_unlocked (GstDroidCamSrc * src)
     src->image_renegotiate = FALSE;
   }
 
+  /* The picture has to be taken with what an open batch changed so far */
+  if (!gst_droid_cam_src_set_camera_params (src)) {
+    return FALSE;
+  }
+
   /* First we need to flush the viewfinder branch of the pipeline: */
   if (!gst_droid_cam_src_flush_buffers (src)) {
     return FALSE;
@@ -1203,6 +2152,7 @@ gst_droid_cam_src_start_image_capture_unlocked (GstDroidCamSrc * src)
   src->capture_end_sent = FALSE;
 
   /* start actual capturing */
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_TAKE_PICTURE, 0, 0, 0);
   err = src->dev->ops->take_picture (src->dev);
 
   if (err != 0) {
@@ -1233,13 +2183,20 @@ gst_droid_cam_src_start_video_capture_unlocked (GstDroidCamSrc * src)
     src->video_renegotiate = FALSE;
   }
 
+  /* Recording has to start with what an open batch changed so far */
+  if (!gst_droid_cam_src_set_camera_params (src)) {
+    return FALSE;
+  }
+
   /* First we need to flush the viewfinder branch of the pipeline: */
   if (!gst_droid_cam_src_flush_buffers (src)) {
     return FALSE;
   }
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_STOP_PREVIEW, 0, 0, 0);
   src->dev->ops->stop_preview (src->dev);
   gst_camera_buffer_pool_clear (src->pool);
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_START_PREVIEW, 0, 0, 0);
   err = src->dev->ops->start_preview (src->dev);
   if (err != 0) {
     GST_ELEMENT_ERROR (src, LIBRARY, INIT, ("Could not start camera: %d", err),
@@ -1274,6 +2231,7 @@ gst_droid_cam_src_start_video_capture_unlocked (GstDroidCamSrc * src)
   src->video_capture_status = VIDEO_CAPTURE_STARTING;
   g_mutex_unlock (&src->video_capture_status_lock);
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_START_RECORDING, 0, 0, 0);
   err = src->dev->ops->start_recording (src->dev);
   if (err != 0) {
     GST_WARNING_OBJECT (src, "failed to start video recording: %d");
@@ -1289,8 +2247,9 @@ gst_droid_cam_src_start_video_capture_unlocked (GstDroidCamSrc * src)
   src->pool->flushing = FALSE;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-  if (!gst_vf_src_pad_start_task (src->vfsrc)) {
-    GST_ERROR_OBJECT (src, "Failed to start viewfinder task");
+  if (!gst_camera_scheduler_start (src->scheduler,
+          GST_CAMERA_SCHEDULER_VIEWFINDER)) {
+    GST_ERROR_OBJECT (src, "Failed to start viewfinder");
     GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
     src->pool->flushing = TRUE;
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
@@ -1307,8 +2266,9 @@ out:
   src->pool->flushing = TRUE;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-  if (!gst_vf_src_pad_start_task (src->vfsrc)) {
-    GST_ERROR_OBJECT (src, "Failed to start viewfinder task");
+  if (!gst_camera_scheduler_start (src->scheduler,
+          GST_CAMERA_SCHEDULER_VIEWFINDER)) {
+    GST_ERROR_OBJECT (src, "Failed to start viewfinder");
   }
 
   return ret;
@@ -1350,6 +2310,9 @@ gst_droid_cam_src_stop_video_capture (GstDroidCamSrc * src)
   src->video_capture_status = VIDEO_CAPTURE_STOPPING;
   g_mutex_unlock (&src->video_capture_status_lock);
 
+  /* Rather than waiting for the next frame to notice */
+  gst_camera_scheduler_wakeup (src->scheduler, GST_CAMERA_SCHEDULER_VIDEO);
+
   /* Now check the status again */
   g_mutex_lock (&src->video_capture_status_lock);
   if (!(src->video_capture_status == VIDEO_CAPTURE_STOPPED)
@@ -1389,6 +2352,7 @@ gst_droid_cam_src_stop_video_capture (GstDroidCamSrc * src)
   g_mutex_unlock (&src->pushed_video_frames_lock);
 
   /* Now we really stop. */
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_STOP_RECORDING, 0, 0, 0);
   src->dev->ops->stop_recording (src->dev);
   GST_DEBUG_OBJECT (src, "HAL stopped recording");
 
@@ -1401,6 +2365,50 @@ gst_droid_cam_src_stop_video_capture (GstDroidCamSrc * src)
   g_mutex_unlock (&src->capturing_mutex);
 }
 
+static void
+gst_droid_cam_src_free_image_memory (gpointer data)
+{
+  camera_memory_t *mem = (camera_memory_t *) data;
+
+  mem->release (mem);
+}
+
+/*
+ * The HAL reuses its memory once the callback returns so the image gets
+ * copied anyway. With a memfd backend it is copied into one so it can be
+ * passed on by fd without copying it again.
+ */
+static GstBuffer *
+gst_droid_cam_src_new_image_buffer (GstDroidCamSrc * src, int size)
+{
+  GstCameraMemoryBackend backend;
+  camera_memory_t *mem;
+  GstBuffer *buffer;
+
+  GST_OBJECT_LOCK (src);
+  backend = src->memory_backend;
+  GST_OBJECT_UNLOCK (src);
+
+  if (backend == GST_CAMERA_MEMORY_BACKEND_MALLOC) {
+    return gst_buffer_new_and_alloc (size);
+  }
+
+  mem = gst_camera_memory_get_full (-1, size, 1, backend);
+  if (!mem) {
+    return gst_buffer_new_and_alloc (size);
+  }
+
+  buffer = gst_buffer_new ();
+  GST_BUFFER_DATA (buffer) = mem->data;
+  GST_BUFFER_SIZE (buffer) = size;
+  GST_BUFFER_MALLOCDATA (buffer) = (gpointer) mem;
+  GST_BUFFER_FREE_FUNC (buffer) = gst_droid_cam_src_free_image_memory;
+
+  gst_camera_memory_attach_fd (buffer, mem, 0);
+
+  return buffer;
+}
+
 static void
 gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
     const camera_memory_t * mem, unsigned int index,
@@ -1410,7 +2418,6 @@ gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
   void *data;
   int size;
   GstCaps *caps;
-  GstClock *clock;
   GstClockTime timestamp;
 
   GST_DEBUG_OBJECT (src, "handle compressed image");
@@ -1423,7 +2430,7 @@ gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
     goto stop;
   }
 
-  buffer = gst_buffer_new_and_alloc (size);
+  buffer = gst_droid_cam_src_new_image_buffer (src, size);
   caps = gst_pad_get_negotiated_caps (src->imgsrc);
   if (!caps) {
     GST_WARNING_OBJECT (src, "No negotiated caps on imgsrc pad");
@@ -1436,14 +2443,7 @@ gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
   memcpy (GST_BUFFER_DATA (buffer), data, size);
   GST_BUFFER_SIZE (buffer) = size;
 
-  GST_OBJECT_LOCK (src);
-  clock = GST_ELEMENT_CLOCK (src);
-
-  if (clock) {
-    timestamp = gst_clock_get_time (clock) - GST_ELEMENT (src)->base_time;
-  } else {
-    timestamp = GST_CLOCK_TIME_NONE;
-  }
+  timestamp = gst_droid_cam_src_get_running_time (src);
 
   GST_BUFFER_TIMESTAMP (buffer) = timestamp;
 
@@ -1453,24 +2453,17 @@ gst_droid_cam_src_handle_compressed_image (GstDroidCamSrc * src,
   g_mutex_lock (&src->img_lock);
 
   g_queue_push_tail (src->img_queue, buffer);
-  g_cond_signal (&src->img_cond);
 
   g_mutex_unlock (&src->img_lock);
 
-  GST_OBJECT_UNLOCK (src);
+  gst_camera_scheduler_wakeup (src->scheduler, GST_CAMERA_SCHEDULER_IMAGE);
+
   goto invoke_finish;
 
 stop:
-  g_mutex_lock (&src->img_lock);
-
-  src->img_task_running = FALSE;
-  g_cond_signal (&src->img_cond);
+  gst_camera_scheduler_stop (src->scheduler, GST_CAMERA_SCHEDULER_IMAGE);
 
-  g_mutex_unlock (&src->img_lock);
-
-  gst_pad_stop_task (src->imgsrc);
-
-  GST_DEBUG_OBJECT (src, "stopped imgsrc task");
+  GST_DEBUG_OBJECT (src, "stopped imgsrc");
 
 invoke_finish:
   /*
@@ -1494,6 +2487,7 @@ gst_droid_cam_src_finish_capture (GstDroidCamSrc * src)
 
   gst_camera_buffer_pool_clear (src->pool);
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_START_PREVIEW, 0, 0, 0);
   err = src->dev->ops->start_preview (src->dev);
 
   if (err != 0) {
@@ -1508,10 +2502,11 @@ gst_droid_cam_src_finish_capture (GstDroidCamSrc * src)
   src->pool->flushing = FALSE;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-  started = gst_vf_src_pad_start_task (src->vfsrc);
+  started = gst_camera_scheduler_start (src->scheduler,
+      GST_CAMERA_SCHEDULER_VIEWFINDER);
 
   if (!started) {
-    GST_ERROR_OBJECT (src, "Failed to start task");
+    GST_ERROR_OBJECT (src, "Failed to start viewfinder");
     GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
     src->pool->flushing = TRUE;
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
@@ -1534,6 +2529,11 @@ gst_droid_cam_src_data_callback (int32_t msg_type, const camera_memory_t * mem,
 {
   GstDroidCamSrc *src = (GstDroidCamSrc *) user_data;
 
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_droid_cam_src_trace_data (src, GST_HAL_TRACE_DATA, msg_type, mem,
+        index, 0);
+  }
+
   GST_DEBUG_OBJECT (src, "data callback");
   switch (msg_type) {
     case CAMERA_MSG_COMPRESSED_IMAGE:
@@ -1556,7 +2556,6 @@ gst_droid_cam_src_data_timestamp_callback (int64_t timestamp,
   void *video_data;
   int size;
   GstBuffer *buff;
-  GstClock *clock;
   GstClockTime ts;
   GstClockTime duration;
   GstCaps *caps;
@@ -1565,6 +2564,11 @@ gst_droid_cam_src_data_timestamp_callback (int64_t timestamp,
 
   src = (GstDroidCamSrc *) user;
 
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_droid_cam_src_trace_data (src, GST_HAL_TRACE_DATA_TIMESTAMP, msg_type,
+        data, index, timestamp);
+  }
+
   GST_DEBUG_OBJECT (src, "data timestamp callback");
 
   video_data = gst_camera_memory_get_data (data, index, &size);
@@ -1584,6 +2588,8 @@ gst_droid_cam_src_data_timestamp_callback (int64_t timestamp,
   if (drop_buffer) {
     GST_DEBUG_OBJECT (src, "video recording is stopping. Dropping buffer %p",
         video_data);
+    GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_RELEASE_RECORDING_FRAME, 0, 0,
+        0);
     src->dev->ops->release_recording_frame (src->dev, video_data);
     return;
   }
@@ -1605,19 +2611,12 @@ gst_droid_cam_src_data_timestamp_callback (int64_t timestamp,
   g_mutex_unlock (&src->num_video_frames_lock);
 
   GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
-  duration = src->pool->buffer_duration;
+  /* Video frames come at the preview rate */
+  duration = GST_CLOCK_TIME_IS_VALID (src->pool->frame_interval) ?
+      src->pool->frame_interval : src->pool->buffer_duration;
   GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-  GST_OBJECT_LOCK (src);
-  clock = GST_ELEMENT_CLOCK (src);
-
-  if (clock) {
-    ts = gst_clock_get_time (clock) - GST_ELEMENT (src)->base_time;
-  } else {
-    ts = GST_CLOCK_TIME_NONE;
-  }
-
-  GST_OBJECT_UNLOCK (src);
+  ts = gst_droid_cam_src_get_running_time (src);
 
   GST_BUFFER_DURATION (buff) = duration;
 
@@ -1639,12 +2638,16 @@ gst_droid_cam_src_data_timestamp_callback (int64_t timestamp,
   GST_BUFFER_MALLOCDATA (buff) = (gpointer) malloc_data;
   GST_BUFFER_FREE_FUNC (buff) = gst_droid_cam_src_free_video_buffer;
 
+  /* The frame stays in the HAL memory until the buffer is freed */
+  gst_camera_memory_attach_fd (buff, data, index);
+
   GST_LOG_OBJECT (src, "added buffer %p", buff);
 
   g_mutex_lock (&src->video_lock);
   g_queue_push_tail (src->video_queue, buff);
-  g_cond_signal (&src->video_cond);
   g_mutex_unlock (&src->video_lock);
+
+  gst_camera_scheduler_wakeup (src->scheduler, GST_CAMERA_SCHEDULER_VIDEO);
 }
 
 static void
@@ -1655,6 +2658,8 @@ gst_droid_cam_src_notify_callback (int32_t msg_type,
 
   src = (GstDroidCamSrc *) user;
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_NOTIFY, msg_type, ext1, ext2);
+
   GST_DEBUG_OBJECT (src, "notify callback: 0x%x, %i, %i", msg_type, ext1, ext2);
 
   /* TODO: more messages and error messages */
@@ -1709,10 +2714,12 @@ gst_droid_cam_src_set_recording_hint (GstDroidCamSrc * src, gboolean apply)
 
   switch (src->mode) {
     case MODE_IMAGE:
-      camera_params_set (src->camera_params, "recording-hint", "false");
+      gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_RECORDING_HINT,
+          "false");
       break;
     case MODE_VIDEO:
-      camera_params_set (src->camera_params, "recording-hint", "true");
+      gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_RECORDING_HINT,
+          "true");
       break;
     default:
       GST_OBJECT_UNLOCK (src);
@@ -1740,6 +2747,8 @@ gst_droid_cam_src_free_video_buffer (gpointer data)
 
   GST_LOG_OBJECT (src, "free video buffer %p", buffer);
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_RELEASE_RECORDING_FRAME, 0, 0,
+      0);
   src->dev->ops->release_recording_frame (src->dev, GST_BUFFER_DATA (buffer));
 
   g_mutex_lock (&src->pushed_video_frames_lock);
@@ -1820,6 +2829,7 @@ gst_droid_cam_src_start_autofocus (GstDroidCamSrc * src)
     return;
   }
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_AUTO_FOCUS, 0, 0, 0);
   err = src->dev->ops->auto_focus (src->dev);
   if (err != 0) {
     GST_WARNING_OBJECT (src, "Error %d starting autofocus", err);
@@ -1839,6 +2849,7 @@ gst_droid_cam_src_stop_autofocus (GstDroidCamSrc * src)
     return;
   }
 
+  GST_HAL_TRACE (src->hal_trace, GST_HAL_TRACE_CANCEL_AUTO_FOCUS, 0, 0, 0);
   err = src->dev->ops->cancel_auto_focus (src->dev);
   if (err != 0) {
     GST_WARNING_OBJECT (src, "Error %d stopping autofocus", err);
@@ -1877,9 +2888,10 @@ gst_droid_cam_src_apply_image_noise_reduction (GstDroidCamSrc * src)
     return;
   }
 
-  if (src->camera_device != 0) {
+  if (!gst_droid_cam_src_has_camera_capability (src,
+          GST_CAMERA_MODULE_CAP_DENOISE)) {
     GST_WARNING_OBJECT (src,
-        "Image noise reduction is only supported by primary camera");
+        "Image noise reduction is not supported by this camera");
     return;
   }
 
@@ -1887,32 +2899,89 @@ gst_droid_cam_src_apply_image_noise_reduction (GstDroidCamSrc * src)
 
   if (src->mode != MODE_IMAGE) {
     GST_LOG_OBJECT (src, "Disabling image noise reduction in video mode");
-    camera_params_set (src->camera_params, "denoise", "denoise-off");
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_DENOISE,
+        "denoise-off");
   } else if (src->image_noise_reduction) {
     GST_LOG_OBJECT (src, "Enabling image noise reduction");
-    camera_params_set (src->camera_params, "denoise", "denoise-on");
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_DENOISE,
+        "denoise-on");
   } else {
     GST_LOG_OBJECT (src, "Disabling image noise reduction");
-    camera_params_set (src->camera_params, "denoise", "denoise-off");
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_DENOISE,
+        "denoise-off");
   }
 
   GST_OBJECT_UNLOCK (src);
 
-  gst_droid_cam_src_set_camera_params (src);
+  gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static void
-gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
+gst_droid_cam_src_apply_thread_params (GstDroidCamSrc * src)
+{
+  GST_DEBUG_OBJECT (src, "thread policy %d, priority %d, affinity 0x%"
+      G_GINT64_MODIFIER "x", src->thread_policy, src->thread_priority,
+      src->thread_affinity);
+
+  gst_camera_scheduler_set_thread_params (src->scheduler, src->thread_policy,
+      src->thread_priority, src->thread_affinity);
+}
+
+static void
+gst_droid_cam_src_apply_pool_idle_timeout (GstDroidCamSrc * src)
+{
+  gst_camera_buffer_pool_set_idle_timeout (src->pool,
+      src->pool_idle_timeout ? src->pool_idle_timeout * GST_MSECOND :
+      GST_CLOCK_TIME_NONE);
+}
+
+static GstStructure *
+gst_droid_cam_src_get_scheduling_latency (GstDroidCamSrc * src)
+{
+  static const gchar *const names[GST_CAMERA_SCHEDULER_NUM_SOURCES] = {
+    "viewfinder",
+    "video",
+    "image",
+  };
+  GstStructure *s;
+  GstCameraSchedulerLatency latency;
+  gchar *field;
+  int x;
+
+  s = gst_structure_empty_new ("scheduling-latency");
+
+  for (x = 0; x < GST_CAMERA_SCHEDULER_NUM_SOURCES; x++) {
+    gst_camera_scheduler_get_latency (src->scheduler, x, &latency);
+
+    field = g_strdup_printf ("%s-count", names[x]);
+    gst_structure_set (s, field, G_TYPE_UINT64, latency.count, NULL);
+    g_free (field);
+
+    field = g_strdup_printf ("%s-average", names[x]);
+    gst_structure_set (s, field, G_TYPE_UINT64,
+        latency.count ? latency.total / latency.count : 0, NULL);
+    g_free (field);
+
+    field = g_strdup_printf ("%s-max", names[x]);
+    gst_structure_set (s, field, G_TYPE_UINT64, latency.max, NULL);
+    g_free (field);
+  }
+
+  return s;
+}
+
+/*
+ * The HAL might change some of its parameters (max-zoom being one of them)
+ * once the preview is running so we merge them back into our snapshot.
+ */
+static void
+gst_droid_cam_src_refresh_camera_params (GstDroidCamSrc * src)
 {
   gchar *params;
   struct camera_params *camera_params;
-  int max_zoom;
-  GParamSpec *pspec;
-  GParamSpecFloat *pspec_f;
-  gboolean zoom_changed = FALSE;
+  guint32 changed = 0;
 
-  /* It's really bad how we get the value of max-zoom but at least it works. */
-  GST_DEBUG_OBJECT (src, "update max zoom");
+  GST_DEBUG_OBJECT (src, "refresh camera params");
 
   if (!src->dev) {
     GST_DEBUG_OBJECT (src, "camera not open");
@@ -1921,7 +2990,22 @@ gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
 
   g_mutex_lock (&src->params_lock);
   params = src->dev->ops->get_parameters (src->dev);
-  camera_params = camera_params_from_string (params);
+
+  if (G_UNLIKELY (src->hal_trace)) {
+    gst_hal_trace_record_string (src->hal_trace, GST_HAL_TRACE_PARAMS, params);
+  }
+
+  GST_OBJECT_LOCK (src);
+  camera_params = gst_droid_cam_src_edit_camera_params (src);
+  if (camera_params) {
+    changed = camera_params_refresh (camera_params, params);
+    if (changed) {
+      gst_droid_cam_src_publish_camera_params (src, camera_params);
+    } else {
+      camera_params_unref (camera_params);
+    }
+  }
+  GST_OBJECT_UNLOCK (src);
 
   if (src->dev->ops->put_parameters) {
     src->dev->ops->put_parameters (src->dev, params);
@@ -1930,13 +3014,53 @@ gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
   }
   g_mutex_unlock (&src->params_lock);
 
+  GST_LOG_OBJECT (src, "changed keys 0x%x", changed);
+
+  gst_droid_cam_src_camera_params_changed (src, changed);
+}
+
+/*
+ * Recomputes whatever we derive from the keys in changed. Region counts and
+ * caps are read from the snapshot when needed so nothing to do for them.
+ */
+static void
+gst_droid_cam_src_camera_params_changed (GstDroidCamSrc * src,
+    guint32 changed)
+{
+  if (changed & CAMERA_PARAM_MASK (CAMERA_PARAM_MAX_ZOOM)) {
+    gst_droid_cam_src_update_max_zoom (src);
+  }
+
+  if (changed & (CAMERA_PARAM_MASK (CAMERA_PARAM_MIN_EXPOSURE_COMPENSATION) |
+          CAMERA_PARAM_MASK (CAMERA_PARAM_MAX_EXPOSURE_COMPENSATION))) {
+    gst_photo_iface_init_ev_comp (src);
+  }
+}
+
+static void
+gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
+{
+  struct camera_params *camera_params;
+  int max_zoom;
+  GParamSpec *pspec;
+  GParamSpecFloat *pspec_f;
+  gboolean zoom_changed = FALSE;
+
+  GST_DEBUG_OBJECT (src, "update max zoom");
+
+  camera_params = gst_droid_cam_src_get_camera_params (src);
+  if (!camera_params) {
+    GST_DEBUG_OBJECT (src, "camera not open");
+    return;
+  }
+
   /* 0  -> 1.0
    * 1  -> 1.1
    * 2  -> 1.2
    * 10 -> 2.0
    * 60 -> 7.0
    */
-  max_zoom = camera_params_get_int (camera_params, "max-zoom");
+  max_zoom = camera_params_get_int_key (camera_params, CAMERA_PARAM_MAX_ZOOM);
   if (max_zoom + 10 != (int) (src->max_zoom * 10)) {
     GST_DEBUG_OBJECT (src, "setting max_zoom to %f", src->max_zoom);
     src->max_zoom = (max_zoom + 10) / 10.0;
@@ -1946,7 +3070,7 @@ gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
     zoom_changed = TRUE;
   }
 
-  camera_params_free (camera_params);
+  camera_params_unref (camera_params);
 
   if (!zoom_changed) {
     return;
@@ -1969,7 +3093,7 @@ gst_droid_cam_src_update_max_zoom (GstDroidCamSrc * src)
 static void
 gst_droid_cam_src_adjust_video_torch (GstDroidCamSrc * src)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean supported;
 
   GST_DEBUG_OBJECT (src, "adjust video torch");
 
@@ -1986,9 +3110,11 @@ gst_droid_cam_src_adjust_video_torch (GstDroidCamSrc * src)
 
   if (src->video_torch) {
     GST_OBJECT_LOCK (src);
-    camera_params_set (src->camera_params, "flash-mode", "torch");
+    supported =
+        gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_FLASH_MODE,
+        "torch");
     GST_OBJECT_UNLOCK (src);
-    if (!klass->set_camera_params (src)) {
+    if (!supported || !gst_droid_cam_src_set_camera_params_deferred (src)) {
       GST_WARNING_OBJECT (src, "Failed to set video torch");
       gst_photo_iface_update_flash_mode (src);
       src->video_torch = FALSE;
@@ -2012,6 +3138,7 @@ gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src, GstEvent * event)
   gboolean reset = FALSE;
   gchar *focus_param = NULL, *metering_param = NULL;
   gfloat scaleX = 0.0, scaleY = 0.0;
+  struct camera_params *camera_params;
 
   if (!gst_structure_get_uint (s, "frame-width", &width) ||
       !gst_structure_get_uint (s, "frame-height", &height)) {
@@ -2030,12 +3157,19 @@ gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src, GstEvent * event)
     goto out;
   }
 
-  GST_OBJECT_LOCK (src);
+  camera_params = gst_droid_cam_src_get_camera_params (src);
+  if (!camera_params) {
+    GST_WARNING_OBJECT (src, "camera not open");
+    goto out;
+  }
+
   supported_focus_regions =
-      camera_params_get_int (src->camera_params, "max-num-focus-areas");
+      camera_params_get_int_key (camera_params,
+      CAMERA_PARAM_MAX_NUM_FOCUS_AREAS);
   supported_metering_regions =
-      camera_params_get_int (src->camera_params, "max-num-focus-areas");
-  GST_OBJECT_UNLOCK (src);
+      camera_params_get_int_key (camera_params,
+      CAMERA_PARAM_MAX_NUM_METERING_AREAS);
+  camera_params_unref (camera_params);
 
   objcount = gst_value_list_get_size (regions);
   supported_regions = supported_focus_regions > supported_metering_regions
@@ -2094,7 +3228,8 @@ gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src, GstEvent * event)
   if (reset) {
     GST_INFO_OBJECT (src, "resetting roi");
     GST_OBJECT_LOCK (src);
-    camera_params_set (src->camera_params, "focus-areas", "(0, 0, 0, 0, 0)");
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_FOCUS_AREAS,
+        "(0, 0, 0, 0, 0)");
     GST_OBJECT_UNLOCK (src);
     goto update_and_out;
   }
@@ -2110,14 +3245,14 @@ gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src, GstEvent * event)
         b - 1000, entry.p);
     if (focus_param && i < supported_focus_regions) {
       gchar *old_param = focus_param;
-      focus_param = g_strjoin (",", old_param, src, NULL);
+      focus_param = g_strjoin (",", old_param, str, NULL);
       g_free (old_param);
     } else if (i < supported_focus_regions) {
       focus_param = strdup (str);
     }
     if (metering_param && i < supported_metering_regions) {
       gchar *old_param = metering_param;
-      metering_param = g_strjoin (",", old_param, src, NULL);
+      metering_param = g_strjoin (",", old_param, str, NULL);
       g_free (old_param);
     } else if (i < supported_metering_regions) {
       metering_param = strdup (str);
@@ -2128,18 +3263,20 @@ gst_droid_cam_src_handle_roi_event (GstDroidCamSrc * src, GstEvent * event)
   GST_OBJECT_LOCK (src);
   if (focus_param) {
     GST_DEBUG_OBJECT (src, "Setting focus roi param %s", focus_param);
-    camera_params_set (src->camera_params, "focus-areas", focus_param);
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_FOCUS_AREAS,
+        focus_param);
     g_free (focus_param);
   }
   if (metering_param) {
     GST_DEBUG_OBJECT (src, "Setting metering roi param %s", metering_param);
-    camera_params_set (src->camera_params, "metering-areas", metering_param);
+    gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_METERING_AREAS,
+        metering_param);
     g_free (metering_param);
   }
   GST_OBJECT_UNLOCK (src);
 
 update_and_out:
-  ret = gst_droid_cam_src_set_camera_params (src);
+  ret = gst_droid_cam_src_set_camera_params_deferred (src);
 
 out:
   g_array_unref (array);
@@ -25,12 +25,18 @@
 #include <hardware/camera.h>
 #include "gst/gstgralloc.h"
 #include "gstcamerabufferpool.h"
+#include "gstcameramemory.h"
 #ifndef GST_USE_UNSTABLE_API
 #define GST_USE_UNSTABLE_API
 #include <gst/interfaces/photography.h>
 #undef GST_USE_UNSTABLE_API
 #endif /* GST_USE_UNSTABLE_API */
 #include "gstcamerasettings.h"
+#include "cameraparams.h"
+#include "gsthaltrace.h"
+#include "gstcamerascheduler.h"
+#include "gstcameraeventqueue.h"
+#include "gstcameramodule.h"
 
 G_BEGIN_DECLS
 
@@ -59,7 +65,7 @@ G_BEGIN_DECLS
 
 #define DEFAULT_FPS                        30
 
-#define GST_DROID_CAM_SRC_VIDEO_CAPS_NAME  "video/x-raw-data"
+#define GST_DROID_CAM_SRC_VIDEO_CAPS_NAME  CAMERA_PARAMS_VIDEO_CAPS_NAME
 
 typedef enum {
   VIDEO_CAPTURE_ERROR = -1,
@@ -75,19 +81,35 @@ typedef enum {
 typedef struct _GstDroidCamSrc GstDroidCamSrc;
 typedef struct _GstDroidCamSrcClass GstDroidCamSrcClass;
 
-typedef struct _GstDroidCamSrcCameraInfo GstDroidCamSrcCameraInfo;
+/*
+ * Caps a capture pad last settled on. Negotiating again with the same camera
+ * against the same peer caps ends up there anyway, as long as the preview
+ * size fixation matches against did not change either.
+ */
+typedef struct {
+  gint camera_index;
+  gint preview_width;
+  gint preview_height;
+  GstCaps *peer;
+  GstCaps *caps;
+} GstDroidCamSrcNegotiation;
 
-struct _GstDroidCamSrcCameraInfo {
-  /* Sensor mount angle */
-  int orientation;
+/*
+ * End of the last buffer a pad pushed. Only written by the thread pushing
+ * on the pad so the sequence counter is all readers need.
+ */
+typedef struct {
+  volatile gint seq;
+  GstClockTime last_stop;
+} GstDroidCamSrcPosition;
 
-  /* id used for open() call */
-  int id;
-};
+typedef GstCameraModuleCamera GstDroidCamSrcCameraInfo;
 
 struct _GstDroidCamSrc {
   GstBin parent;
 
+  /* Shared with other instances. hwmod, cam and gralloc come from it */
+  GstCameraModule *module;
   GstGralloc *gralloc;
   struct hw_module_t *hwmod;
   camera_module_t *cam;
@@ -95,19 +117,57 @@ struct _GstDroidCamSrc {
   struct hw_device_t *cam_dev;
   camera_device_t *dev;
 
+  /*
+   * Immutable snapshot of the camera parameters. Readers take a reference
+   * via gst_droid_cam_src_get_camera_params (). Writers hold the object
+   * lock, modify a copy obtained from gst_droid_cam_src_edit_camera_params ()
+   * and swap it in with gst_droid_cam_src_publish_camera_params ().
+   * camera_params_lock is a bit lock guarding only the pointer swap.
+   */
   struct camera_params *camera_params;
+  gint camera_params_lock;
   GMutex params_lock;
 
+  /* nesting depth of begin-params/commit-params, protected by object lock */
+  gint params_batch;
+
   GstCameraBufferPool *pool;
+  /* Preview memory budget, 0 for none. Handed to every new pool */
+  guint64 max_pool_bytes;
+  /* Milliseconds, 0 to never release idle preview buffers */
+  guint pool_idle_timeout;
 
   gint user_camera_device;
   gint camera_device;
+  /* HAL id picked by the app, -1 to go by user_camera_device */
+  gint user_camera_index;
+  /* cameras entry in use, -1 if none */
+  gint camera_index;
   gint mode;
   gboolean video_metadata;
+  GstCameraMemoryBackend memory_backend;
+
+  /* Where to record HAL interactions. Opened with the camera */
+  gchar *hal_trace_location;
+  GstHalTrace *hal_trace;
 
-  GList *events;
+  /* Serialized events pushed before the next viewfinder buffer */
+  GstCameraEventQueue events;
 
   GstSegment segment;
+  /* Folded into segment when it is needed. Indexed like scheduler sources */
+  GstDroidCamSrcPosition positions[GST_CAMERA_SCHEDULER_NUM_SOURCES];
+
+  /*
+   * The clock and base time buffers are timestamped against. Written under
+   * the object lock, read lock-free by the HAL callbacks through the
+   * sequence counter. See gst_droid_cam_src_get_running_time ()
+   */
+  volatile gint clock_seq;
+  GstClock *ts_clock;
+  GstClockTime ts_base_time;
+  /* Replaced clocks a callback might still be reading. Dropped in NULL */
+  GSList *old_clocks;
 
   GstPad *vfsrc;
   GstPad *imgsrc;
@@ -121,15 +181,20 @@ struct _GstDroidCamSrc {
   gboolean image_renegotiate;
   gboolean video_renegotiate;
 
+  GstDroidCamSrcNegotiation image_negotiation;
+  GstDroidCamSrcNegotiation video_negotiation;
+
+  /* Pushes on all three pads */
+  GstCameraScheduler *scheduler;
+  GstCameraSchedulerPolicy thread_policy;
+  gint thread_priority;
+  guint64 thread_affinity;
+
   GQueue *img_queue;
-  GCond img_cond;
   GMutex img_lock;
-  gboolean img_task_running;
 
   GQueue *video_queue;
-  GCond video_cond;
   GMutex video_lock;
-  gboolean video_task_running;
 
   GMutex pushed_video_frames_lock;
   GCond pushed_video_frames_cond;
@@ -147,7 +212,11 @@ struct _GstDroidCamSrc {
   gboolean capture_start_sent;
   gboolean capture_end_sent;
 
-  GstDroidCamSrcCameraInfo device_info[2];
+  /*
+   * GstDroidCamSrcCameraInfo for every camera the HAL described, in HAL
+   * order. Copied from module when probing, protected by the object lock.
+   */
+  GArray *cameras;
 
   /* photography interface bits */
   GstPhotoSettings photo_settings;
@@ -169,7 +238,7 @@ struct _GstDroidCamSrcClass {
   gboolean (* set_camera_params) (GstDroidCamSrc *src);
 
   gboolean (* open_segment) (GstDroidCamSrc *src, GstPad * pad);
-  void (* update_segment) (GstDroidCamSrc *src, GstBuffer * buffer);
+  void (* update_segment) (GstDroidCamSrc *src, GstPad * pad, GstBuffer * buffer);
 };
 
 GType gst_droid_cam_src_get_type (void);
@@ -177,6 +246,28 @@ GType gst_droid_cam_src_get_type (void);
 void gst_droid_cam_src_start_autofocus (GstDroidCamSrc * src);
 void gst_droid_cam_src_stop_autofocus (GstDroidCamSrc * src);
 
+struct camera_params *gst_droid_cam_src_get_camera_params (GstDroidCamSrc *
+							  src);
+struct camera_params *gst_droid_cam_src_edit_camera_params (GstDroidCamSrc *
+							   src);
+void gst_droid_cam_src_publish_camera_params (GstDroidCamSrc * src,
+					      struct camera_params *params);
+gboolean gst_droid_cam_src_set_camera_param (GstDroidCamSrc * src,
+					     CameraParamKey key, const gchar * value);
+gboolean gst_droid_cam_src_set_camera_params_deferred (GstDroidCamSrc * src);
+
+gboolean gst_droid_cam_src_get_camera_size (GstDroidCamSrc * src,
+					    CameraParamKey key, gint * width, gint * height);
+
+GstClockTime gst_droid_cam_src_get_running_time (GstDroidCamSrc * src);
+
+GstCaps *gst_droid_cam_src_lookup_negotiation (GstDroidCamSrc * src,
+					       GstDroidCamSrcNegotiation * negotiation,
+					       GstCaps * peer);
+void gst_droid_cam_src_store_negotiation (GstDroidCamSrc * src,
+					  GstDroidCamSrcNegotiation * negotiation,
+					  GstCaps * peer, GstCaps * caps);
+
 G_END_DECLS
 
 #endif /* __GST_DROID_CAM_SRC_H__ */
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "gsthaltrace.h"
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+struct _GstHalTrace {
+  /* Callbacks come from HAL threads so writes are serialized */
+  GMutex lock;
+  FILE *file;
+  GstClockTime start;
+  gboolean failed;
+};
+
+GstHalTrace *
+gst_hal_trace_new (const gchar * location, GError ** error)
+{
+  GstHalTrace *trace;
+  GstHalTraceHeader header;
+  FILE *file;
+
+  file = g_fopen (location, "wb");
+  if (!file) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Could not open %s: %s", location, g_strerror (errno));
+    return NULL;
+  }
+
+  memset (&header, 0x0, sizeof (header));
+  header.magic = GST_HAL_TRACE_MAGIC;
+  header.version = GST_HAL_TRACE_VERSION;
+  header.record_size = sizeof (GstHalTraceRecord);
+
+  if (fwrite (&header, sizeof (header), 1, file) != 1) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Could not write to %s: %s", location, g_strerror (errno));
+    fclose (file);
+    return NULL;
+  }
+
+  trace = g_slice_new0 (GstHalTrace);
+  g_mutex_init (&trace->lock);
+  trace->file = file;
+  trace->start = gst_util_get_timestamp ();
+
+  return trace;
+}
+
+void
+gst_hal_trace_free (GstHalTrace * trace)
+{
+  fclose (trace->file);
+  g_mutex_clear (&trace->lock);
+  g_slice_free (GstHalTrace, trace);
+}
+
+static void
+gst_hal_trace_write (GstHalTrace * trace, GstHalTraceRecord * record,
+    const gchar * payload)
+{
+  g_mutex_lock (&trace->lock);
+
+  /* Taken under the lock so records are in time order */
+  record->time = gst_util_get_timestamp () - trace->start;
+
+  if (!trace->failed) {
+    /* Buffered. A record costs a memcpy until the buffer fills up */
+    if (fwrite (record, sizeof (*record), 1, trace->file) != 1
+        || (record->payload
+            && fwrite (payload, record->payload, 1, trace->file) != 1)) {
+      GST_WARNING ("failed to write HAL trace: %s", g_strerror (errno));
+      trace->failed = TRUE;
+    }
+  }
+
+  g_mutex_unlock (&trace->lock);
+}
+
+void
+gst_hal_trace_record (GstHalTrace * trace, GstHalTraceEvent event,
+    gint32 arg0, gint32 arg1, gint32 arg2, guint32 size, gint64 timestamp)
+{
+  GstHalTraceRecord record;
+
+  memset (&record, 0x0, sizeof (record));
+  record.event = event;
+  record.timestamp = timestamp;
+  record.size = size;
+  record.args[0] = arg0;
+  record.args[1] = arg1;
+  record.args[2] = arg2;
+
+  gst_hal_trace_write (trace, &record, NULL);
+}
+
+void
+gst_hal_trace_record_string (GstHalTrace * trace, GstHalTraceEvent event,
+    const gchar * str)
+{
+  GstHalTraceRecord record;
+
+  memset (&record, 0x0, sizeof (record));
+  record.event = event;
+
+  if (str) {
+    record.size = record.payload = strlen (str);
+  }
+
+  gst_hal_trace_write (trace, &record, str);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_HAL_TRACE_H__
+#define __GST_HAL_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A trace file is a GstHalTraceHeader followed by GstHalTraceRecords in
+ * native byte order. Records with a non zero payload are followed by that
+ * many bytes (the parameters string for PARAMS and SET_PARAMS).
+ */
+
+#define GST_HAL_TRACE_MAGIC              0x54484344     /* "DCHT" */
+#define GST_HAL_TRACE_VERSION            1
+
+typedef enum {
+  /* Calls into the HAL */
+  GST_HAL_TRACE_PARAMS = 1,                  /* payload: get_parameters () */
+  GST_HAL_TRACE_SET_PARAMS = 2,              /* payload: set_parameters () */
+  GST_HAL_TRACE_START_PREVIEW = 3,
+  GST_HAL_TRACE_STOP_PREVIEW = 4,
+  GST_HAL_TRACE_TAKE_PICTURE = 5,
+  GST_HAL_TRACE_START_RECORDING = 6,
+  GST_HAL_TRACE_STOP_RECORDING = 7,
+  GST_HAL_TRACE_RELEASE_RECORDING_FRAME = 8,
+  GST_HAL_TRACE_AUTO_FOCUS = 9,
+  GST_HAL_TRACE_CANCEL_AUTO_FOCUS = 10,
+
+  /* Callbacks from the HAL */
+  GST_HAL_TRACE_NOTIFY = 32,                 /* msg_type, ext1, ext2 */
+  GST_HAL_TRACE_DATA = 33,                   /* msg_type, index */
+  GST_HAL_TRACE_DATA_TIMESTAMP = 34,         /* msg_type, index */
+  GST_HAL_TRACE_REQUEST_MEMORY = 35,         /* fd, num_bufs */
+
+  /* preview_stream_ops calls from the HAL */
+  GST_HAL_TRACE_DEQUEUE_BUFFER = 64,         /* return value */
+  GST_HAL_TRACE_ENQUEUE_BUFFER = 65,
+  GST_HAL_TRACE_CANCEL_BUFFER = 66,
+  GST_HAL_TRACE_LOCK_BUFFER = 67,
+  GST_HAL_TRACE_SET_BUFFER_COUNT = 68,       /* count */
+  GST_HAL_TRACE_SET_BUFFERS_GEOMETRY = 69,   /* width, height, format */
+  GST_HAL_TRACE_SET_CROP = 70,               /* left, top, right, bottom */
+  GST_HAL_TRACE_SET_USAGE = 71,              /* usage */
+  GST_HAL_TRACE_SET_SWAP_INTERVAL = 72,      /* interval */
+  GST_HAL_TRACE_SET_TIMESTAMP = 73,
+} GstHalTraceEvent;
+
+typedef struct {
+  guint32 magic;
+  guint32 version;
+  guint32 record_size;
+  guint32 reserved;
+} GstHalTraceHeader;
+
+typedef struct {
+  /* monotonic nanoseconds since the trace was started */
+  guint64 time;
+
+  /* HAL provided timestamp for DATA_TIMESTAMP and SET_TIMESTAMP */
+  gint64 timestamp;
+
+  guint16 event;
+  guint16 reserved;
+
+  /*
+   * size of the data passed along (a single buffer for memory callbacks).
+   * The crop bottom for SET_CROP.
+   */
+  guint32 size;
+
+  gint32 args[3];
+
+  guint32 payload;
+} GstHalTraceRecord;
+
+typedef struct _GstHalTrace GstHalTrace;
+
+GstHalTrace *gst_hal_trace_new (const gchar * location, GError ** error);
+void gst_hal_trace_free (GstHalTrace * trace);
+
+void gst_hal_trace_record (GstHalTrace * trace, GstHalTraceEvent event,
+    gint32 arg0, gint32 arg1, gint32 arg2, guint32 size, gint64 timestamp);
+void gst_hal_trace_record_string (GstHalTrace * trace, GstHalTraceEvent event,
+    const gchar * str);
+
+/* Cheap enough to leave everywhere: tracing is off unless trace is set */
+#define GST_HAL_TRACE(trace,event,arg0,arg1,arg2)                     \
+  G_STMT_START {                                                      \
+    if (G_UNLIKELY (trace)) {                                         \
+      gst_hal_trace_record (trace, event, arg0, arg1, arg2, 0, 0);    \
+    }                                                                 \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif /* __GST_HAL_TRACE_H__ */
@@ -19,6 +19,7 @@
 
 #include "gstimgsrcpad.h"
 #include "gstdroidcamsrc.h"
+#include "gstcamerafixate.h"
 #include "cameraparams.h"
 #include "exif.h"
 #include <gst/video/video.h>
@@ -34,7 +35,6 @@ static gboolean gst_droid_cam_src_imgsrc_activatepush (GstPad * pad,
 static const GstQueryType *gst_droid_cam_src_imgsrc_query_type (GstPad * pad);
 static gboolean gst_droid_cam_src_imgsrc_query (GstPad * pad, GstQuery * query);
 
-static void gst_droid_cam_src_imgsrc_loop (gpointer data);
 static gboolean gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src);
 
 /* TODO: Check any potential events needed by camerabin2 (start capture, finish capture, ...) */
@@ -67,6 +67,7 @@ gst_droid_cam_src_imgsrc_setcaps (GstPad * pad, GstCaps * caps)
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
 
+  struct camera_params *params;
   int width, height;
 
   GST_DEBUG_OBJECT (src, "imgsrc setcaps %" GST_PTR_FORMAT, caps);
@@ -84,7 +85,19 @@ gst_droid_cam_src_imgsrc_setcaps (GstPad * pad, GstCaps * caps)
   }
 
   GST_OBJECT_LOCK (src);
-  camera_params_set_capture_size (src->camera_params, width, height);
+  params = gst_droid_cam_src_edit_camera_params (src);
+  if (params) {
+    if (!camera_params_set_capture_size (params, width, height)) {
+      GST_OBJECT_UNLOCK (src);
+      camera_params_unref (params);
+
+      GST_ELEMENT_ERROR (src, STREAM, FORMAT,
+          ("Unsupported capture resolution %dx%d", width, height), (NULL));
+      return FALSE;
+    }
+
+    gst_droid_cam_src_publish_camera_params (src, params);
+  }
   GST_OBJECT_UNLOCK (src);
 
   return klass->set_camera_params (src);
@@ -95,19 +108,19 @@ gst_droid_cam_src_imgsrc_getcaps (GstPad * pad)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstCaps *caps = NULL;
+  struct camera_params *params;
 
   GST_DEBUG_OBJECT (src, "imgsrc getcaps");
 
-  GST_OBJECT_LOCK (src);
+  params = gst_droid_cam_src_get_camera_params (src);
 
-  if (src->camera_params) {
-    caps = camera_params_get_capture_caps (src->camera_params);
+  if (params) {
+    caps = camera_params_get_capture_caps (params);
+    camera_params_unref (params);
   } else {
     caps = gst_caps_copy (gst_pad_get_pad_template_caps (pad));
   }
 
-  GST_OBJECT_UNLOCK (src);
-
   GST_LOG_OBJECT (src, "returning %" GST_PTR_FORMAT, caps);
 
   return caps;
@@ -117,17 +130,28 @@ static void
 gst_droid_cam_src_imgsrc_fixatecaps (GstPad * pad, GstCaps * caps)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
-  GstStructure *s;
+  GstCameraFixateTarget target;
+  GstCameraFixateResult result;
 
   GST_LOG_OBJECT (src, "fixatecaps %" GST_PTR_FORMAT, caps);
 
-  gst_caps_truncate (caps);
-
-  s = gst_caps_get_structure (caps, 0);
-
-  gst_structure_fixate_field_nearest_int (s, "width", DEFAULT_IMG_WIDTH);
-  gst_structure_fixate_field_nearest_int (s, "height", DEFAULT_IMG_HEIGHT);
-  gst_structure_fixate_field_nearest_fraction (s, "framerate", DEFAULT_FPS, 1);
+  target.width = DEFAULT_IMG_WIDTH;
+  target.height = DEFAULT_IMG_HEIGHT;
+  target.fps = DEFAULT_FPS;
+  target.ref_width = target.ref_height = 0;
+
+  /* Pictures should show what the viewfinder showed */
+  gst_droid_cam_src_get_camera_size (src, CAMERA_PARAM_PREVIEW_SIZE,
+      &target.ref_width, &target.ref_height);
+
+  if (gst_camera_fixate_caps (caps, &target, &result)) {
+    GST_DEBUG_OBJECT (src, "picked %dx%d@%d/%d out of %u sizes. cost %.3f: "
+        "aspect %.3f against %dx%d, size %.3f against %dx%d@%d",
+        result.width, result.height, result.fps_n, result.fps_d,
+        result.candidates, result.cost, result.aspect_cost, target.ref_width,
+        target.ref_height, result.size_cost, target.width, target.height,
+        target.fps);
+  }
 
   GST_DEBUG_OBJECT (src, "caps now is %" GST_PTR_FORMAT, caps);
 }
@@ -142,51 +166,23 @@ gst_droid_cam_src_imgsrc_activatepush (GstPad * pad, gboolean active)
   GST_DEBUG_OBJECT (src, "imgsrc activatepush: %d", active);
 
   if (active) {
-    gboolean started;
-
     /* First we do caps negotiation */
     if (!gst_droid_cam_src_imgsrc_negotiate (src)) {
       return FALSE;
     }
 
-    /* Then we start our task */
-    GST_PAD_STREAM_LOCK (pad);
-
-    g_mutex_lock (&src->img_lock);
-    src->img_task_running = TRUE;
-
-    started = gst_pad_start_task (pad, gst_droid_cam_src_imgsrc_loop, pad);
-    if (!started) {
-      src->img_task_running = FALSE;
-
-      g_mutex_unlock (&src->img_lock);
-
-      GST_PAD_STREAM_UNLOCK (pad);
-
-      GST_ERROR_OBJECT (src, "Failed to start task");
-      gst_pad_stop_task (pad);
-
+    /* Then we start pushing */
+    if (!gst_camera_scheduler_start (src->scheduler,
+            GST_CAMERA_SCHEDULER_IMAGE)) {
+      GST_ERROR_OBJECT (src, "Failed to start streaming");
       return FALSE;
     }
-
-    g_mutex_unlock (&src->img_lock);
-
-    GST_PAD_STREAM_UNLOCK (pad);
-
   } else {
-    GST_DEBUG_OBJECT (src, "stopping task");
-
-    g_mutex_lock (&src->img_lock);
-
-    src->img_task_running = FALSE;
-
-    g_cond_signal (&src->img_cond);
-
-    g_mutex_unlock (&src->img_lock);
+    GST_DEBUG_OBJECT (src, "stopping streaming");
 
-    gst_pad_stop_task (pad);
+    gst_camera_scheduler_stop (src->scheduler, GST_CAMERA_SCHEDULER_IMAGE);
 
-    GST_DEBUG_OBJECT (src, "stopped task");
+    GST_DEBUG_OBJECT (src, "stopped streaming");
   }
 
   return TRUE;
@@ -202,8 +198,8 @@ gst_img_src_pad_renegotiate (GstPad * pad)
   return gst_droid_cam_src_imgsrc_negotiate (src);
 }
 
-static void
-gst_droid_cam_src_imgsrc_loop (gpointer data)
+GstCameraSchedulerResult
+gst_img_src_pad_dispatch (gpointer data)
 {
   GstPad *pad = (GstPad *) data;
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
@@ -211,8 +207,11 @@ gst_droid_cam_src_imgsrc_loop (gpointer data)
   GstBuffer *buffer;
   GstFlowReturn ret;
   GstTagList *tags;
+  gboolean more;
+
+  GST_DEBUG_OBJECT (src, "dispatch");
 
-  GST_DEBUG_OBJECT (src, "loop");
+  GST_PAD_STREAM_LOCK (pad);
 
   g_mutex_lock (&src->img_lock);
 
@@ -220,39 +219,22 @@ gst_droid_cam_src_imgsrc_loop (gpointer data)
     /* TODO: handle renegotiation */
   }
 
-  if (!src->img_task_running) {
-    g_mutex_unlock (&src->img_lock);
-
-    GST_DEBUG_OBJECT (src, "task not running");
-    return;
-  }
-
-  if (src->img_queue->length > 0) {
-    buffer = g_queue_pop_head (src->img_queue);
-    g_mutex_unlock (&src->img_lock);
-
-    goto push_buffer;
-  }
-
-  g_cond_wait (&src->img_cond, &src->img_lock);
+  buffer = g_queue_pop_head (src->img_queue);
+  more = src->img_queue->length > 0;
+  g_mutex_unlock (&src->img_lock);
 
-  if (!src->img_task_running) {
-    g_mutex_unlock (&src->img_lock);
+  if (!buffer) {
+    GST_PAD_STREAM_UNLOCK (pad);
 
-    GST_DEBUG_OBJECT (src, "task not running");
-    return;
+    return GST_CAMERA_SCHEDULER_IDLE;
   }
 
-  buffer = g_queue_pop_head (src->img_queue);
-  g_mutex_unlock (&src->img_lock);
-
-push_buffer:
   /* TODO: Do we need a new segment each time? */
   if (!klass->open_segment (src, src->imgsrc)) {
     GST_WARNING_OBJECT (src, "failed to push new segment");
   }
 
-  klass->update_segment (src, buffer);
+  klass->update_segment (src, pad, buffer);
 
   tags = gst_droid_cam_src_get_exif_tags (buffer);
   if (!tags) {
@@ -279,6 +261,43 @@ push_buffer:
         ("streaming task paused, reason %s (%d)", gst_flow_get_name (ret),
             ret));
   }
+
+  GST_PAD_STREAM_UNLOCK (pad);
+
+  return more ? GST_CAMERA_SCHEDULER_BUSY : GST_CAMERA_SCHEDULER_IDLE;
+}
+
+/*
+ * Pad caps can not tell us if the camera still has the size they ask for:
+ * the device might have been opened again since.
+ */
+static gboolean
+gst_droid_cam_src_imgsrc_apply_size (GstDroidCamSrc * src, GstCaps * caps)
+{
+  int width = 0, height = 0;
+  gchar *size;
+  gboolean ret;
+
+  if (!gst_video_format_parse_caps (caps, NULL, &width, &height)) {
+    return FALSE;
+  }
+
+  size = g_strdup_printf ("%dx%d", width, height);
+
+  GST_OBJECT_LOCK (src);
+  ret = !src->camera_params
+      || gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_PICTURE_SIZE,
+      size);
+  GST_OBJECT_UNLOCK (src);
+
+  g_free (size);
+
+  if (!ret) {
+    GST_ELEMENT_ERROR (src, STREAM, FORMAT,
+        ("Unsupported capture resolution %dx%d", width, height), (NULL));
+  }
+
+  return ret;
 }
 
 static gboolean
@@ -294,6 +313,15 @@ gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src)
 
   klass = GST_DROID_CAM_SRC_GET_CLASS (src);
 
+  peer = gst_pad_peer_get_caps_reffed (src->imgsrc);
+
+  common =
+      gst_droid_cam_src_lookup_negotiation (src, &src->image_negotiation, peer);
+  if (common) {
+    GST_DEBUG_OBJECT (src, "reusing caps %" GST_PTR_FORMAT, common);
+    goto set_caps;
+  }
+
   caps = gst_droid_cam_src_imgsrc_getcaps (src->imgsrc);
   if (!caps || gst_caps_is_empty (caps)) {
     GST_ELEMENT_ERROR (src, STREAM, FORMAT,
@@ -309,13 +337,7 @@ gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src)
 
   GST_LOG_OBJECT (src, "caps %" GST_PTR_FORMAT, caps);
 
-  peer = gst_pad_peer_get_caps_reffed (src->imgsrc);
-
   if (!peer || gst_caps_is_empty (peer) || gst_caps_is_any (peer)) {
-    if (peer) {
-      gst_caps_unref (peer);
-    }
-
     gst_caps_unref (caps);
 
     /* Use default. */
@@ -326,10 +348,8 @@ gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src)
 
     GST_DEBUG_OBJECT (src, "using default caps %" GST_PTR_FORMAT, caps);
 
-    ret = gst_pad_set_caps (src->imgsrc, caps);
-    gst_caps_unref (caps);
-
-    goto out;
+    common = caps;
+    goto set_caps;
   }
 
   GST_DEBUG_OBJECT (src, "peer caps %" GST_PTR_FORMAT, peer);
@@ -339,7 +359,6 @@ gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src)
   GST_LOG_OBJECT (src, "caps intersection %" GST_PTR_FORMAT, common);
 
   gst_caps_unref (caps);
-  gst_caps_unref (peer);
 
   if (gst_caps_is_empty (common)) {
     GST_ELEMENT_ERROR (src, STREAM, FORMAT, ("No common caps"), (NULL));
@@ -354,13 +373,25 @@ gst_droid_cam_src_imgsrc_negotiate (GstDroidCamSrc * src)
     gst_pad_fixate_caps (src->imgsrc, common);
   }
 
-  ret = gst_pad_set_caps (src->imgsrc, common);
+set_caps:
+  /* setcaps () is skipped if the pad has these caps already */
+  ret = gst_droid_cam_src_imgsrc_apply_size (src, common)
+      && gst_pad_set_caps (src->imgsrc, common);
+
+  if (ret) {
+    gst_droid_cam_src_store_negotiation (src, &src->image_negotiation, peer,
+        common);
+  }
 
   gst_caps_unref (common);
 
 out:
+  if (peer) {
+    gst_caps_unref (peer);
+  }
+
   if (ret) {
-    /* set camera parameters */
+    /* set camera parameters. Nothing reaches the HAL if they did not change */
     ret = klass->set_camera_params (src);
   }
 
@@ -21,11 +21,13 @@
 #define __GST_IMG_SRC_PAD_H__
 
 #include <gst/gst.h>
+#include "gstcamerascheduler.h"
 
 G_BEGIN_DECLS
 
 GstPad *gst_img_src_pad_new (GstStaticPadTemplate *pad_template, const char * name);
 gboolean gst_img_src_pad_renegotiate (GstPad * pad);
+GstCameraSchedulerResult gst_img_src_pad_dispatch (gpointer data);
 
 G_END_DECLS
 
@@ -220,10 +220,19 @@ gst_photo_iface_settings_to_params (GstDroidCamSrc * src)
 void
 gst_photo_iface_init_ev_comp (GstDroidCamSrc * src)
 {
+  struct camera_params *params = gst_droid_cam_src_get_camera_params (src);
+
+  if (!params) {
+    return;
+  }
+
   src->min_ev_comp =
-      camera_params_get_int (src->camera_params, "min-exposure-compensation");
+      camera_params_get_int_key (params,
+      CAMERA_PARAM_MIN_EXPOSURE_COMPENSATION);
   src->max_ev_comp =
-      camera_params_get_int (src->camera_params, "max-exposure-compensation");
+      camera_params_get_int_key (params,
+      CAMERA_PARAM_MAX_EXPOSURE_COMPENSATION);
+  camera_params_unref (params);
 
   src->ev_comp_step =
       ((-1 * src->min_ev_comp) +
@@ -350,7 +359,7 @@ static gboolean
 _gst_photo_iface_set_flash_mode (GstDroidCamSrc * src, GstFlashMode flash,
     gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
 
   const char *val =
       gst_camera_settings_find_droid (src->settings->flash_mode, flash);
@@ -364,21 +373,28 @@ _gst_photo_iface_set_flash_mode (GstDroidCamSrc * src, GstFlashMode flash,
   GST_DEBUG_OBJECT (src, "storing flash mode %i", flash);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.flash_mode = flash;
 
   if (!src->camera_params) {
+    /* Applied when the camera is opened */
+    src->photo_settings.flash_mode = flash;
     GST_OBJECT_UNLOCK (src);
     return TRUE;
   }
 
-  camera_params_set (src->camera_params, "flash-mode", val);
+  ret = gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_FLASH_MODE, val);
+
+  /* Only what the camera takes is reported back */
+  if (ret) {
+    src->photo_settings.flash_mode = flash;
+  }
+
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static gboolean
@@ -420,7 +436,7 @@ static gboolean
 _gst_photo_iface_set_focus_mode (GstDroidCamSrc * src,
     GstFocusMode focus, gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
 
   const char *val =
       gst_camera_settings_find_droid (src->settings->focus_mode, focus);
@@ -434,9 +450,9 @@ _gst_photo_iface_set_focus_mode (GstDroidCamSrc * src,
   GST_DEBUG_OBJECT (src, "storing focus mode %i", focus);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.focus_mode = focus;
 
   if (!src->camera_params) {
+    src->photo_settings.focus_mode = focus;
     GST_OBJECT_UNLOCK (src);
     return TRUE;
   }
@@ -444,22 +460,25 @@ _gst_photo_iface_set_focus_mode (GstDroidCamSrc * src,
   /* Special handling for this focus mode */
   if (!strcmp (val, "continuous")) {
     if (src->mode == MODE_IMAGE) {
-      camera_params_set (src->camera_params, "focus-mode",
-          "continuous-picture");
+      val = "continuous-picture";
     } else {
-      camera_params_set (src->camera_params, "focus-mode", "continuous-video");
+      val = "continuous-video";
     }
-  } else {
-    camera_params_set (src->camera_params, "focus-mode", val);
+  }
+
+  ret = gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_FOCUS_MODE, val);
+
+  if (ret) {
+    src->photo_settings.focus_mode = focus;
   }
 
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 void
@@ -509,7 +528,7 @@ static gboolean
 _gst_photo_iface_set_white_balance_mode (GstDroidCamSrc * src,
     GstWhiteBalanceMode wb, gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
 
   const char *val =
       gst_camera_settings_find_droid (src->settings->white_balance_mode, wb);
@@ -523,21 +542,28 @@ _gst_photo_iface_set_white_balance_mode (GstDroidCamSrc * src,
   GST_DEBUG_OBJECT (src, "storing white balance mode %i", wb);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.wb_mode = wb;
 
   if (!src->camera_params) {
+    src->photo_settings.wb_mode = wb;
     GST_OBJECT_UNLOCK (src);
     return TRUE;
   }
 
-  camera_params_set (src->camera_params, "whitebalance", val);
+  ret =
+      gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_WHITE_BALANCE,
+      val);
+
+  if (ret) {
+    src->photo_settings.wb_mode = wb;
+  }
+
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static gboolean
@@ -577,31 +603,35 @@ _gst_photo_iface_get_zoom (GstDroidCamSrc * src)
 static gboolean
 _gst_photo_iface_set_zoom (GstDroidCamSrc * src, gfloat zoom, gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
   int droid_val = (zoom * 10) - 10;
   char *val = g_strdup_printf ("%i", droid_val);
 
   GST_DEBUG_OBJECT (src, "set zoom to %f (%s)", zoom, val);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.zoom = zoom;
 
   if (!src->camera_params) {
+    src->photo_settings.zoom = zoom;
     GST_OBJECT_UNLOCK (src);
     g_free (val);
     return TRUE;
   }
 
-  camera_params_set (src->camera_params, "zoom", val);
+  ret = gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_ZOOM, val);
   g_free (val);
 
+  if (ret) {
+    src->photo_settings.zoom = zoom;
+  }
+
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static gboolean
@@ -642,7 +672,7 @@ static gboolean
 _gst_photo_iface_set_iso_speed (GstDroidCamSrc * src, guint iso,
     gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
 
   const char *val =
       gst_camera_settings_find_droid (src->settings->iso_speed, iso);
@@ -656,21 +686,26 @@ _gst_photo_iface_set_iso_speed (GstDroidCamSrc * src, guint iso,
   GST_DEBUG_OBJECT (src, "storing iso speed %i", iso);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.iso_speed = iso;
 
   if (!src->camera_params) {
+    src->photo_settings.iso_speed = iso;
     GST_OBJECT_UNLOCK (src);
     return TRUE;
   }
 
-  camera_params_set (src->camera_params, "iso", val);
+  ret = gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_ISO, val);
+
+  if (ret) {
+    src->photo_settings.iso_speed = iso;
+  }
+
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static gboolean
@@ -712,7 +747,7 @@ static gboolean
 _gst_photo_iface_set_ev_compensation (GstDroidCamSrc * src, gfloat ev,
     gboolean commit)
 {
-  GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
+  gboolean ret;
   int val = src->ev_comp_step * ev;
   gchar *string_val = NULL;
 
@@ -721,9 +756,9 @@ _gst_photo_iface_set_ev_compensation (GstDroidCamSrc * src, gfloat ev,
   string_val = g_strdup_printf ("%i", val);
 
   GST_OBJECT_LOCK (src);
-  src->photo_settings.ev_compensation = ev;
 
   if (!src->camera_params) {
+    src->photo_settings.ev_compensation = ev;
     GST_OBJECT_UNLOCK (src);
 
     g_free (string_val);
@@ -731,16 +766,22 @@ _gst_photo_iface_set_ev_compensation (GstDroidCamSrc * src, gfloat ev,
     return TRUE;
   }
 
-  camera_params_set (src->camera_params, "exposure-compensation", string_val);
+  ret =
+      gst_droid_cam_src_set_camera_param (src,
+      CAMERA_PARAM_EXPOSURE_COMPENSATION, string_val);
   g_free (string_val);
 
+  if (ret) {
+    src->photo_settings.ev_compensation = ev;
+  }
+
   GST_OBJECT_UNLOCK (src);
 
-  if (!commit) {
-    return TRUE;
+  if (!ret || !commit) {
+    return ret;
   }
 
-  return klass->set_camera_params (src);
+  return gst_droid_cam_src_set_camera_params_deferred (src);
 }
 
 static void
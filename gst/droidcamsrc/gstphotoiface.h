@@ -29,6 +29,9 @@ enum
 {
   PROP_0,
   PROP_CAMERA_DEVICE,
+  PROP_CAMERA_INDEX,
+  PROP_CAMERA_FACING,
+  PROP_NUM_CAMERAS,
   PROP_MODE,
   PROP_READY_FOR_CAPTURE,
   PROP_VIDEO_METADATA,
@@ -36,6 +39,16 @@ enum
   PROP_IMAGE_NOISE_REDUCTION,
   PROP_MAX_ZOOM,
   PROP_VIDEO_TORCH,
+  PROP_MEMORY_BACKEND,
+  PROP_HAL_TRACE_LOCATION,
+  PROP_THREAD_POLICY,
+  PROP_THREAD_PRIORITY,
+  PROP_THREAD_AFFINITY,
+  PROP_SCHEDULING_LATENCY,
+  PROP_MAX_POOL_BYTES,
+  PROP_POOL_BYTES,
+  PROP_PEAK_POOL_BYTES,
+  PROP_POOL_IDLE_TIMEOUT,
 
   /* photography */
   PROP_FLASH_MODE,
@@ -19,6 +19,7 @@
 
 #include "gstvfsrcpad.h"
 #include "gstdroidcamsrc.h"
+#include "gstcamerafixate.h"
 #include "cameraparams.h"
 #include <gst/video/video.h>
 #include <gst/gstnativebuffer.h>
@@ -34,7 +35,6 @@ static const GstQueryType *gst_droid_cam_src_vfsrc_query_type (GstPad * pad);
 static gboolean gst_droid_cam_src_vfsrc_query (GstPad * pad, GstQuery * query);
 static void gst_droid_cam_src_vfsrc_fixatecaps (GstPad * pad, GstCaps * caps);
 
-static void gst_droid_cam_src_vfsrc_loop (gpointer data);
 static gboolean gst_droid_cam_src_vfsrc_negotiate (GstDroidCamSrc * src);
 
 GstPad *
@@ -56,12 +56,6 @@ gst_vf_src_pad_new (GstStaticPadTemplate * pad_template, const char *name)
   return pad;
 }
 
-gboolean
-gst_vf_src_pad_start_task (GstPad * pad)
-{
-  return gst_pad_start_task (pad, gst_droid_cam_src_vfsrc_loop, pad);
-}
-
 static gboolean
 gst_droid_cam_src_vfsrc_activatepush (GstPad * pad, gboolean active)
 {
@@ -80,10 +74,12 @@ gst_droid_cam_src_vfsrc_activatepush (GstPad * pad, gboolean active)
       return FALSE;
     }
 
-    /* Then we start our task */
+    /* Then we start pushing. Holding the stream lock keeps the streaming
+     * thread from seeing the pool flushing until we are done */
     GST_PAD_STREAM_LOCK (pad);
 
-    started = gst_vf_src_pad_start_task (pad);
+    started = gst_camera_scheduler_start (src->scheduler,
+        GST_CAMERA_SCHEDULER_VIEWFINDER);
     if (!started) {
       GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
       src->pool->flushing = TRUE;
@@ -91,8 +87,7 @@ gst_droid_cam_src_vfsrc_activatepush (GstPad * pad, gboolean active)
 
       GST_PAD_STREAM_UNLOCK (pad);
 
-      GST_ERROR_OBJECT (src, "Failed to start task");
-      gst_pad_stop_task (pad);
+      GST_ERROR_OBJECT (src, "Failed to start streaming");
       return FALSE;
     }
 
@@ -102,19 +97,18 @@ gst_droid_cam_src_vfsrc_activatepush (GstPad * pad, gboolean active)
 
     GST_PAD_STREAM_UNLOCK (pad);
 
-    GST_DEBUG_OBJECT (src, "task started");
+    GST_DEBUG_OBJECT (src, "streaming started");
   } else {
     GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
     src->pool->flushing = TRUE;
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
-    GST_DEBUG_OBJECT (src, "stopping task");
+    GST_DEBUG_OBJECT (src, "stopping streaming");
 
-    gst_camera_buffer_pool_unlock_app_queue (src->pool);
+    gst_camera_scheduler_stop (src->scheduler,
+        GST_CAMERA_SCHEDULER_VIEWFINDER);
 
-    gst_pad_stop_task (pad);
-
-    GST_DEBUG_OBJECT (src, "stopped task");
+    GST_DEBUG_OBJECT (src, "stopped streaming");
   }
 
   return TRUE;
@@ -126,9 +120,11 @@ gst_droid_cam_src_vfsrc_setcaps (GstPad * pad, GstCaps * caps)
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
 
+  struct camera_params *params;
   int width, height;
   int fps_n, fps_d;
   int fps;
+  int range_min = 0, range_max = 0;
 
   GST_DEBUG_OBJECT (src, "vfsrc setcaps %" GST_PTR_FORMAT, caps);
 
@@ -156,8 +152,31 @@ gst_droid_cam_src_vfsrc_setcaps (GstPad * pad, GstCaps * caps)
   fps = fps_n / fps_d;
 
   GST_OBJECT_LOCK (src);
-  camera_params_set_viewfinder_size (src->camera_params, width, height);
-  camera_params_set_viewfinder_fps (src->camera_params, fps);
+  params = gst_droid_cam_src_edit_camera_params (src);
+  if (params) {
+    /* Recording wants a steady rate, the viewfinder can slow down */
+    if (camera_params_set_viewfinder_fps_range (params, fps_n, fps_d,
+            src->mode != MODE_VIDEO, &range_min, &range_max)) {
+      /* For HALs which only look at the old key */
+      camera_params_set_viewfinder_fps (params, fps);
+    } else if (camera_params_set_viewfinder_fps (params, fps)) {
+      range_min = range_max = 0;
+    } else {
+      fps = 0;
+    }
+
+    if (!fps || !camera_params_set_viewfinder_size (params, width, height)) {
+      GST_OBJECT_UNLOCK (src);
+      camera_params_unref (params);
+
+      GST_ELEMENT_ERROR (src, STREAM, FORMAT,
+          ("Unsupported viewfinder mode %dx%d@%d/%d", width, height, fps_n,
+              fps_d), (NULL));
+      return FALSE;
+    }
+
+    gst_droid_cam_src_publish_camera_params (src, params);
+  }
   GST_OBJECT_UNLOCK (src);
 
   if (klass->set_camera_params (src)) {
@@ -167,8 +186,24 @@ gst_droid_cam_src_vfsrc_setcaps (GstPad * pad, GstCaps * caps)
     /* TODO: Make sure we are not overwriting a previous value. */
     src->pool->buffer_duration =
         gst_util_uint64_scale_int (GST_SECOND, fps_d, fps_n);
+    if (range_min > 0 && range_max > range_min) {
+      src->pool->min_buffer_duration =
+          gst_util_uint64_scale_int (GST_SECOND, 1000, range_max);
+      src->pool->max_buffer_duration =
+          gst_util_uint64_scale_int (GST_SECOND, 1000, range_min);
+    } else {
+      src->pool->min_buffer_duration = src->pool->buffer_duration;
+      src->pool->max_buffer_duration = src->pool->buffer_duration;
+    }
+    src->pool->frame_interval = src->pool->buffer_duration;
     src->pool->fps_n = fps_n;
     src->pool->fps_d = fps_d;
+
+    GST_DEBUG_OBJECT (src, "frame duration %" GST_TIME_FORMAT " (%"
+        GST_TIME_FORMAT " - %" GST_TIME_FORMAT ")",
+        GST_TIME_ARGS (src->pool->buffer_duration),
+        GST_TIME_ARGS (src->pool->min_buffer_duration),
+        GST_TIME_ARGS (src->pool->max_buffer_duration));
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
     return TRUE;
@@ -182,16 +217,19 @@ gst_droid_cam_src_vfsrc_getcaps (GstPad * pad)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstCaps *caps = NULL;
+  struct camera_params *params;
 
   GST_DEBUG_OBJECT (src, "vfsrc getcaps");
 
-  GST_OBJECT_LOCK (src);
+  params = gst_droid_cam_src_get_camera_params (src);
 
-  if (src->camera_params) {
+  if (params) {
     int x;
     uint len;
 
-    caps = camera_params_get_viewfinder_caps (src->camera_params);
+    /* shared with camera_params */
+    caps = gst_caps_make_writable (camera_params_get_viewfinder_caps (params));
+    camera_params_unref (params);
     len = gst_caps_get_size (caps);
 
     GST_CAMERA_BUFFER_POOL_LOCK (src->pool);
@@ -199,7 +237,8 @@ gst_droid_cam_src_vfsrc_getcaps (GstPad * pad)
     for (x = 0; x < len; x++) {
       GstStructure *s = gst_caps_get_structure (caps, x);
       gst_structure_set (s, "orientation-angle", G_TYPE_INT,
-          src->pool->orientation, NULL);
+          src->pool->orientation, GST_CAMERA_BUFFER_META_CAPS_FIELD,
+          G_TYPE_BOOLEAN, TRUE, NULL);
     }
 
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
@@ -207,8 +246,6 @@ gst_droid_cam_src_vfsrc_getcaps (GstPad * pad)
     caps = gst_caps_copy (gst_pad_get_pad_template_caps (pad));
   }
 
-  GST_OBJECT_UNLOCK (src);
-
   GST_LOG_OBJECT (src, "returning %" GST_PTR_FORMAT, caps);
 
   return caps;
@@ -262,81 +299,74 @@ static void
 gst_droid_cam_src_vfsrc_fixatecaps (GstPad * pad, GstCaps * caps)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
-  GstStructure *s;
+  GstCameraFixateTarget target;
+  GstCameraFixateResult result;
 
   GST_LOG_OBJECT (src, "fixatecaps %" GST_PTR_FORMAT, caps);
 
-  gst_caps_truncate (caps);
-
-  s = gst_caps_get_structure (caps, 0);
-
-  gst_structure_fixate_field_nearest_int (s, "width", DEFAULT_VF_WIDTH);
-  gst_structure_fixate_field_nearest_int (s, "height", DEFAULT_VF_HEIGHT);
-  gst_structure_fixate_field_nearest_fraction (s, "framerate", DEFAULT_FPS, 1);
+  target.width = DEFAULT_VF_WIDTH;
+  target.height = DEFAULT_VF_HEIGHT;
+  target.fps = DEFAULT_FPS;
+  target.ref_width = target.ref_height = 0;
+
+  /* A preview shaped like the capture saves the HAL cropping or scaling */
+  gst_droid_cam_src_get_camera_size (src,
+      src->mode == MODE_VIDEO ? CAMERA_PARAM_VIDEO_SIZE :
+      CAMERA_PARAM_PICTURE_SIZE, &target.ref_width, &target.ref_height);
+
+  if (gst_camera_fixate_caps (caps, &target, &result)) {
+    GST_DEBUG_OBJECT (src, "picked %dx%d@%d/%d out of %u sizes. cost %.3f: "
+        "aspect %.3f against %dx%d, size %.3f against %dx%d@%d",
+        result.width, result.height, result.fps_n, result.fps_d,
+        result.candidates, result.cost, result.aspect_cost, target.ref_width,
+        target.ref_height, result.size_cost, target.width, target.height,
+        target.fps);
+  }
 
   GST_DEBUG_OBJECT (src, "caps now is %" GST_PTR_FORMAT, caps);
 }
 
-static void
-gst_droid_cam_src_vfsrc_loop (gpointer data)
+GstCameraSchedulerResult
+gst_vf_src_pad_dispatch (gpointer data)
 {
   GstPad *pad = (GstPad *) data;
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
-  GstCameraBufferPool *pool = gst_camera_buffer_pool_ref (src->pool);
+  GstCameraBufferPool *pool = src->pool;
   GstNativeBuffer *buff;
   GstFlowReturn ret;
-  GList *events = NULL;
+  GList *events;
+  GList *l;
+  gboolean more;
 
-  GST_LOG_OBJECT (src, "loop");
+  GST_LOG_OBJECT (src, "dispatch");
+
+  GST_PAD_STREAM_LOCK (pad);
 
   GST_CAMERA_BUFFER_POOL_LOCK (pool);
 
   if (pool->flushing) {
-
     GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
+    GST_PAD_STREAM_UNLOCK (pad);
 
-    goto pool_flushing;
+    GST_DEBUG_OBJECT (src, "pool is flushing. pausing");
+    return GST_CAMERA_SCHEDULER_PAUSE;
   }
 
   GST_CAMERA_BUFFER_POOL_UNLOCK (pool);
 
   g_mutex_lock (&pool->app_lock);
-  if (pool->app_queue->length > 0) {
-    buff = g_queue_pop_head (pool->app_queue);
-
-    g_mutex_unlock (&pool->app_lock);
-
-    goto push_buffer;
-  }
-
-  GST_LOG_OBJECT (src, "empty app queue. waiting for buffer");
-  g_cond_wait (&pool->app_cond, &pool->app_lock);
-  GST_LOG_OBJECT (src, "done waiting for buffer");
-
-  if (pool->app_queue->length == 0) {
-    /* pool is flushing. */
-    g_mutex_unlock (&pool->app_lock);
-
-    goto pool_flushing;
-  }
-
   buff = g_queue_pop_head (pool->app_queue);
-
+  more = pool->app_queue->length > 0;
   g_mutex_unlock (&pool->app_lock);
-  goto push_buffer;
 
-pool_flushing:
-  /* pause task. */
-  gst_camera_buffer_pool_unref (src->pool);
+  if (!buff) {
+    GST_PAD_STREAM_UNLOCK (pad);
 
-  GST_DEBUG_OBJECT (src, "pool is flushing. pausing task");
-  gst_pad_pause_task (pad);
-  return;
+    GST_LOG_OBJECT (src, "empty app queue");
+    return GST_CAMERA_SCHEDULER_IDLE;
+  }
 
-push_buffer:
-  /* push buffer */
-  gst_camera_buffer_pool_unref (src->pool);
   if (G_UNLIKELY (src->send_new_segment)) {
     GST_DEBUG_OBJECT (src, "sending new segment event");
 
@@ -347,26 +377,19 @@ push_buffer:
     src->send_new_segment = FALSE;
   }
 
-  GST_OBJECT_LOCK (src);
+  if (G_UNLIKELY (!gst_camera_event_queue_is_empty (&src->events))) {
+    events = gst_camera_event_queue_take (&src->events);
 
-  if (src->events) {
-    events = src->events;
-    src->events = NULL;
-  }
-
-  GST_OBJECT_UNLOCK (src);
+    for (l = events; l; l = l->next) {
+      GST_DEBUG_OBJECT (src, "pushed event %" GST_PTR_FORMAT, l->data);
 
-  while (events) {
-    GstEvent *ev = g_list_nth_data (events, 0);
-    events = g_list_remove (events, ev);
-    GST_DEBUG_OBJECT (src, "pushed event %" GST_PTR_FORMAT, ev);
+      gst_pad_push_event (src->vfsrc, l->data);
+    }
 
-    gst_pad_push_event (src->vfsrc, ev);
+    g_list_free (events);
   }
 
-  g_list_free (events);
-
-  klass->update_segment (src, GST_BUFFER (buff));
+  klass->update_segment (src, pad, GST_BUFFER (buff));
 
   GST_LOG_OBJECT (src, "pushing buffer %p", buff);
   ret = gst_pad_push (pad, GST_BUFFER (buff));
@@ -375,11 +398,12 @@ push_buffer:
     goto pause;
   }
 
-  return;
+  GST_PAD_STREAM_UNLOCK (pad);
+
+  return more ? GST_CAMERA_SCHEDULER_BUSY : GST_CAMERA_SCHEDULER_IDLE;
 
 pause:
-  GST_DEBUG_OBJECT (src, "pausing task. reason: %s", gst_flow_get_name (ret));
-  gst_pad_pause_task (pad);
+  GST_DEBUG_OBJECT (src, "pausing. reason: %s", gst_flow_get_name (ret));
 
   if (ret == GST_FLOW_UNEXPECTED) {
     /* perform EOS */
@@ -393,6 +417,10 @@ pause:
     /* perform EOS */
     gst_pad_push_event (pad, gst_event_new_eos ());
   }
+
+  GST_PAD_STREAM_UNLOCK (pad);
+
+  return GST_CAMERA_SCHEDULER_PAUSE;
 }
 
 static gboolean
@@ -438,7 +466,8 @@ gst_droid_cam_src_vfsrc_negotiate (GstDroidCamSrc * src)
         "width", G_TYPE_INT, DEFAULT_VF_WIDTH,
         "height", G_TYPE_INT, DEFAULT_VF_HEIGHT,
         "framerate", GST_TYPE_FRACTION, DEFAULT_FPS, 1,
-        "orientation-angle", G_TYPE_INT, src->pool->orientation, NULL);
+        "orientation-angle", G_TYPE_INT, src->pool->orientation,
+        GST_CAMERA_BUFFER_META_CAPS_FIELD, G_TYPE_BOOLEAN, TRUE, NULL);
     GST_CAMERA_BUFFER_POOL_UNLOCK (src->pool);
 
     GST_DEBUG_OBJECT (src, "using default caps %" GST_PTR_FORMAT, caps);
@@ -21,11 +21,12 @@
 #define __GST_VF_SRC_PAD_H__
 
 #include <gst/gst.h>
+#include "gstcamerascheduler.h"
 
 G_BEGIN_DECLS
 
 GstPad *gst_vf_src_pad_new (GstStaticPadTemplate *pad_template, const char * name);
-gboolean gst_vf_src_pad_start_task (GstPad * pad);
+GstCameraSchedulerResult gst_vf_src_pad_dispatch (gpointer data);
 
 G_END_DECLS
 
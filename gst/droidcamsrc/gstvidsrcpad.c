@@ -19,6 +19,7 @@
 
 #include "gstvidsrcpad.h"
 #include "gstdroidcamsrc.h"
+#include "gstcamerafixate.h"
 #include "cameraparams.h"
 #include <gst/video/video.h>
 
@@ -33,7 +34,6 @@ static gboolean gst_droid_cam_src_vidsrc_activatepush (GstPad * pad,
 static const GstQueryType *gst_droid_cam_src_vidsrc_query_type (GstPad * pad);
 static gboolean gst_droid_cam_src_vidsrc_query (GstPad * pad, GstQuery * query);
 
-static void gst_droid_cam_src_vidsrc_loop (gpointer data);
 static gboolean gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src);
 
 /* TODO: Check any potential events needed by camerabin2 (start capture, finish capture, ...) */
@@ -71,6 +71,7 @@ gst_droid_cam_src_vidsrc_setcaps (GstPad * pad, GstCaps * caps)
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstDroidCamSrcClass *klass = GST_DROID_CAM_SRC_GET_CLASS (src);
 
+  struct camera_params *params;
   int width, height;
 
   GST_DEBUG_OBJECT (src, "vidsrc setcaps %" GST_PTR_FORMAT, caps);
@@ -88,7 +89,19 @@ gst_droid_cam_src_vidsrc_setcaps (GstPad * pad, GstCaps * caps)
   }
 
   GST_OBJECT_LOCK (src);
-  camera_params_set_video_size (src->camera_params, width, height);
+  params = gst_droid_cam_src_edit_camera_params (src);
+  if (params) {
+    if (!camera_params_set_video_size (params, width, height)) {
+      GST_OBJECT_UNLOCK (src);
+      camera_params_unref (params);
+
+      GST_ELEMENT_ERROR (src, STREAM, FORMAT,
+          ("Unsupported video resolution %dx%d", width, height), (NULL));
+      return FALSE;
+    }
+
+    gst_droid_cam_src_publish_camera_params (src, params);
+  }
   GST_OBJECT_UNLOCK (src);
 
   /* TODO: We are not yet setting framerate */
@@ -100,21 +113,21 @@ gst_droid_cam_src_vidsrc_getcaps (GstPad * pad)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
   GstCaps *caps = NULL;
+  struct camera_params *params;
 
   GST_DEBUG_OBJECT (src, "vidsrc getcaps");
 
-  GST_OBJECT_LOCK (src);
+  params = gst_droid_cam_src_get_camera_params (src);
 
-  if (src->camera_params) {
+  if (params) {
     GST_LOG_OBJECT (src, "caps from camera parameters");
-    caps = camera_params_get_video_caps (src->camera_params);
+    caps = camera_params_get_video_caps (params);
+    camera_params_unref (params);
   } else {
     GST_LOG_OBJECT (src, "caps from template");
     caps = gst_caps_copy (gst_pad_get_pad_template_caps (pad));
   }
 
-  GST_OBJECT_UNLOCK (src);
-
   GST_LOG_OBJECT (src, "returning %" GST_PTR_FORMAT, caps);
 
   return caps;
@@ -124,17 +137,28 @@ static void
 gst_droid_cam_src_vidsrc_fixatecaps (GstPad * pad, GstCaps * caps)
 {
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
-  GstStructure *s;
+  GstCameraFixateTarget target;
+  GstCameraFixateResult result;
 
   GST_LOG_OBJECT (src, "fixatecaps %" GST_PTR_FORMAT, caps);
 
-  gst_caps_truncate (caps);
-
-  s = gst_caps_get_structure (caps, 0);
-
-  gst_structure_fixate_field_nearest_int (s, "width", DEFAULT_VIDEO_WIDTH);
-  gst_structure_fixate_field_nearest_int (s, "height", DEFAULT_VIDEO_HEIGHT);
-  gst_structure_fixate_field_nearest_fraction (s, "framerate", DEFAULT_FPS, 1);
+  target.width = DEFAULT_VIDEO_WIDTH;
+  target.height = DEFAULT_VIDEO_HEIGHT;
+  target.fps = DEFAULT_FPS;
+  target.ref_width = target.ref_height = 0;
+
+  /* Video should show what the viewfinder showed */
+  gst_droid_cam_src_get_camera_size (src, CAMERA_PARAM_PREVIEW_SIZE,
+      &target.ref_width, &target.ref_height);
+
+  if (gst_camera_fixate_caps (caps, &target, &result)) {
+    GST_DEBUG_OBJECT (src, "picked %dx%d@%d/%d out of %u sizes. cost %.3f: "
+        "aspect %.3f against %dx%d, size %.3f against %dx%d@%d",
+        result.width, result.height, result.fps_n, result.fps_d,
+        result.candidates, result.cost, result.aspect_cost, target.ref_width,
+        target.ref_height, result.size_cost, target.width, target.height,
+        target.fps);
+  }
 
   GST_DEBUG_OBJECT (src, "caps now is %" GST_PTR_FORMAT, caps);
 }
@@ -149,50 +173,23 @@ gst_droid_cam_src_vidsrc_activatepush (GstPad * pad, gboolean active)
   GST_DEBUG_OBJECT (src, "vidsrc activatepush: %d", active);
 
   if (active) {
-    gboolean started;
-
     /* First we do caps negotiation */
     if (!gst_droid_cam_src_vidsrc_negotiate (src)) {
       return FALSE;
     }
 
-    /* Then we start our task */
-    GST_PAD_STREAM_LOCK (pad);
-
-    g_mutex_lock (&src->video_lock);
-    src->video_task_running = TRUE;
-
-    started = gst_pad_start_task (pad, gst_droid_cam_src_vidsrc_loop, pad);
-    if (!started) {
-      src->video_task_running = FALSE;
-
-      g_mutex_unlock (&src->video_lock);
-
-      GST_PAD_STREAM_UNLOCK (pad);
-
-      GST_ERROR_OBJECT (src, "Failed to start task");
-      gst_pad_stop_task (pad);
-
+    /* Then we start pushing */
+    if (!gst_camera_scheduler_start (src->scheduler,
+            GST_CAMERA_SCHEDULER_VIDEO)) {
+      GST_ERROR_OBJECT (src, "Failed to start streaming");
       return FALSE;
     }
-
-    g_mutex_unlock (&src->video_lock);
-
-    GST_PAD_STREAM_UNLOCK (pad);
   } else {
-    GST_DEBUG_OBJECT (src, "stopping task");
+    GST_DEBUG_OBJECT (src, "stopping streaming");
 
-    g_mutex_lock (&src->video_lock);
-
-    src->video_task_running = FALSE;
-
-    g_cond_signal (&src->video_cond);
-
-    g_mutex_unlock (&src->video_lock);
-
-    gst_pad_stop_task (pad);
+    gst_camera_scheduler_stop (src->scheduler, GST_CAMERA_SCHEDULER_VIDEO);
 
-    GST_DEBUG_OBJECT (src, "stopped task");
+    GST_DEBUG_OBJECT (src, "stopped streaming");
   }
 
   return TRUE;
@@ -208,8 +205,8 @@ gst_vid_src_pad_renegotiate (GstPad * pad)
   return gst_droid_cam_src_vidsrc_negotiate (src);
 }
 
-static void
-gst_droid_cam_src_vidsrc_loop (gpointer data)
+GstCameraSchedulerResult
+gst_vid_src_pad_dispatch (gpointer data)
 {
   GstPad *pad = (GstPad *) data;
   GstDroidCamSrc *src = GST_DROID_CAM_SRC (GST_OBJECT_PARENT (pad));
@@ -217,46 +214,34 @@ gst_droid_cam_src_vidsrc_loop (gpointer data)
   GstFlowReturn ret;
   gboolean stop_recording = FALSE;
   gboolean send_new_segment = FALSE;
+  gboolean more;
+
+  GST_LOG_OBJECT (src, "dispatch");
 
-  GST_LOG_OBJECT (src, "loop");
+  GST_PAD_STREAM_LOCK (pad);
 
   /* TODO: caps renegotiation */
   g_mutex_lock (&src->video_lock);
-  if (!src->video_task_running) {
-    g_mutex_unlock (&src->video_lock);
-
-    GST_DEBUG_OBJECT (src, "task not running");
-    return;
-  }
-
-  g_cond_wait (&src->video_cond, &src->video_lock);
-
-  if (!src->video_task_running) {
-    g_mutex_unlock (&src->video_lock);
-
-    GST_DEBUG_OBJECT (src, "task not running");
-    return;
-  }
 
   g_mutex_lock (&src->video_capture_status_lock);
   GST_LOG_OBJECT (src, "video capture status %d", src->video_capture_status);
 
   switch (src->video_capture_status) {
     case VIDEO_CAPTURE_ERROR:
-      g_assert_not_reached ();
-      break;
-    case VIDEO_CAPTURE_STOPPED:
-      /* This could still happen since main thread will signal us
-       * while stopping videos:
-       * 1) we saw the status change, performed EOS and stopped recording.
-       * 2) we stopped the recording
-       * 3) we got the signaled
-       */
+      /* We paused when we set it. Whatever is left is dropped by
+       * gst_droid_cam_src_stop_video_capture () */
+      g_mutex_unlock (&src->video_capture_status_lock);
+      g_mutex_unlock (&src->video_lock);
+      GST_PAD_STREAM_UNLOCK (pad);
+      return GST_CAMERA_SCHEDULER_PAUSE;
 
+    case VIDEO_CAPTURE_STOPPED:
+      /* Woken up after we have stopped already */
       GST_DEBUG_OBJECT (src, "video recording has been stopped already");
       g_mutex_unlock (&src->video_capture_status_lock);
       g_mutex_unlock (&src->video_lock);
-      return;
+      GST_PAD_STREAM_UNLOCK (pad);
+      return GST_CAMERA_SCHEDULER_IDLE;
 
     case VIDEO_CAPTURE_STARTING:
       send_new_segment = TRUE;
@@ -277,8 +262,14 @@ gst_droid_cam_src_vidsrc_loop (gpointer data)
   }
 
   buffer = g_queue_pop_head (src->video_queue);
+  more = src->video_queue->length > 0;
   g_mutex_unlock (&src->video_lock);
 
+  if (!buffer) {
+    GST_PAD_STREAM_UNLOCK (pad);
+    return GST_CAMERA_SCHEDULER_IDLE;
+  }
+
   if (send_new_segment) {
     GST_DEBUG_OBJECT (src, "sending new segment");
     if (!gst_pad_push_event (src->vidsrc, gst_event_new_new_segment (FALSE, 1.0,
@@ -312,8 +303,6 @@ gst_droid_cam_src_vidsrc_loop (gpointer data)
 
     g_mutex_unlock (&src->video_lock);
 
-    gst_pad_pause_task (src->vidsrc);
-
     GST_ELEMENT_ERROR (src, STREAM, FAILED,
         ("Internal data flow error."),
         ("streaming task paused, reason %s (%d)", gst_flow_get_name (ret),
@@ -323,9 +312,15 @@ gst_droid_cam_src_vidsrc_loop (gpointer data)
     gst_pad_push_event (src->vidsrc, gst_event_new_flush_start ());
     gst_pad_push_event (src->vidsrc, gst_event_new_flush_stop ());
     gst_pad_push_event (src->vidsrc, gst_event_new_eos ());
+
+    GST_PAD_STREAM_UNLOCK (pad);
+
+    return GST_CAMERA_SCHEDULER_PAUSE;
   }
 
-  return;
+  GST_PAD_STREAM_UNLOCK (pad);
+
+  return more ? GST_CAMERA_SCHEDULER_BUSY : GST_CAMERA_SCHEDULER_IDLE;
 
 stop_recording:
   GST_DEBUG_OBJECT (src, "stopping video recording");
@@ -348,7 +343,44 @@ stop_recording:
 
   g_mutex_unlock (&src->video_lock);
 
+  GST_PAD_STREAM_UNLOCK (pad);
+
   GST_DEBUG_OBJECT (src, "pushed %d video frames", src->num_video_frames);
+
+  return GST_CAMERA_SCHEDULER_IDLE;
+}
+
+/*
+ * Pad caps can not tell us if the camera still has the size they ask for:
+ * the device might have been opened again since.
+ */
+static gboolean
+gst_droid_cam_src_vidsrc_apply_size (GstDroidCamSrc * src, GstCaps * caps)
+{
+  int width = 0, height = 0;
+  gchar *size;
+  gboolean ret;
+
+  if (!gst_video_format_parse_caps (caps, NULL, &width, &height)) {
+    return FALSE;
+  }
+
+  size = g_strdup_printf ("%dx%d", width, height);
+
+  GST_OBJECT_LOCK (src);
+  ret = !src->camera_params
+      || gst_droid_cam_src_set_camera_param (src, CAMERA_PARAM_VIDEO_SIZE,
+      size);
+  GST_OBJECT_UNLOCK (src);
+
+  g_free (size);
+
+  if (!ret) {
+    GST_ELEMENT_ERROR (src, STREAM, FORMAT,
+        ("Unsupported video resolution %dx%d", width, height), (NULL));
+  }
+
+  return ret;
 }
 
 static gboolean
@@ -364,6 +396,15 @@ gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src)
 
   klass = GST_DROID_CAM_SRC_GET_CLASS (src);
 
+  peer = gst_pad_peer_get_caps_reffed (src->vidsrc);
+
+  common =
+      gst_droid_cam_src_lookup_negotiation (src, &src->video_negotiation, peer);
+  if (common) {
+    GST_DEBUG_OBJECT (src, "reusing caps %" GST_PTR_FORMAT, common);
+    goto set_caps;
+  }
+
   caps = gst_droid_cam_src_vidsrc_getcaps (src->vidsrc);
   if (!caps || gst_caps_is_empty (caps)) {
     GST_ELEMENT_ERROR (src, STREAM, FORMAT,
@@ -379,13 +420,7 @@ gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src)
 
   GST_LOG_OBJECT (src, "caps %" GST_PTR_FORMAT, caps);
 
-  peer = gst_pad_peer_get_caps_reffed (src->vidsrc);
-
   if (!peer || gst_caps_is_empty (peer) || gst_caps_is_any (peer)) {
-    if (peer) {
-      gst_caps_unref (peer);
-    }
-
     gst_caps_unref (caps);
 
     /* Use default. */
@@ -396,10 +431,8 @@ gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src)
 
     GST_DEBUG_OBJECT (src, "using default caps %" GST_PTR_FORMAT, caps);
 
-    ret = gst_pad_set_caps (src->vidsrc, caps);
-    gst_caps_unref (caps);
-
-    goto out;
+    common = caps;
+    goto set_caps;
   }
 
   GST_DEBUG_OBJECT (src, "peer caps %" GST_PTR_FORMAT, peer);
@@ -409,7 +442,6 @@ gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src)
   GST_LOG_OBJECT (src, "caps intersection %" GST_PTR_FORMAT, common);
 
   gst_caps_unref (caps);
-  gst_caps_unref (peer);
 
   if (gst_caps_is_empty (common)) {
     GST_ELEMENT_ERROR (src, STREAM, FORMAT, ("No common caps"), (NULL));
@@ -424,13 +456,25 @@ gst_droid_cam_src_vidsrc_negotiate (GstDroidCamSrc * src)
     gst_pad_fixate_caps (src->vidsrc, common);
   }
 
-  ret = gst_pad_set_caps (src->vidsrc, common);
+set_caps:
+  /* setcaps () is skipped if the pad has these caps already */
+  ret = gst_droid_cam_src_vidsrc_apply_size (src, common)
+      && gst_pad_set_caps (src->vidsrc, common);
+
+  if (ret) {
+    gst_droid_cam_src_store_negotiation (src, &src->video_negotiation, peer,
+        common);
+  }
 
   gst_caps_unref (common);
 
 out:
+  if (peer) {
+    gst_caps_unref (peer);
+  }
+
   if (ret) {
-    /* set camera parameters */
+    /* set camera parameters. Nothing reaches the HAL if they did not change */
     ret = klass->set_camera_params (src);
   }
 
@@ -21,11 +21,13 @@
 #define __GST_VID_SRC_PAD_H__
 
 #include <gst/gst.h>
+#include "gstcamerascheduler.h"
 
 G_BEGIN_DECLS
 
 GstPad *gst_vid_src_pad_new (GstStaticPadTemplate *pad_template, const char * name);
 gboolean gst_vid_src_pad_renegotiate (GstPad * pad);
+GstCameraSchedulerResult gst_vid_src_pad_dispatch (gpointer data);
 
 G_END_DECLS
 
@@ -19,6 +19,15 @@ BuildRequires:  pkgconfig(libexif)
 %description
 GStreamer source for Android camera hal
 
+%package devel
+Summary:    Preview buffer meta of the GStreamer Android camera source
+Group:      Development/Libraries
+Requires:   %{name} = %{version}-%{release}
+
+%description devel
+Header and pkg-config file for reading the buffer layout the GStreamer
+Android camera source attaches to preview buffers
+
 %prep
 %setup -q
 
@@ -30,8 +39,20 @@ make
 
 %install
 %make_install
+rm -f %{buildroot}%{_libdir}/*.la
+
+%post -p /sbin/ldconfig
+
+%postun -p /sbin/ldconfig
 
 %files
 %defattr(-,root,root,-)
 %{_libdir}/gstreamer-0.10/libgstdroidcamsrc.so
+%{_libdir}/libgstcamerabuffermeta-0.10.so.*
 %{_sysconfdir}/xdg/*.conf
+
+%files devel
+%defattr(-,root,root,-)
+%{_libdir}/libgstcamerabuffermeta-0.10.so
+%{_libdir}/pkgconfig/gstcamerabuffermeta-0.10.pc
+%{_includedir}/gstreamer-0.10/gst/droidcamsrc/gstcamerabuffermeta.h
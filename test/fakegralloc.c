@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A gralloc backed by plain heap memory. Enough for the buffer pool to
+ * allocate preview buffers and for the fake camera to write into them.
+ */
+
+#include "fakehal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static struct fake_gralloc_handle *
+fake_gralloc_handle (buffer_handle_t handle)
+{
+  struct fake_gralloc_handle *h = (struct fake_gralloc_handle *) handle;
+
+  if (!h || h->magic != FAKE_GRALLOC_MAGIC) {
+    return NULL;
+  }
+
+  return h;
+}
+
+static int
+fake_gralloc_bytes_per_pixel (int format)
+{
+  switch (format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+      return 4;
+    case HAL_PIXEL_FORMAT_RGB_888:
+      return 3;
+    case HAL_PIXEL_FORMAT_RGB_565:
+      return 2;
+    default:
+      /* YUV. Planes are accounted for in the size */
+      return 1;
+  }
+}
+
+static size_t
+fake_gralloc_size (int format, int stride, int height)
+{
+  size_t size =
+      (size_t) stride * height * fake_gralloc_bytes_per_pixel (format);
+
+  switch (format) {
+    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+    case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+    case HAL_PIXEL_FORMAT_YV12:
+      return size * 3 / 2;
+    case HAL_PIXEL_FORMAT_YCbCr_422_SP:
+    case HAL_PIXEL_FORMAT_YCbCr_422_I:
+      return size * 2;
+    default:
+      return size;
+  }
+}
+
+static int
+fake_gralloc_alloc (alloc_device_t * dev, int w, int h, int format,
+    int usage, buffer_handle_t * handle, int *stride)
+{
+  struct fake_gralloc_handle *hnd;
+
+  if (w <= 0 || h <= 0) {
+    return -EINVAL;
+  }
+
+  hnd = calloc (1, sizeof (*hnd));
+  if (!hnd) {
+    return -ENOMEM;
+  }
+
+  hnd->base.version = sizeof (native_handle_t);
+  hnd->base.numFds = 0;
+  hnd->base.numInts =
+      (sizeof (*hnd) - sizeof (native_handle_t)) / sizeof (int);
+
+  hnd->magic = FAKE_GRALLOC_MAGIC;
+  hnd->width = w;
+  hnd->height = h;
+  /* What most hardware wants */
+  hnd->stride = (w + 31) & ~31;
+  hnd->format = format;
+  hnd->usage = usage;
+  hnd->size = fake_gralloc_size (format, hnd->stride, h);
+  hnd->data = calloc (1, hnd->size);
+
+  if (!hnd->data) {
+    free (hnd);
+    return -ENOMEM;
+  }
+
+  *handle = (buffer_handle_t) hnd;
+  *stride = hnd->stride;
+
+  return 0;
+}
+
+static int
+fake_gralloc_free (alloc_device_t * dev, buffer_handle_t handle)
+{
+  struct fake_gralloc_handle *hnd = fake_gralloc_handle (handle);
+
+  if (!hnd) {
+    return -EINVAL;
+  }
+
+  hnd->magic = 0;
+  free (hnd->data);
+  free (hnd);
+
+  return 0;
+}
+
+static int
+fake_gralloc_close (struct hw_device_t *dev)
+{
+  free (dev);
+
+  return 0;
+}
+
+static int
+fake_gralloc_open (const struct hw_module_t *module, const char *name,
+    struct hw_device_t **device)
+{
+  alloc_device_t *dev;
+
+  if (strcmp (name, GRALLOC_HARDWARE_GPU0)) {
+    return -EINVAL;
+  }
+
+  dev = calloc (1, sizeof (*dev));
+  if (!dev) {
+    return -ENOMEM;
+  }
+
+  dev->common.tag = HARDWARE_DEVICE_TAG;
+  dev->common.version = 0;
+  dev->common.module = (struct hw_module_t *) module;
+  dev->common.close = fake_gralloc_close;
+  dev->alloc = fake_gralloc_alloc;
+  dev->free = fake_gralloc_free;
+
+  *device = &dev->common;
+
+  return 0;
+}
+
+static int
+fake_gralloc_register_buffer (struct gralloc_module_t const *module,
+    buffer_handle_t handle)
+{
+  return fake_gralloc_handle (handle) ? 0 : -EINVAL;
+}
+
+static int
+fake_gralloc_unregister_buffer (struct gralloc_module_t const *module,
+    buffer_handle_t handle)
+{
+  return fake_gralloc_handle (handle) ? 0 : -EINVAL;
+}
+
+static int
+fake_gralloc_lock (struct gralloc_module_t const *module,
+    buffer_handle_t handle, int usage, int l, int t, int w, int h,
+    void **vaddr)
+{
+  struct fake_gralloc_handle *hnd = fake_gralloc_handle (handle);
+
+  if (!hnd) {
+    return -EINVAL;
+  }
+
+  *vaddr = hnd->data;
+
+  return 0;
+}
+
+static int
+fake_gralloc_unlock (struct gralloc_module_t const *module,
+    buffer_handle_t handle)
+{
+  return fake_gralloc_handle (handle) ? 0 : -EINVAL;
+}
+
+static int
+fake_gralloc_perform (struct gralloc_module_t const *module, int operation,
+    ...)
+{
+  return -EINVAL;
+}
+
+static struct hw_module_methods_t fake_gralloc_methods = {
+  .open = fake_gralloc_open,
+};
+
+struct gralloc_module_t fake_gralloc_module = {
+  .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = HARDWARE_MODULE_API_VERSION (0, 1),
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = GRALLOC_HARDWARE_MODULE_ID,
+        .name = "Fake gralloc",
+        .author = "Jolla LTD.",
+        .methods = &fake_gralloc_methods,
+      },
+  .registerBuffer = fake_gralloc_register_buffer,
+  .unregisterBuffer = fake_gralloc_unregister_buffer,
+  .lock = fake_gralloc_lock,
+  .unlock = fake_gralloc_unlock,
+  .perform = fake_gralloc_perform,
+};
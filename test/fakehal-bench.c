@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures frame rate, latency and CPU time per frame of droidcamsrc running
+ * on top of the fake camera HAL:
+ *
+ *   LD_PRELOAD=.libs/libfakehal.so ./fakehal-bench [-m mode] [-t seconds] \
+ *     [-n captures] [-d device]
+ *
+ * mode is viewfinder, capture, recording or all. Viewfinder and video
+ * latency is the running time at the sink minus the buffer timestamp.
+ * Capture latency is the time from start-capture to the image reaching the
+ * sink. CPU time covers the whole process, fake HAL included, so run with
+ * FAKEHAL_FPS=0 to see what the element itself costs.
+ */
+
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define DEFAULT_SECONDS         5
+#define DEFAULT_CAPTURES        10
+#define CAPTURE_RETRY_MS        5
+
+#define SINK "fakesink sync=false async=false signal-handoffs=true"
+#define PIPELINE "droidcamsrc name=src camera-device=%d " \
+  "src.vfsrc ! " SINK " name=vf " \
+  "src.imgsrc ! " SINK " name=img " \
+  "src.vidsrc ! " SINK " name=vid"
+
+typedef enum
+{
+  BENCH_VIEWFINDER = 0,
+  BENCH_CAPTURE = 1,
+  BENCH_RECORDING = 2,
+} BenchMode;
+
+static const char *bench_mode_names[] = {
+  "viewfinder", "capture", "recording"
+};
+
+typedef struct
+{
+  GMutex lock;
+  guint frames;
+  gint64 first;
+  gint64 last;
+  GArray *latency;
+} BenchStats;
+
+typedef struct
+{
+  BenchMode mode;
+  int seconds;
+  int captures;
+  int device;
+
+  GMainLoop *loop;
+  GstElement *pipeline;
+  GstElement *src;
+
+  BenchStats vf;
+  BenchStats img;
+  BenchStats vid;
+
+  gint started;
+  gint64 capture_start;
+  struct rusage usage;
+  gint64 cpu_us;
+  int ret;
+} Bench;
+
+static gint64
+bench_cpu_time (const struct rusage *usage)
+{
+  return (gint64) (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) *
+      G_USEC_PER_SEC + usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+}
+
+static void
+bench_stats_init (BenchStats * stats)
+{
+  g_mutex_init (&stats->lock);
+  stats->frames = 0;
+  stats->first = stats->last = 0;
+  stats->latency = g_array_new (FALSE, FALSE, sizeof (gint64));
+}
+
+static void
+bench_stats_free (BenchStats * stats)
+{
+  g_array_free (stats->latency, TRUE);
+  g_mutex_clear (&stats->lock);
+}
+
+static void
+bench_stats_add (BenchStats * stats, gint64 latency)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&stats->lock);
+
+  if (!stats->frames++) {
+    stats->first = now;
+  }
+
+  stats->last = now;
+
+  if (latency >= 0) {
+    g_array_append_val (stats->latency, latency);
+  }
+
+  g_mutex_unlock (&stats->lock);
+}
+
+static gint
+bench_compare (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void
+bench_stats_print (Bench * bench, const char *name, BenchStats * stats,
+    gboolean primary)
+{
+  GArray *lat = stats->latency;
+  gint64 sum = 0;
+  double fps = 0;
+  guint x;
+
+  g_print ("%-10s %-10s %6u frames", bench_mode_names[bench->mode], name,
+      stats->frames);
+
+  if (stats->frames > 1 && stats->last > stats->first) {
+    fps = (stats->frames - 1) * (double) G_USEC_PER_SEC /
+        (stats->last - stats->first);
+    g_print (" %8.2f fps", fps);
+  }
+
+  if (lat->len > 0) {
+    g_array_sort (lat, bench_compare);
+
+    for (x = 0; x < lat->len; x++) {
+      sum += g_array_index (lat, gint64, x);
+    }
+
+    g_print ("  latency ms min %.2f avg %.2f p99 %.2f max %.2f",
+        g_array_index (lat, gint64, 0) / 1000.0,
+        sum / 1000.0 / lat->len,
+        g_array_index (lat, gint64, (lat->len - 1) * 99 / 100) / 1000.0,
+        g_array_index (lat, gint64, lat->len - 1) / 1000.0);
+  }
+
+  if (primary && stats->frames > 0) {
+    g_print ("  cpu %.0f us/frame", (double) bench->cpu_us / stats->frames);
+  }
+
+  g_print ("\n");
+}
+
+/* Running time at the sink minus the timestamp the element gave the buffer */
+static gint64
+bench_latency (GstElement * sink, GstBuffer * buffer)
+{
+  GstClock *clock;
+  GstClockTime now;
+
+  if (!GST_BUFFER_TIMESTAMP_IS_VALID (buffer)) {
+    return -1;
+  }
+
+  clock = gst_element_get_clock (sink);
+  if (!clock) {
+    return -1;
+  }
+
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (sink);
+  gst_object_unref (clock);
+
+  if (now < GST_BUFFER_TIMESTAMP (buffer)) {
+    return 0;
+  }
+
+  return GST_TIME_AS_USECONDS (now - GST_BUFFER_TIMESTAMP (buffer));
+}
+
+static gboolean
+bench_stop (gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  bench->cpu_us = bench_cpu_time (&usage) - bench_cpu_time (&bench->usage);
+
+  g_main_loop_quit (bench->loop);
+
+  return FALSE;
+}
+
+static gboolean
+bench_stop_recording (gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+
+  g_signal_emit_by_name (bench->src, "stop-capture", NULL);
+
+  return bench_stop (bench);
+}
+
+static gboolean
+bench_capture (gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  gboolean ready = FALSE;
+
+  g_object_get (bench->src, "ready-for-capture", &ready, NULL);
+  if (!ready) {
+    g_timeout_add (CAPTURE_RETRY_MS, bench_capture, bench);
+    return FALSE;
+  }
+
+  bench->capture_start = g_get_monotonic_time ();
+  g_signal_emit_by_name (bench->src, "start-capture", NULL);
+
+  return FALSE;
+}
+
+/* Called once the viewfinder is running */
+static gboolean
+bench_start (gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+
+  getrusage (RUSAGE_SELF, &bench->usage);
+
+  switch (bench->mode) {
+    case BENCH_VIEWFINDER:
+      g_timeout_add_seconds (bench->seconds, bench_stop, bench);
+      break;
+    case BENCH_CAPTURE:
+      bench_capture (bench);
+      break;
+    case BENCH_RECORDING:
+      g_signal_emit_by_name (bench->src, "start-capture", NULL);
+      g_timeout_add_seconds (bench->seconds, bench_stop_recording, bench);
+      break;
+  }
+
+  return FALSE;
+}
+
+static void
+bench_vf_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+
+  /* The first frame pays for starting up so it is not counted */
+  if (g_atomic_int_compare_and_exchange (&bench->started, 0, 1)) {
+    g_idle_add (bench_start, bench);
+    return;
+  }
+
+  bench_stats_add (&bench->vf, bench_latency (sink, buffer));
+}
+
+static void
+bench_img_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+
+  bench_stats_add (&bench->img, g_get_monotonic_time () -
+      bench->capture_start);
+
+  if (bench->img.frames < (guint) bench->captures) {
+    g_idle_add (bench_capture, bench);
+  } else {
+    g_idle_add (bench_stop, bench);
+  }
+}
+
+static void
+bench_vid_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+
+  bench_stats_add (&bench->vid, bench_latency (sink, buffer));
+}
+
+static gboolean
+bench_bus_watch (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  Bench *bench = (Bench *) user_data;
+  GError *err = NULL;
+  gchar *debug = NULL;
+
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_ERROR) {
+    return TRUE;
+  }
+
+  gst_message_parse_error (message, &err, &debug);
+  g_printerr ("Error: %s (%s)\n", err->message, debug ? debug : "");
+  g_error_free (err);
+  g_free (debug);
+
+  bench->ret = 1;
+  g_main_loop_quit (bench->loop);
+
+  return TRUE;
+}
+
+static void
+bench_connect (Bench * bench, const char *name, GCallback callback)
+{
+  GstElement *sink = gst_bin_get_by_name (GST_BIN (bench->pipeline), name);
+
+  g_signal_connect (sink, "handoff", callback, bench);
+  gst_object_unref (sink);
+}
+
+static int
+bench_run (BenchMode mode, int seconds, int captures, int device)
+{
+  Bench bench;
+  GError *err = NULL;
+  GstBus *bus;
+  gchar *desc;
+
+  memset (&bench, 0, sizeof (bench));
+  bench.mode = mode;
+  bench.seconds = seconds;
+  bench.captures = captures;
+  bench.device = device;
+
+  desc = g_strdup_printf (PIPELINE, device);
+  bench.pipeline = gst_parse_launch (desc, &err);
+  g_free (desc);
+
+  if (!bench.pipeline) {
+    g_printerr ("Failed to create pipeline: %s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+
+  bench_stats_init (&bench.vf);
+  bench_stats_init (&bench.img);
+  bench_stats_init (&bench.vid);
+
+  bench.loop = g_main_loop_new (NULL, FALSE);
+  bench.src = gst_bin_get_by_name (GST_BIN (bench.pipeline), "src");
+  g_object_set (bench.src, "mode", mode == BENCH_RECORDING ? 2 : 1, NULL);
+
+  bench_connect (&bench, "vf", G_CALLBACK (bench_vf_handoff));
+  bench_connect (&bench, "img", G_CALLBACK (bench_img_handoff));
+  bench_connect (&bench, "vid", G_CALLBACK (bench_vid_handoff));
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (bench.pipeline));
+  gst_bus_add_watch (bus, bench_bus_watch, &bench);
+  gst_object_unref (bus);
+
+  if (gst_element_set_state (bench.pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Failed to start pipeline\n");
+    bench.ret = 1;
+  } else {
+    g_main_loop_run (bench.loop);
+  }
+
+  gst_element_set_state (bench.pipeline, GST_STATE_NULL);
+
+  if (!bench.ret) {
+    bench_stats_print (&bench, "vfsrc", &bench.vf, mode == BENCH_VIEWFINDER);
+
+    if (mode == BENCH_CAPTURE) {
+      bench_stats_print (&bench, "imgsrc", &bench.img, TRUE);
+    } else if (mode == BENCH_RECORDING) {
+      bench_stats_print (&bench, "vidsrc", &bench.vid, TRUE);
+    }
+  }
+
+  gst_object_unref (bench.src);
+  gst_object_unref (bench.pipeline);
+  g_main_loop_unref (bench.loop);
+
+  bench_stats_free (&bench.vf);
+  bench_stats_free (&bench.img);
+  bench_stats_free (&bench.vid);
+
+  return bench.ret;
+}
+
+static void
+usage (const char *name)
+{
+  g_printerr ("usage: %s [-m viewfinder|capture|recording|all] "
+      "[-t seconds] [-n captures] [-d device]\n", name);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *mode = "all";
+  int seconds = DEFAULT_SECONDS;
+  int captures = DEFAULT_CAPTURES;
+  int device = 0;
+  int runs = 0;
+  int ret = 0;
+  int x;
+
+  gst_init (&argc, &argv);
+
+  for (x = 1; x < argc; x++) {
+    if (x + 1 == argc) {
+      usage (argv[0]);
+      return 1;
+    }
+
+    if (!strcmp (argv[x], "-m")) {
+      mode = argv[++x];
+    } else if (!strcmp (argv[x], "-t")) {
+      seconds = atoi (argv[++x]);
+    } else if (!strcmp (argv[x], "-n")) {
+      captures = atoi (argv[++x]);
+    } else if (!strcmp (argv[x], "-d")) {
+      device = atoi (argv[++x]);
+    } else {
+      usage (argv[0]);
+      return 1;
+    }
+  }
+
+  for (x = BENCH_VIEWFINDER; x <= BENCH_RECORDING; x++) {
+    if (strcmp (mode, "all") && strcmp (mode, bench_mode_names[x])) {
+      continue;
+    }
+
+    ret |= bench_run (x, seconds, captures, device);
+    ++runs;
+  }
+
+  if (!runs) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  return ret;
+}
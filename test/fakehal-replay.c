@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Turns a trace recorded by droidcamsrc (hal-trace-location) into what the
+ * fake camera needs to play it back: the parameters the HAL reported, the
+ * timing of every preview session and how long captures and focusing took.
+ */
+
+#include "fakehal.h"
+#include "gsthaltrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct fake_replay_builder
+{
+  struct fake_replay *replay;
+  struct fake_replay_session *session;
+  int64_t session_start;
+  int64_t last;
+
+  int capture_pending;
+  struct fake_replay_capture capture;
+  int64_t capture_start;
+
+  int focus_pending;
+  int64_t focus_start;
+};
+
+static void *
+fake_replay_append (void *array, int *len, size_t size)
+{
+  char *ret = realloc (array, (*len + 1) * size);
+
+  if (!ret) {
+    return NULL;
+  }
+
+  memset (ret + *len * size, 0x0, size);
+  ++*len;
+
+  return ret;
+}
+
+static int
+fake_replay_add_event (struct fake_replay_builder *b,
+    const GstHalTraceRecord * record)
+{
+  struct fake_replay_session *s = b->session;
+  struct fake_replay_event *events;
+  struct fake_replay_event *ev;
+
+  events = fake_replay_append (s->events, &s->n_events, sizeof (*ev));
+  if (!events) {
+    return -1;
+  }
+
+  s->events = events;
+  ev = &events[s->n_events - 1];
+  ev->time = record->time - b->session_start;
+  ev->event = record->event;
+  memcpy (ev->args, record->args, sizeof (ev->args));
+
+  return 0;
+}
+
+static int
+fake_replay_start_session (struct fake_replay_builder *b, int64_t time)
+{
+  struct fake_replay *r = b->replay;
+  struct fake_replay_session *sessions;
+
+  sessions = fake_replay_append (r->sessions, &r->n_sessions,
+      sizeof (*sessions));
+  if (!sessions) {
+    return -1;
+  }
+
+  r->sessions = sessions;
+  b->session = &sessions[r->n_sessions - 1];
+  b->session_start = time;
+
+  return 0;
+}
+
+static void
+fake_replay_end_session (struct fake_replay_builder *b, int64_t time)
+{
+  if (b->session) {
+    b->session->duration = time - b->session_start;
+    b->session = NULL;
+  }
+}
+
+static int
+fake_replay_add_capture (struct fake_replay_builder *b)
+{
+  struct fake_replay *r = b->replay;
+  struct fake_replay_capture *captures;
+
+  b->capture_pending = 0;
+
+  captures = fake_replay_append (r->captures, &r->n_captures,
+      sizeof (*captures));
+  if (!captures) {
+    return -1;
+  }
+
+  r->captures = captures;
+  captures[r->n_captures - 1] = b->capture;
+
+  return 0;
+}
+
+static int
+fake_replay_add_focus (struct fake_replay_builder *b, int64_t delay, int ext1)
+{
+  struct fake_replay *r = b->replay;
+  struct fake_replay_focus *focus;
+
+  b->focus_pending = 0;
+
+  focus = fake_replay_append (r->focus, &r->n_focus, sizeof (*focus));
+  if (!focus) {
+    return -1;
+  }
+
+  r->focus = focus;
+  focus[r->n_focus - 1].delay = delay;
+  focus[r->n_focus - 1].ext1 = ext1;
+
+  return 0;
+}
+
+static int
+fake_replay_add_record (struct fake_replay_builder *b,
+    const GstHalTraceRecord * record, const char *payload)
+{
+  int64_t time = record->time;
+  int err = 0;
+
+  b->last = time;
+
+  switch (record->event) {
+    case GST_HAL_TRACE_PARAMS:
+      /* The first one is what the HAL started with */
+      if (!b->replay->params && payload) {
+        b->replay->params = strndup (payload, record->payload);
+      }
+      break;
+
+    case GST_HAL_TRACE_START_PREVIEW:
+      fake_replay_end_session (b, time);
+      err = fake_replay_start_session (b, time);
+      break;
+
+    case GST_HAL_TRACE_STOP_PREVIEW:
+      fake_replay_end_session (b, time);
+      break;
+
+    case GST_HAL_TRACE_TAKE_PICTURE:
+      fake_replay_end_session (b, time);
+      if (b->capture_pending) {
+        /* No JPEG for the previous one */
+        b->capture.jpeg = -1;
+        err = fake_replay_add_capture (b);
+      }
+
+      b->capture_pending = 1;
+      b->capture_start = time;
+      b->capture.shutter = -1;
+      b->capture.jpeg = -1;
+      b->capture.size = 0;
+      break;
+
+    case GST_HAL_TRACE_AUTO_FOCUS:
+      if (b->focus_pending) {
+        err = fake_replay_add_focus (b, -1, 0);
+      }
+
+      b->focus_pending = 1;
+      b->focus_start = time;
+      break;
+
+    case GST_HAL_TRACE_CANCEL_AUTO_FOCUS:
+      if (b->focus_pending) {
+        err = fake_replay_add_focus (b, -1, 0);
+      }
+      break;
+
+    case GST_HAL_TRACE_NOTIFY:
+      if (record->args[0] == CAMERA_MSG_SHUTTER && b->capture_pending) {
+        b->capture.shutter = time - b->capture_start;
+      } else if (record->args[0] == CAMERA_MSG_FOCUS && b->focus_pending) {
+        err = fake_replay_add_focus (b, time - b->focus_start,
+            record->args[1]);
+      } else if (b->session) {
+        /* Errors, focus moves and whatever else the HAL had to say */
+        err = fake_replay_add_event (b, record);
+      }
+      break;
+
+    case GST_HAL_TRACE_DATA:
+      if (record->args[0] == CAMERA_MSG_COMPRESSED_IMAGE
+          && b->capture_pending) {
+        b->capture.jpeg = time - b->capture_start;
+        b->capture.size = record->size;
+        err = fake_replay_add_capture (b);
+      }
+      /* Preview frame callbacks follow the preview frames */
+      break;
+
+    case GST_HAL_TRACE_DATA_TIMESTAMP:
+      if (record->args[0] == CAMERA_MSG_VIDEO_FRAME && b->session) {
+        err = fake_replay_add_event (b, record);
+      }
+      break;
+
+    case GST_HAL_TRACE_ENQUEUE_BUFFER:
+      if (b->session) {
+        err = fake_replay_add_event (b, record);
+      }
+      break;
+
+    default:
+      /* The HAL reproduces the rest from the parameters */
+      break;
+  }
+
+  return err;
+}
+
+struct fake_replay *
+fake_replay_load (const char *path)
+{
+  struct fake_replay_builder b;
+  GstHalTraceHeader header;
+  GstHalTraceRecord record;
+  FILE *file;
+  char *payload = NULL;
+  int err = 0;
+
+  file = fopen (path, "rb");
+  if (!file) {
+    perror (path);
+    return NULL;
+  }
+
+  if (fread (&header, sizeof (header), 1, file) != 1
+      || header.magic != GST_HAL_TRACE_MAGIC
+      || header.version != GST_HAL_TRACE_VERSION
+      || header.record_size != sizeof (GstHalTraceRecord)) {
+    fprintf (stderr, "%s: not a HAL trace\n", path);
+    fclose (file);
+    return NULL;
+  }
+
+  memset (&b, 0x0, sizeof (b));
+  b.replay = calloc (1, sizeof (*b.replay));
+  if (!b.replay) {
+    fclose (file);
+    return NULL;
+  }
+
+  while (!err && fread (&record, sizeof (record), 1, file) == 1) {
+    if (record.payload) {
+      char *p = realloc (payload, record.payload);
+
+      if (!p || fread (p, record.payload, 1, file) != 1) {
+        /* Truncated. Keep what we have */
+        payload = p ? p : payload;
+        break;
+      }
+
+      payload = p;
+    }
+
+    err = fake_replay_add_record (&b, &record,
+        record.payload ? payload : NULL);
+  }
+
+  free (payload);
+  fclose (file);
+
+  fake_replay_end_session (&b, b.last);
+
+  if (!err && b.capture_pending) {
+    err = fake_replay_add_capture (&b);
+  }
+
+  if (!err && b.focus_pending) {
+    err = fake_replay_add_focus (&b, -1, 0);
+  }
+
+  if (err) {
+    fprintf (stderr, "%s: out of memory\n", path);
+    fake_replay_free (b.replay);
+    return NULL;
+  }
+
+  return b.replay;
+}
+
+void
+fake_replay_free (struct fake_replay *replay)
+{
+  int x;
+
+  if (!replay) {
+    return;
+  }
+
+  for (x = 0; x < replay->n_sessions; x++) {
+    free (replay->sessions[x].events);
+  }
+
+  free (replay->sessions);
+  free (replay->captures);
+  free (replay->focus);
+  free (replay->params);
+  free (replay);
+}
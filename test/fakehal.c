@@ -0,0 +1,1514 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A camera HAL v1 module which needs no hardware. It replaces
+ * hw_get_module() so it has to be preloaded:
+ *
+ *   LD_PRELOAD=test/.libs/libfakehal.so gst-launch-0.10 droidcamsrc ! ...
+ *
+ * Preview frames are pushed through preview_stream_ops, video frames and
+ * JPEGs go through the data callbacks just like a real HAL would do it.
+ * It is tuned with environment variables:
+ *
+ *   FAKEHAL_CAMERAS           number of cameras (0-2, default 2)
+ *   FAKEHAL_PARAMS            file to read the initial parameters from
+ *   FAKEHAL_FPS               frame rate, 0 for as fast as possible
+ *                             (default: preview-frame-rate)
+ *   FAKEHAL_JITTER_US         random delay added to every frame and callback
+ *   FAKEHAL_FILL              1 to write whole frames instead of one line
+ *   FAKEHAL_BUFFERS           preview buffers we ask the window for
+ *   FAKEHAL_VIDEO_BUFFERS     video frames which can be in flight
+ *   FAKEHAL_CAPTURE_DELAY_MS  time between take_picture and the JPEG
+ *   FAKEHAL_FOCUS_DELAY_MS    time between auto_focus and the notification
+ *   FAKEHAL_JPEG_SIZE         pad JPEGs to at least this many bytes
+ *   FAKEHAL_REPLAY            trace to play back instead (see below)
+ *
+ * A trace recorded on a device with GST_DROID_CAM_SRC_HAL_TRACE=file (or the
+ * hal-trace-location property) can be replayed here:
+ *
+ *   FAKEHAL_REPLAY=file LD_PRELOAD=test/.libs/libfakehal.so test/fakehal-bench
+ *
+ * The parameters come from the trace unless FAKEHAL_PARAMS is set. Every
+ * start_preview () plays the next recorded preview session, frame by frame
+ * and video frame by video frame at the recorded times, along with any other
+ * notification the HAL sent. A session which runs longer than the recording
+ * loops over its frames. Captures and focusing take as long as they took on
+ * the device and produce JPEGs of the recorded size.
+ */
+
+#include "fakehal.h"
+#include "gsthaltrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#define DEFAULT_CAMERAS                 2
+#define DEFAULT_BUFFERS                 4
+#define DEFAULT_VIDEO_BUFFERS           8
+#define DEFAULT_CAPTURE_DELAY_MS        150
+#define DEFAULT_FOCUS_DELAY_MS          100
+#define DEFAULT_JPEG_SIZE               0
+
+#define PREVIEW_FORMAT                  HAL_PIXEL_FORMAT_YCrCb_420_SP
+#define METADATA_SIZE                   8
+
+static const char fake_camera_default_params[] =
+    "preview-size=640x480;"
+    "preview-size-values=1920x1080,1280x720,800x480,640x480,320x240;"
+    "preview-format=yuv420sp;preview-format-values=yuv420sp,yuv420p;"
+    "preview-frame-rate=30;preview-frame-rate-values=15,24,30;"
+    "preview-fps-range=7500,30000;"
+    "preview-fps-range-values=(7500,30000),(30000,30000);"
+    "picture-size=2048x1536;"
+    "picture-size-values=3264x2448,2048x1536,1600x1200,1280x720,640x480;"
+    "picture-format=jpeg;picture-format-values=jpeg;jpeg-quality=95;"
+    "jpeg-thumbnail-width=320;jpeg-thumbnail-height=240;"
+    "jpeg-thumbnail-size-values=320x240,0x0;"
+    "video-size=1280x720;video-size-values=1920x1080,1280x720,640x480;"
+    "preferred-preview-size-for-video=1280x720;video-frame-format=yuv420sp;"
+    "focus-mode=auto;"
+    "focus-mode-values=auto,infinity,macro,continuous-video,"
+    "continuous-picture;"
+    "flash-mode=off;flash-mode-values=off,auto,on,torch;"
+    "whitebalance=auto;"
+    "whitebalance-values=auto,incandescent,fluorescent,daylight,"
+    "cloudy-daylight;"
+    "iso=auto;iso-values=auto,100,200,400,800;"
+    "exposure-compensation=0;exposure-compensation-step=0.5;"
+    "min-exposure-compensation=-4;max-exposure-compensation=4;"
+    "zoom=0;max-zoom=60;zoom-supported=true;smooth-zoom-supported=false;"
+    "focus-areas=(0,0,0,0,0);max-num-focus-areas=1;"
+    "metering-areas=(0,0,0,0,0);max-num-metering-areas=1;"
+    "denoise=denoise-off;denoise-values=denoise-off,denoise-on;"
+    "recording-hint=false;video-snapshot-supported=true;"
+    "focal-length=3.5;horizontal-view-angle=60;vertical-view-angle=45";
+
+struct fake_camera_config
+{
+  int fps;
+  int jitter_us;
+  int fill;
+  int buffers;
+  int video_buffers;
+  int capture_delay_ms;
+  int focus_delay_ms;
+  int jpeg_size;
+};
+
+struct fake_camera
+{
+  camera_device_t dev;
+  int id;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  struct fake_camera_config config;
+  unsigned seed;
+
+  camera_notify_callback notify_cb;
+  camera_data_callback data_cb;
+  camera_data_timestamp_callback data_cb_timestamp;
+  camera_request_memory get_memory;
+  void *user;
+  int32_t msgs;
+
+  char *params;
+
+  struct preview_stream_ops *window;
+  pthread_t preview_thread;
+  int previewing;
+  int width;
+  int height;
+  unsigned frame;
+  camera_memory_t *preview_mem;
+
+  int recording;
+  int metadata;
+  int video_width;
+  int video_height;
+  camera_memory_t *video_mem;
+  size_t video_size;
+  unsigned char *video_busy;
+  int video_in_flight;
+
+  /* take_picture () and auto_focus () threads still running */
+  int jobs;
+  unsigned focus_id;
+
+  /* What to play back next from the replay */
+  struct fake_replay *replay;
+  unsigned next_session;
+  unsigned next_capture;
+  unsigned next_focus;
+};
+
+int
+fake_hal_env_int (const char *name, int def)
+{
+  const char *env = getenv (name);
+
+  if (!env || !*env) {
+    return def;
+  }
+
+  return atoi (env);
+}
+
+int64_t
+fake_hal_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct fake_camera *
+fake_camera_get (struct camera_device *dev)
+{
+  return (struct fake_camera *) dev->priv;
+}
+
+/* Needs the lock */
+static int64_t
+fake_camera_jitter (struct fake_camera *cam)
+{
+  if (cam->config.jitter_us <= 0) {
+    return 0;
+  }
+
+  return (int64_t) (rand_r (&cam->seed) % (cam->config.jitter_us + 1)) * 1000;
+}
+
+static void
+fake_camera_sleep (int64_t ns)
+{
+  struct timespec ts;
+
+  if (ns <= 0) {
+    return;
+  }
+
+  ts.tv_sec = ns / 1000000000LL;
+  ts.tv_nsec = ns % 1000000000LL;
+
+  while (nanosleep (&ts, &ts) == -1 && errno == EINTR);
+}
+
+/*
+ * Looks key up in a "key1=value1;key2=value2" string and copies the value
+ * to val. Returns 0 if the key is not there.
+ */
+static int
+fake_camera_param (const char *params, const char *key, char *val,
+    size_t len)
+{
+  size_t key_len = strlen (key);
+  const char *pos = params;
+
+  while (pos && *pos) {
+    const char *end = strchr (pos, ';');
+    size_t n = end ? (size_t) (end - pos) : strlen (pos);
+
+    if (n > key_len && !strncmp (pos, key, key_len) && pos[key_len] == '=') {
+      n -= key_len + 1;
+      if (n >= len) {
+        n = len - 1;
+      }
+
+      memcpy (val, pos + key_len + 1, n);
+      val[n] = '\0';
+      return 1;
+    }
+
+    pos = end ? end + 1 : NULL;
+  }
+
+  return 0;
+}
+
+static int
+fake_camera_param_int (const char *params, const char *key, int def)
+{
+  char val[32];
+
+  if (!fake_camera_param (params, key, val, sizeof (val))) {
+    return def;
+  }
+
+  return atoi (val);
+}
+
+static int
+fake_camera_param_size (const char *params, const char *key, int *width,
+    int *height)
+{
+  char val[32];
+
+  if (!fake_camera_param (params, key, val, sizeof (val))) {
+    return 0;
+  }
+
+  return sscanf (val, "%dx%d", width, height) == 2 && *width > 0
+      && *height > 0;
+}
+
+/* Like a real HAL we refuse values which are not in the matching list */
+static int
+fake_camera_param_supported (const char *params, const char *key)
+{
+  char val[32];
+  char values_key[64];
+  char *values;
+  char *pos;
+  size_t len;
+  int ret = 0;
+
+  if (!fake_camera_param (params, key, val, sizeof (val))) {
+    return 1;
+  }
+
+  snprintf (values_key, sizeof (values_key), "%s-values", key);
+
+  len = strlen (params) + 1;
+  values = malloc (len);
+  if (!values) {
+    return 0;
+  }
+
+  if (!fake_camera_param (params, values_key, values, len)) {
+    free (values);
+    return 1;
+  }
+
+  len = strlen (val);
+
+  for (pos = values; pos; pos = strchr (pos, ',')) {
+    if (*pos == ',') {
+      ++pos;
+    }
+
+    if (!strncmp (pos, val, len) && (pos[len] == ',' || pos[len] == '\0')) {
+      ret = 1;
+      break;
+    }
+  }
+
+  free (values);
+
+  return ret;
+}
+
+static char *
+fake_camera_load_params (void)
+{
+  const char *path = getenv ("FAKEHAL_PARAMS");
+  FILE *file;
+  char *params;
+  long size;
+
+  if (!path) {
+    return strdup (fake_camera_default_params);
+  }
+
+  file = fopen (path, "r");
+  if (!file) {
+    perror (path);
+    return strdup (fake_camera_default_params);
+  }
+
+  fseek (file, 0, SEEK_END);
+  size = ftell (file);
+  fseek (file, 0, SEEK_SET);
+
+  params = calloc (1, size + 1);
+  if (params && fread (params, 1, size, file) != (size_t) size) {
+    free (params);
+    params = NULL;
+  }
+
+  fclose (file);
+
+  while (params && size > 0 && (params[size - 1] == '\n'
+          || params[size - 1] == '\r')) {
+    params[--size] = '\0';
+  }
+
+  return params;
+}
+
+/*
+ * Smallest baseline JPEG we can produce: one gray component, one quantization
+ * table and huffman tables which only know "no change" and "end of block" so
+ * every 8x8 block takes 2 bits. Comment segments make up the requested size.
+ */
+static unsigned char *
+fake_camera_jpeg (int width, int height, size_t target, size_t *size)
+{
+  static const unsigned char header[] = {
+    0xff, 0xd8,
+    0xff, 0xe0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00,
+    0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+  };
+  static const unsigned char dht[] = {
+    0xff, 0xc4, 0x00, 0x26,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  };
+  static const unsigned char sos[] = {
+    0xff, 0xda, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00,
+  };
+  size_t blocks = (size_t) ((width + 7) / 8) * ((height + 7) / 8);
+  size_t scan = (blocks * 2 + 7) / 8;
+  size_t len = sizeof (header) + 69 + 13 + sizeof (dht) + sizeof (sos) + scan
+      + 2;
+  size_t padding = target > len ? target - len : 0;
+  unsigned char *jpeg;
+  unsigned char *pos;
+
+  /* Every comment segment costs 4 bytes on top of its payload */
+  if (padding > 0 && padding < 4) {
+    padding = 4;
+  }
+
+  jpeg = malloc (len + padding);
+  if (!jpeg) {
+    return NULL;
+  }
+
+  pos = jpeg;
+  memcpy (pos, header, sizeof (header));
+  pos += sizeof (header);
+
+  while (padding >= 4) {
+    size_t n = padding > 0xffff + 2 ? 0xffff + 2 : padding;
+
+    /* Do not leave less than a segment behind */
+    if (padding - n > 0 && padding - n < 4) {
+      n -= 4;
+    }
+
+    *pos++ = 0xff;
+    *pos++ = 0xfe;
+    *pos++ = (n - 2) >> 8;
+    *pos++ = (n - 2) & 0xff;
+    memset (pos, ' ', n - 4);
+    pos += n - 4;
+    padding -= n;
+  }
+
+  /* DQT */
+  *pos++ = 0xff;
+  *pos++ = 0xdb;
+  *pos++ = 0x00;
+  *pos++ = 0x43;
+  *pos++ = 0x00;
+  memset (pos, 1, 64);
+  pos += 64;
+
+  /* SOF0 */
+  *pos++ = 0xff;
+  *pos++ = 0xc0;
+  *pos++ = 0x00;
+  *pos++ = 0x0b;
+  *pos++ = 0x08;
+  *pos++ = height >> 8;
+  *pos++ = height & 0xff;
+  *pos++ = width >> 8;
+  *pos++ = width & 0xff;
+  *pos++ = 0x01;
+  *pos++ = 0x01;
+  *pos++ = 0x11;
+  *pos++ = 0x00;
+
+  memcpy (pos, dht, sizeof (dht));
+  pos += sizeof (dht);
+  memcpy (pos, sos, sizeof (sos));
+  pos += sizeof (sos);
+
+  /* All codes are 0 and the last byte is padded with 1 bits */
+  memset (pos, 0, scan);
+  if ((blocks * 2) % 8) {
+    pos[scan - 1] = 0xff >> ((blocks * 2) % 8);
+  }
+  pos += scan;
+
+  *pos++ = 0xff;
+  *pos++ = 0xd9;
+
+  *size = pos - jpeg;
+
+  return jpeg;
+}
+
+static void
+fake_camera_fill (struct fake_camera *cam, unsigned char *data, int stride,
+    int height, unsigned frame)
+{
+  if (cam->config.fill) {
+    memset (data, frame & 0xff, (size_t) stride * height);
+    memset (data + (size_t) stride * height, 128, (size_t) stride * height / 2);
+  } else {
+    /* Enough for a consumer to tell frames apart */
+    memset (data, frame & 0xff, stride);
+  }
+}
+
+static void
+fake_camera_video_frame (struct fake_camera *cam, int64_t timestamp,
+    unsigned frame)
+{
+  camera_data_timestamp_callback cb;
+  camera_memory_t *mem;
+  void *user;
+  int slot = -1;
+  int x;
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (!cam->recording || !(cam->msgs & CAMERA_MSG_VIDEO_FRAME)) {
+    pthread_mutex_unlock (&cam->lock);
+    return;
+  }
+
+  for (x = 0; x < cam->config.video_buffers; x++) {
+    if (!cam->video_busy[x]) {
+      slot = x;
+      break;
+    }
+  }
+
+  if (slot == -1) {
+    /* The application did not give anything back. Drop it */
+    pthread_mutex_unlock (&cam->lock);
+    return;
+  }
+
+  cam->video_busy[slot] = 1;
+  ++cam->video_in_flight;
+  cb = cam->data_cb_timestamp;
+  mem = cam->video_mem;
+  user = cam->user;
+
+  pthread_mutex_unlock (&cam->lock);
+
+  if (cam->metadata) {
+    memcpy ((char *) mem->data + slot * cam->video_size, &frame,
+        sizeof (frame));
+  } else {
+    fake_camera_fill (cam, (unsigned char *) mem->data +
+        slot * cam->video_size, cam->video_width, cam->video_height, frame);
+  }
+
+  cb (timestamp, CAMERA_MSG_VIDEO_FRAME, mem, slot, user);
+
+  pthread_mutex_lock (&cam->lock);
+  --cam->video_in_flight;
+  pthread_cond_broadcast (&cam->cond);
+  pthread_mutex_unlock (&cam->lock);
+}
+
+/* Video frames are tied to preview frames unless they come from a replay */
+static void
+fake_camera_preview_frame (struct fake_camera *cam,
+    struct preview_stream_ops *window, unsigned frame, int with_video)
+{
+  buffer_handle_t *buffer;
+  int stride;
+  void *vaddr;
+  int64_t timestamp;
+  camera_data_callback cb = NULL;
+  void *user = NULL;
+
+  if (window->dequeue_buffer (window, &buffer, &stride) != 0) {
+    /* Everything is downstream. Try again with the next frame */
+    return;
+  }
+
+  window->lock_buffer (window, buffer);
+
+  if (fake_gralloc_module.lock (&fake_gralloc_module, *buffer,
+          GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0, cam->width, cam->height,
+          &vaddr) == 0) {
+    fake_camera_fill (cam, vaddr, stride, cam->height, frame);
+    fake_gralloc_module.unlock (&fake_gralloc_module, *buffer);
+  }
+
+  timestamp = fake_hal_now ();
+  window->set_timestamp (window, timestamp);
+  window->enqueue_buffer (window, buffer);
+
+  pthread_mutex_lock (&cam->lock);
+  if (cam->preview_mem && (cam->msgs & CAMERA_MSG_PREVIEW_FRAME)) {
+    cb = cam->data_cb;
+    user = cam->user;
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  if (cb) {
+    fake_camera_fill (cam, cam->preview_mem->data, cam->width, cam->height,
+        frame);
+    cb (CAMERA_MSG_PREVIEW_FRAME, cam->preview_mem, 0, NULL, user);
+  }
+
+  if (with_video) {
+    fake_camera_video_frame (cam, timestamp, frame);
+  }
+}
+
+/* Needs the lock. Returns 0 if preview got stopped while waiting */
+static int
+fake_camera_wait_until (struct fake_camera *cam, int64_t deadline)
+{
+  struct timespec ts;
+
+  ts.tv_sec = deadline / 1000000000LL;
+  ts.tv_nsec = deadline % 1000000000LL;
+
+  while (cam->previewing && fake_hal_now () < deadline) {
+    pthread_cond_timedwait (&cam->cond, &cam->lock, &ts);
+  }
+
+  return cam->previewing;
+}
+
+static void
+fake_camera_replay_event (struct fake_camera *cam,
+    struct preview_stream_ops *window, const struct fake_replay_event *ev)
+{
+  camera_notify_callback cb = NULL;
+  unsigned frame;
+
+  pthread_mutex_lock (&cam->lock);
+  frame = cam->frame++;
+  if (ev->event == GST_HAL_TRACE_NOTIFY && (cam->msgs & ev->args[0])) {
+    cb = cam->notify_cb;
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  switch (ev->event) {
+    case GST_HAL_TRACE_ENQUEUE_BUFFER:
+      fake_camera_preview_frame (cam, window, frame, 0);
+      break;
+
+    case GST_HAL_TRACE_DATA_TIMESTAMP:
+      fake_camera_video_frame (cam, fake_hal_now (), frame);
+      break;
+
+    case GST_HAL_TRACE_NOTIFY:
+      if (cb) {
+        cb (ev->args[0], ev->args[1], ev->args[2], cam->user);
+      }
+      break;
+  }
+}
+
+/* Needs the lock */
+static void
+fake_camera_replay_loop (struct fake_camera *cam,
+    const struct fake_replay_session *session)
+{
+  int64_t start = fake_hal_now ();
+  int lap = 0;
+  int x = 0;
+
+  while (cam->previewing) {
+    const struct fake_replay_event *ev;
+
+    if (x == session->n_events) {
+      if (session->duration <= 0) {
+        /* Nothing to loop over. Idle until stopped */
+        while (cam->previewing) {
+          pthread_cond_wait (&cam->cond, &cam->lock);
+        }
+        break;
+      }
+
+      start += session->duration;
+      ++lap;
+      x = 0;
+      continue;
+    }
+
+    ev = &session->events[x++];
+
+    /* Notifications happened once */
+    if (lap > 0 && ev->event == GST_HAL_TRACE_NOTIFY) {
+      continue;
+    }
+
+    if (!fake_camera_wait_until (cam, start + ev->time)) {
+      break;
+    }
+
+    pthread_mutex_unlock (&cam->lock);
+
+    fake_camera_replay_event (cam, cam->window, ev);
+
+    pthread_mutex_lock (&cam->lock);
+  }
+}
+
+static void *
+fake_camera_preview_loop (void *data)
+{
+  struct fake_camera *cam = (struct fake_camera *) data;
+  int64_t next = fake_hal_now ();
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->replay && cam->replay->n_sessions > 0) {
+    struct fake_replay *replay = cam->replay;
+
+    fake_camera_replay_loop (cam,
+        &replay->sessions[cam->next_session++ % replay->n_sessions]);
+
+    pthread_mutex_unlock (&cam->lock);
+
+    return NULL;
+  }
+
+  while (cam->previewing) {
+    struct preview_stream_ops *window = cam->window;
+    int fps = cam->config.fps;
+    unsigned frame = cam->frame++;
+
+    if (fps < 0) {
+      fps = fake_camera_param_int (cam->params, "preview-frame-rate", 30);
+    }
+
+    if (fps > 0) {
+      int64_t now = fake_hal_now ();
+
+      next += 1000000000LL / fps;
+
+      /* Do not try to catch up after a stall */
+      if (next < now) {
+        next = now;
+      }
+
+      if (!fake_camera_wait_until (cam, next + fake_camera_jitter (cam))) {
+        break;
+      }
+    }
+
+    pthread_mutex_unlock (&cam->lock);
+
+    fake_camera_preview_frame (cam, window, frame, 1);
+
+    pthread_mutex_lock (&cam->lock);
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+
+  return NULL;
+}
+
+static int
+fake_camera_set_preview_window (struct camera_device *dev,
+    struct preview_stream_ops *window)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->previewing) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EBUSY;
+  }
+
+  cam->window = window;
+
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+static void
+fake_camera_set_callbacks (struct camera_device *dev,
+    camera_notify_callback notify_cb, camera_data_callback data_cb,
+    camera_data_timestamp_callback data_cb_timestamp,
+    camera_request_memory get_memory, void *user)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  cam->notify_cb = notify_cb;
+  cam->data_cb = data_cb;
+  cam->data_cb_timestamp = data_cb_timestamp;
+  cam->get_memory = get_memory;
+  cam->user = user;
+
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static void
+fake_camera_enable_msg_type (struct camera_device *dev, int32_t msg_type)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  cam->msgs |= msg_type;
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static void
+fake_camera_disable_msg_type (struct camera_device *dev, int32_t msg_type)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  cam->msgs &= ~msg_type;
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static int
+fake_camera_msg_type_enabled (struct camera_device *dev, int32_t msg_type)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int ret;
+
+  pthread_mutex_lock (&cam->lock);
+  ret = (cam->msgs & msg_type) == msg_type;
+  pthread_mutex_unlock (&cam->lock);
+
+  return ret;
+}
+
+static int
+fake_camera_start_preview (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  struct preview_stream_ops *window;
+  int width = 0;
+  int height = 0;
+  int min = 0;
+  int err;
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->previewing) {
+    pthread_mutex_unlock (&cam->lock);
+    return 0;
+  }
+
+  window = cam->window;
+
+  if (!window || !fake_camera_param_size (cam->params, "preview-size",
+          &width, &height)) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EINVAL;
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+
+  /* Only start_preview () and stop_preview () change the state */
+  window->get_min_undequeued_buffer_count (window, &min);
+
+  err = window->set_buffer_count (window, cam->config.buffers + min);
+  if (!err) {
+    err = window->set_buffers_geometry (window, width, height, PREVIEW_FORMAT);
+  }
+
+  if (!err) {
+    err = window->set_usage (window, GRALLOC_USAGE_SW_WRITE_OFTEN);
+  }
+
+  if (err) {
+    return err;
+  }
+
+  pthread_mutex_lock (&cam->lock);
+
+  cam->width = width;
+  cam->height = height;
+
+  if (cam->preview_mem) {
+    cam->preview_mem->release (cam->preview_mem);
+  }
+
+  cam->preview_mem = cam->get_memory (-1, (size_t) width * height * 3 / 2, 1,
+      cam->user);
+
+  cam->previewing = 1;
+
+  err = pthread_create (&cam->preview_thread, NULL, fake_camera_preview_loop,
+      cam);
+  if (err) {
+    cam->previewing = 0;
+    err = -err;
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+
+  return err;
+}
+
+static void
+fake_camera_stop_preview (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (!cam->previewing) {
+    pthread_mutex_unlock (&cam->lock);
+    return;
+  }
+
+  cam->previewing = 0;
+  pthread_cond_broadcast (&cam->cond);
+
+  pthread_mutex_unlock (&cam->lock);
+
+  pthread_join (cam->preview_thread, NULL);
+}
+
+static int
+fake_camera_preview_enabled (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int ret;
+
+  pthread_mutex_lock (&cam->lock);
+  ret = cam->previewing;
+  pthread_mutex_unlock (&cam->lock);
+
+  return ret;
+}
+
+static int
+fake_camera_store_meta_data_in_buffers (struct camera_device *dev, int enable)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->recording) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EBUSY;
+  }
+
+  cam->metadata = enable;
+
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+/* Needs the lock */
+static void
+fake_camera_free_video_buffers (struct fake_camera *cam)
+{
+  while (cam->video_in_flight > 0) {
+    pthread_cond_wait (&cam->cond, &cam->lock);
+  }
+
+  if (cam->video_mem) {
+    cam->video_mem->release (cam->video_mem);
+    cam->video_mem = NULL;
+  }
+
+  free (cam->video_busy);
+  cam->video_busy = NULL;
+}
+
+static int
+fake_camera_start_recording (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->recording) {
+    pthread_mutex_unlock (&cam->lock);
+    return 0;
+  }
+
+  if (!cam->previewing) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EINVAL;
+  }
+
+  /* Frames of the previous recording can not be in use anymore */
+  fake_camera_free_video_buffers (cam);
+
+  if (!fake_camera_param_size (cam->params, "video-size", &cam->video_width,
+          &cam->video_height)) {
+    cam->video_width = cam->width;
+    cam->video_height = cam->height;
+  }
+
+  cam->video_size = cam->metadata ? METADATA_SIZE :
+      (size_t) cam->video_width * cam->video_height * 3 / 2;
+  cam->video_mem = cam->get_memory (-1, cam->video_size,
+      cam->config.video_buffers, cam->user);
+  cam->video_busy = calloc (cam->config.video_buffers, 1);
+
+  if (!cam->video_mem || !cam->video_busy) {
+    fake_camera_free_video_buffers (cam);
+    pthread_mutex_unlock (&cam->lock);
+    return -ENOMEM;
+  }
+
+  cam->recording = 1;
+
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+static void
+fake_camera_stop_recording (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  cam->recording = 0;
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static int
+fake_camera_recording_enabled (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int ret;
+
+  pthread_mutex_lock (&cam->lock);
+  ret = cam->recording;
+  pthread_mutex_unlock (&cam->lock);
+
+  return ret;
+}
+
+static void
+fake_camera_release_recording_frame (struct camera_device *dev,
+    const void *opaque)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  const char *data = (const char *) opaque;
+  const char *base;
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->video_mem) {
+    base = (const char *) cam->video_mem->data;
+
+    if (data >= base
+        && data < base + cam->video_size * cam->config.video_buffers) {
+      cam->video_busy[(data - base) / cam->video_size] = 0;
+    }
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static void *
+fake_camera_focus (void *data)
+{
+  struct fake_camera *cam = (struct fake_camera *) data;
+  camera_notify_callback cb = NULL;
+  unsigned id;
+  int64_t delay;
+  int ext1 = 1;
+
+  pthread_mutex_lock (&cam->lock);
+  id = cam->focus_id;
+  delay = cam->config.focus_delay_ms * 1000000LL + fake_camera_jitter (cam);
+
+  if (cam->replay && cam->replay->n_focus > 0) {
+    struct fake_replay_focus *focus =
+        &cam->replay->focus[cam->next_focus++ % cam->replay->n_focus];
+
+    delay = focus->delay;
+    ext1 = focus->ext1;
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  /* A negative delay is a focus which never finished */
+  fake_camera_sleep (delay);
+
+  pthread_mutex_lock (&cam->lock);
+  if (delay >= 0 && id == cam->focus_id && (cam->msgs & CAMERA_MSG_FOCUS)) {
+    cb = cam->notify_cb;
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  if (cb) {
+    cb (CAMERA_MSG_FOCUS, ext1, 0, cam->user);
+  }
+
+  pthread_mutex_lock (&cam->lock);
+  --cam->jobs;
+  pthread_cond_broadcast (&cam->cond);
+  pthread_mutex_unlock (&cam->lock);
+
+  return NULL;
+}
+
+/* Needs the lock */
+static int
+fake_camera_start_job (struct fake_camera *cam, void *(*func) (void *))
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err;
+
+  pthread_attr_init (&attr);
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+  err = pthread_create (&thread, &attr, func, cam);
+
+  pthread_attr_destroy (&attr);
+
+  if (err) {
+    return -err;
+  }
+
+  ++cam->jobs;
+
+  return 0;
+}
+
+static int
+fake_camera_auto_focus (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int err;
+
+  pthread_mutex_lock (&cam->lock);
+  ++cam->focus_id;
+  err = fake_camera_start_job (cam, fake_camera_focus);
+  pthread_mutex_unlock (&cam->lock);
+
+  return err;
+}
+
+static int
+fake_camera_cancel_auto_focus (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  ++cam->focus_id;
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+static void *
+fake_camera_capture (void *data)
+{
+  struct fake_camera *cam = (struct fake_camera *) data;
+  camera_notify_callback notify_cb = NULL;
+  camera_data_callback data_cb = NULL;
+  camera_memory_t *mem = NULL;
+  unsigned char *jpeg = NULL;
+  size_t size = 0;
+  int width = 0;
+  int height = 0;
+  int64_t start = fake_hal_now ();
+  struct fake_replay_capture capture;
+
+  pthread_mutex_lock (&cam->lock);
+  fake_camera_param_size (cam->params, "picture-size", &width, &height);
+
+  if (cam->replay && cam->replay->n_captures > 0) {
+    capture =
+        cam->replay->captures[cam->next_capture++ % cam->replay->n_captures];
+  } else {
+    capture.shutter =
+        cam->config.capture_delay_ms * 1000000LL + fake_camera_jitter (cam);
+    capture.jpeg = capture.shutter;
+    capture.size = cam->config.jpeg_size;
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  if (capture.shutter >= 0) {
+    fake_camera_sleep (start + capture.shutter - fake_hal_now ());
+
+    pthread_mutex_lock (&cam->lock);
+    if (cam->msgs & CAMERA_MSG_SHUTTER) {
+      notify_cb = cam->notify_cb;
+    }
+    pthread_mutex_unlock (&cam->lock);
+
+    if (notify_cb) {
+      notify_cb (CAMERA_MSG_SHUTTER, 0, 0, cam->user);
+    }
+  }
+
+  if (capture.jpeg >= 0) {
+    jpeg = fake_camera_jpeg (width, height, capture.size, &size);
+    fake_camera_sleep (start + capture.jpeg - fake_hal_now ());
+  }
+
+  pthread_mutex_lock (&cam->lock);
+  if (jpeg && (cam->msgs & CAMERA_MSG_COMPRESSED_IMAGE)) {
+    data_cb = cam->data_cb;
+    mem = cam->get_memory (-1, size, 1, cam->user);
+  }
+  pthread_mutex_unlock (&cam->lock);
+
+  if (mem) {
+    memcpy (mem->data, jpeg, size);
+    data_cb (CAMERA_MSG_COMPRESSED_IMAGE, mem, 0, NULL, cam->user);
+    mem->release (mem);
+  }
+
+  free (jpeg);
+
+  pthread_mutex_lock (&cam->lock);
+  --cam->jobs;
+  pthread_cond_broadcast (&cam->cond);
+  pthread_mutex_unlock (&cam->lock);
+
+  return NULL;
+}
+
+static int
+fake_camera_take_picture (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int width;
+  int height;
+  int err;
+
+  pthread_mutex_lock (&cam->lock);
+
+  if (cam->recording) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EBUSY;
+  }
+
+  if (!fake_camera_param_size (cam->params, "picture-size", &width, &height)) {
+    pthread_mutex_unlock (&cam->lock);
+    return -EINVAL;
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+
+  /* Like most hardware, preview stops until start_preview () is called again */
+  fake_camera_stop_preview (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  err = fake_camera_start_job (cam, fake_camera_capture);
+  pthread_mutex_unlock (&cam->lock);
+
+  return err;
+}
+
+static int
+fake_camera_cancel_picture (struct camera_device *dev)
+{
+  return 0;
+}
+
+static int
+fake_camera_set_parameters (struct camera_device *dev, const char *params)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  int width;
+  int height;
+  char *copy;
+
+  if (!fake_camera_param_size (params, "preview-size", &width, &height)
+      || !fake_camera_param_size (params, "picture-size", &width, &height)
+      || !fake_camera_param_supported (params, "preview-size")
+      || !fake_camera_param_supported (params, "preview-frame-rate")
+      || !fake_camera_param_supported (params, "picture-size")
+      || !fake_camera_param_supported (params, "video-size")) {
+    return -EINVAL;
+  }
+
+  copy = strdup (params);
+  if (!copy) {
+    return -ENOMEM;
+  }
+
+  pthread_mutex_lock (&cam->lock);
+  free (cam->params);
+  cam->params = copy;
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+static char *
+fake_camera_get_parameters (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+  char *params;
+
+  pthread_mutex_lock (&cam->lock);
+  params = strdup (cam->params);
+  pthread_mutex_unlock (&cam->lock);
+
+  return params;
+}
+
+static void
+fake_camera_put_parameters (struct camera_device *dev, char *params)
+{
+  free (params);
+}
+
+static int
+fake_camera_send_command (struct camera_device *dev, int32_t cmd,
+    int32_t arg1, int32_t arg2)
+{
+  return 0;
+}
+
+static void
+fake_camera_release (struct camera_device *dev)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  /* A capture can restart preview from the data callback so wait for it */
+  ++cam->focus_id;
+
+  while (cam->jobs > 0) {
+    pthread_cond_wait (&cam->cond, &cam->lock);
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+
+  fake_camera_stop_preview (dev);
+  fake_camera_stop_recording (dev);
+
+  pthread_mutex_lock (&cam->lock);
+
+  fake_camera_free_video_buffers (cam);
+
+  if (cam->preview_mem) {
+    cam->preview_mem->release (cam->preview_mem);
+    cam->preview_mem = NULL;
+  }
+
+  pthread_mutex_unlock (&cam->lock);
+}
+
+static int
+fake_camera_dump (struct camera_device *dev, int fd)
+{
+  struct fake_camera *cam = fake_camera_get (dev);
+
+  pthread_mutex_lock (&cam->lock);
+  dprintf (fd, "fake camera %d: %s, %s, frame %u\n", cam->id,
+      cam->previewing ? "previewing" : "idle",
+      cam->recording ? "recording" : "not recording", cam->frame);
+  pthread_mutex_unlock (&cam->lock);
+
+  return 0;
+}
+
+static camera_device_ops_t fake_camera_ops = {
+  .set_preview_window = fake_camera_set_preview_window,
+  .set_callbacks = fake_camera_set_callbacks,
+  .enable_msg_type = fake_camera_enable_msg_type,
+  .disable_msg_type = fake_camera_disable_msg_type,
+  .msg_type_enabled = fake_camera_msg_type_enabled,
+  .start_preview = fake_camera_start_preview,
+  .stop_preview = fake_camera_stop_preview,
+  .preview_enabled = fake_camera_preview_enabled,
+  .store_meta_data_in_buffers = fake_camera_store_meta_data_in_buffers,
+  .start_recording = fake_camera_start_recording,
+  .stop_recording = fake_camera_stop_recording,
+  .recording_enabled = fake_camera_recording_enabled,
+  .release_recording_frame = fake_camera_release_recording_frame,
+  .auto_focus = fake_camera_auto_focus,
+  .cancel_auto_focus = fake_camera_cancel_auto_focus,
+  .take_picture = fake_camera_take_picture,
+  .cancel_picture = fake_camera_cancel_picture,
+  .set_parameters = fake_camera_set_parameters,
+  .get_parameters = fake_camera_get_parameters,
+  .put_parameters = fake_camera_put_parameters,
+  .send_command = fake_camera_send_command,
+  .release = fake_camera_release,
+  .dump = fake_camera_dump,
+};
+
+static int
+fake_camera_close (struct hw_device_t *device)
+{
+  struct fake_camera *cam = (struct fake_camera *) device;
+
+  fake_camera_release (&cam->dev);
+
+  pthread_cond_destroy (&cam->cond);
+  pthread_mutex_destroy (&cam->lock);
+  fake_replay_free (cam->replay);
+  free (cam->params);
+  free (cam);
+
+  return 0;
+}
+
+static int
+fake_camera_get_number_of_cameras (void)
+{
+  int cameras = fake_hal_env_int ("FAKEHAL_CAMERAS", DEFAULT_CAMERAS);
+
+  if (cameras < 0) {
+    return 0;
+  }
+
+  return cameras > 2 ? 2 : cameras;
+}
+
+static int
+fake_camera_get_camera_info (int camera_id, struct camera_info *info)
+{
+  if (camera_id < 0 || camera_id >= fake_camera_get_number_of_cameras ()) {
+    return -EINVAL;
+  }
+
+  info->facing = camera_id == 0 ? CAMERA_FACING_BACK : CAMERA_FACING_FRONT;
+  info->orientation = camera_id == 0 ? 90 : 270;
+
+  return 0;
+}
+
+static int
+fake_camera_open (const struct hw_module_t *module, const char *name,
+    struct hw_device_t **device)
+{
+  struct fake_camera *cam;
+  pthread_condattr_t attr;
+  char *end;
+  long id = strtol (name, &end, 10);
+
+  if (*end || id < 0 || id >= fake_camera_get_number_of_cameras ()) {
+    return -EINVAL;
+  }
+
+  cam = calloc (1, sizeof (*cam));
+  if (!cam) {
+    return -ENOMEM;
+  }
+
+  if (getenv ("FAKEHAL_REPLAY")) {
+    /* Falls back to made up timing if the trace is no good */
+    cam->replay = fake_replay_load (getenv ("FAKEHAL_REPLAY"));
+  }
+
+  if (cam->replay && cam->replay->params && !getenv ("FAKEHAL_PARAMS")) {
+    cam->params = strdup (cam->replay->params);
+  } else {
+    cam->params = fake_camera_load_params ();
+  }
+
+  if (!cam->params) {
+    fake_replay_free (cam->replay);
+    free (cam);
+    return -ENOMEM;
+  }
+
+  cam->id = id;
+  cam->seed = id;
+
+  cam->config.fps = fake_hal_env_int ("FAKEHAL_FPS", -1);
+  cam->config.jitter_us = fake_hal_env_int ("FAKEHAL_JITTER_US", 0);
+  cam->config.fill = fake_hal_env_int ("FAKEHAL_FILL", 0);
+  cam->config.buffers = fake_hal_env_int ("FAKEHAL_BUFFERS", DEFAULT_BUFFERS);
+  cam->config.video_buffers =
+      fake_hal_env_int ("FAKEHAL_VIDEO_BUFFERS", DEFAULT_VIDEO_BUFFERS);
+  cam->config.capture_delay_ms =
+      fake_hal_env_int ("FAKEHAL_CAPTURE_DELAY_MS", DEFAULT_CAPTURE_DELAY_MS);
+  cam->config.focus_delay_ms =
+      fake_hal_env_int ("FAKEHAL_FOCUS_DELAY_MS", DEFAULT_FOCUS_DELAY_MS);
+  cam->config.jpeg_size =
+      fake_hal_env_int ("FAKEHAL_JPEG_SIZE", DEFAULT_JPEG_SIZE);
+
+  if (cam->config.video_buffers < 1) {
+    cam->config.video_buffers = 1;
+  }
+
+  pthread_mutex_init (&cam->lock, NULL);
+
+  /* The preview loop waits for absolute monotonic deadlines */
+  pthread_condattr_init (&attr);
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+  pthread_cond_init (&cam->cond, &attr);
+  pthread_condattr_destroy (&attr);
+
+  cam->dev.common.tag = HARDWARE_DEVICE_TAG;
+  cam->dev.common.version = HARDWARE_DEVICE_API_VERSION (1, 0);
+  cam->dev.common.module = (struct hw_module_t *) module;
+  cam->dev.common.close = fake_camera_close;
+  cam->dev.ops = &fake_camera_ops;
+  cam->dev.priv = cam;
+
+  *device = &cam->dev.common;
+
+  return 0;
+}
+
+static struct hw_module_methods_t fake_camera_methods = {
+  .open = fake_camera_open,
+};
+
+camera_module_t HAL_MODULE_INFO_SYM = {
+  .common = {
+        .tag = HARDWARE_MODULE_TAG,
+        .module_api_version = CAMERA_MODULE_API_VERSION_1_0,
+        .hal_api_version = HARDWARE_HAL_API_VERSION,
+        .id = CAMERA_HARDWARE_MODULE_ID,
+        .name = "Fake camera",
+        .author = "Jolla LTD.",
+        .methods = &fake_camera_methods,
+      },
+  .get_number_of_cameras = fake_camera_get_number_of_cameras,
+  .get_camera_info = fake_camera_get_camera_info,
+};
+
+int
+hw_get_module_by_class (const char *class_id, const char *inst,
+    const struct hw_module_t **module)
+{
+  if (!strcmp (class_id, CAMERA_HARDWARE_MODULE_ID)) {
+    *module = &HAL_MODULE_INFO_SYM.common;
+    return 0;
+  }
+
+  if (!strcmp (class_id, GRALLOC_HARDWARE_MODULE_ID)) {
+    *module = &fake_gralloc_module.common;
+    return 0;
+  }
+
+  return -ENOENT;
+}
+
+int
+hw_get_module (const char *id, const struct hw_module_t **module)
+{
+  return hw_get_module_by_class (id, NULL, module);
+}
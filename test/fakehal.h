@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __FAKE_HAL_H__
+#define __FAKE_HAL_H__
+
+#include <hardware/hardware.h>
+#include <hardware/camera.h>
+#include <hardware/gralloc.h>
+#include <stdint.h>
+
+#define FAKE_GRALLOC_MAGIC 0x66616b65
+
+/* What our alloc_device_t hands out as buffer_handle_t */
+struct fake_gralloc_handle {
+  native_handle_t base;
+
+  int magic;
+  int width;
+  int height;
+  int stride;
+  int format;
+  int usage;
+  size_t size;
+  void *data;
+};
+
+extern struct gralloc_module_t fake_gralloc_module;
+
+int fake_hal_env_int (const char *name, int def);
+
+int64_t fake_hal_now (void);
+
+/*
+ * A trace recorded by droidcamsrc cut into what the fake camera plays back.
+ * Times are nanoseconds, relative to the start of the session, take_picture ()
+ * or auto_focus (). -1 means it never happened.
+ */
+struct fake_replay_event {
+  int64_t time;
+  int event;                    /* ENQUEUE_BUFFER, DATA_TIMESTAMP or NOTIFY */
+  int32_t args[3];
+};
+
+/* Everything between start_preview () and stop_preview () or take_picture () */
+struct fake_replay_session {
+  struct fake_replay_event *events;
+  int n_events;
+  int64_t duration;
+};
+
+struct fake_replay_capture {
+  int64_t shutter;
+  int64_t jpeg;
+  size_t size;
+};
+
+struct fake_replay_focus {
+  int64_t delay;
+  int ext1;
+};
+
+struct fake_replay {
+  char *params;
+
+  struct fake_replay_session *sessions;
+  int n_sessions;
+
+  struct fake_replay_capture *captures;
+  int n_captures;
+
+  struct fake_replay_focus *focus;
+  int n_focus;
+};
+
+struct fake_replay *fake_replay_load (const char *path);
+void fake_replay_free (struct fake_replay *replay);
+
+#endif /* __FAKE_HAL_H__ */
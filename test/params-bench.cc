@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures the camera parameters API and compares the parser against the
+ * std::map/stringstream based implementation it replaced. Every operation
+ * is reported in ns/op and heap allocations/op. Allocations are counted
+ * by wrapping glibc's malloc so this needs a glibc based system.
+ *
+ * Usage: params-bench [-n iterations] file...
+ * Each file holds one parameter string as returned by get_parameters ()
+ * (see hal-params/).
+ */
+
+#include "cameraparams.h"
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 10000
+
+namespace legacy
+{
+
+typedef std::map < std::string, std::vector < std::string > >Items;
+
+static void
+parse (Items & params, const char *str)
+{
+  std::string s (str);
+
+  std::stringstream stream;
+  stream.str (s);
+  std::string item;
+  Items items;
+
+  while (getline (stream, item, ';')) {
+    std::string key, value;
+    std::vector < std::string > values;
+    std::stringstream i (item);
+
+    if (!getline (i, key, '=')) {
+      continue;
+    }
+
+    while (getline (i, value, ',')) {
+      values.push_back (value);
+    }
+
+    if (values.size () == 0) {
+      continue;
+    }
+
+    items.insert (std::pair < std::string, std::vector < std::string > >(key,
+            values));
+  }
+
+  params = items;
+}
+
+static char *
+to_string (Items & params)
+{
+  std::stringstream stream;
+  Items::iterator end = params.end ();
+  --end;
+
+  for (Items::iterator iter = params.begin (); iter != params.end (); iter++) {
+    stream << iter->first << "=";
+
+    for (unsigned x = 0; x < iter->second.size (); x++) {
+      if (x != 0) {
+        stream << ",";
+      }
+
+      stream << iter->second[x];
+    }
+
+    if (iter != end) {
+      stream << ';';
+    }
+  }
+
+  return strdup (stream.str ().c_str ());
+}
+
+static int
+get_int (Items & params, const char *key)
+{
+  Items::iterator iter = params.find (key);
+  if (iter == params.end () || iter->second.size () == 0) {
+    return 0;
+  }
+
+  return atoi (iter->second[0].c_str ());
+}
+
+}                               /* namespace legacy */
+
+/* Allocation counting */
+extern "C"
+{
+  extern void *__libc_malloc (size_t size);
+  extern void *__libc_calloc (size_t nmemb, size_t size);
+  extern void *__libc_realloc (void *ptr, size_t size);
+}
+
+static bool counting = false;
+static unsigned long allocs = 0;
+
+extern "C" void *
+malloc (size_t size) __THROW
+{
+  if (counting) {
+    allocs++;
+  }
+
+  return __libc_malloc (size);
+}
+
+extern "C" void *
+calloc (size_t nmemb, size_t size) __THROW
+{
+  if (counting) {
+    allocs++;
+  }
+
+  return __libc_calloc (nmemb, size);
+}
+
+extern "C" void *
+realloc (void *ptr, size_t size) __THROW
+{
+  if (counting) {
+    allocs++;
+  }
+
+  return __libc_realloc (ptr, size);
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct bench_ctx
+{
+  std::string str;
+  legacy::Items items;
+  struct camera_params *params;
+  struct camera_params *tmp;
+  int x;
+  int sum;
+};
+
+typedef void (*bench_func) (bench_ctx & ctx);
+
+/*
+ * Runs func iterations times. If setup is given it runs before every
+ * call of func and is neither timed nor counted, which also means each
+ * call of func gets timed on its own.
+ */
+static void
+measure (const char *what, bench_ctx & ctx, int iterations, bench_func func,
+    bench_func setup = NULL, bench_func teardown = NULL)
+{
+  double ns = 0, start;
+
+  allocs = 0;
+
+  if (!setup) {
+    counting = true;
+    start = now ();
+    for (ctx.x = 0; ctx.x < iterations; ctx.x++) {
+      func (ctx);
+    }
+    ns = now () - start;
+    counting = false;
+  } else {
+    for (ctx.x = 0; ctx.x < iterations; ctx.x++) {
+      setup (ctx);
+
+      counting = true;
+      start = now ();
+      func (ctx);
+      ns += now () - start;
+      counting = false;
+
+      if (teardown) {
+        teardown (ctx);
+      }
+    }
+  }
+
+  printf ("  %-24s %10.0f ns/op %8.1f allocs/op\n", what, ns / iterations,
+      (double) allocs / iterations);
+}
+
+static void
+legacy_parse (bench_ctx & ctx)
+{
+  legacy::Items items;
+  legacy::parse (items, ctx.str.c_str ());
+}
+
+static void
+legacy_to_string (bench_ctx & ctx)
+{
+  free (legacy::to_string (ctx.items));
+}
+
+static void
+legacy_get_int (bench_ctx & ctx)
+{
+  ctx.sum += legacy::get_int (ctx.items, "max-zoom");
+}
+
+static void
+from_string (bench_ctx & ctx)
+{
+  camera_params_free (camera_params_from_string (ctx.str.c_str ()));
+}
+
+static void
+to_string (bench_ctx & ctx)
+{
+  free (camera_params_to_string (ctx.params));
+}
+
+static void
+get_int (bench_ctx & ctx)
+{
+  ctx.sum -= camera_params_get_int (ctx.params, "max-zoom");
+}
+
+static void
+get_int_key (bench_ctx & ctx)
+{
+  ctx.sum += camera_params_get_int_key (ctx.params, CAMERA_PARAM_MAX_ZOOM);
+  ctx.sum -= camera_params_get_int (ctx.params, "max-zoom");
+}
+
+static void
+set (bench_ctx & ctx)
+{
+  camera_params_set_int (ctx.params, "zoom", ctx.x & 1);
+}
+
+static void
+set_then_to_string (bench_ctx & ctx)
+{
+  camera_params_set_int (ctx.params, "zoom", ctx.x & 1);
+  free (camera_params_to_string (ctx.params));
+}
+
+static void
+refresh (bench_ctx & ctx)
+{
+  ctx.sum += camera_params_refresh (ctx.params, ctx.str.c_str ());
+}
+
+static void
+copy (bench_ctx & ctx)
+{
+  camera_params_unref (camera_params_copy (ctx.params));
+}
+
+static void
+new_tmp (bench_ctx & ctx)
+{
+  ctx.tmp = camera_params_from_string (ctx.str.c_str ());
+}
+
+static void
+free_tmp (bench_ctx & ctx)
+{
+  camera_params_free (ctx.tmp);
+}
+
+static void
+viewfinder_caps (bench_ctx & ctx)
+{
+  gst_caps_unref (camera_params_get_viewfinder_caps (ctx.tmp));
+}
+
+static void
+capture_caps (bench_ctx & ctx)
+{
+  gst_caps_unref (camera_params_get_capture_caps (ctx.tmp));
+}
+
+static void
+video_caps (bench_ctx & ctx)
+{
+  gst_caps_unref (camera_params_get_video_caps (ctx.tmp));
+}
+
+static void
+cached_viewfinder_caps (bench_ctx & ctx)
+{
+  gst_caps_unref (camera_params_get_viewfinder_caps (ctx.params));
+}
+
+static void
+prepare (bench_ctx & ctx)
+{
+  camera_params_prepare (ctx.tmp);
+}
+
+static bool
+load (const char *path, std::string & str)
+{
+  std::ifstream file (path);
+  std::stringstream stream;
+
+  if (!file) {
+    return false;
+  }
+
+  stream << file.rdbuf ();
+  str = stream.str ();
+
+  while (!str.empty () && (str[str.size () - 1] == '\n'
+          || str[str.size () - 1] == '\r')) {
+    str.erase (str.size () - 1);
+  }
+
+  return true;
+}
+
+static bool
+bench (const char *path, int iterations)
+{
+  bench_ctx ctx;
+
+  if (!load (path, ctx.str)) {
+    std::cerr << "failed to read " << path << std::endl;
+    return false;
+  }
+
+  ctx.params = camera_params_from_string (ctx.str.c_str ());
+  ctx.sum = 0;
+
+  legacy::parse (ctx.items, ctx.str.c_str ());
+
+  /* Both must agree before we compare their speed */
+  char *a = legacy::to_string (ctx.items);
+  char *b = camera_params_to_string (ctx.params);
+  bool same = !strcmp (a, b);
+  free (a);
+  free (b);
+
+  if (!same) {
+    std::cerr << path << ": serialized parameters differ" << std::endl;
+    camera_params_free (ctx.params);
+    return false;
+  }
+
+  printf ("%s: %u bytes, %u keys\n", path, (unsigned) ctx.str.size (),
+      (unsigned) ctx.items.size ());
+
+  measure ("legacy parse", ctx, iterations, legacy_parse);
+  measure ("from_string", ctx, iterations, from_string);
+  measure ("legacy serialize", ctx, iterations, legacy_to_string);
+  measure ("to_string", ctx, iterations, to_string);
+  measure ("legacy lookup", ctx, iterations, legacy_get_int);
+  measure ("get_int", ctx, iterations, get_int);
+  measure ("get_int_key", ctx, iterations, get_int_key);
+  measure ("set", ctx, iterations, set);
+  measure ("set + to_string", ctx, iterations, set_then_to_string);
+  measure ("refresh", ctx, iterations, refresh);
+  measure ("copy", ctx, iterations, copy);
+  measure ("get_viewfinder_caps", ctx, iterations, viewfinder_caps, new_tmp,
+      free_tmp);
+  measure ("get_capture_caps", ctx, iterations, capture_caps, new_tmp,
+      free_tmp);
+  measure ("get_video_caps", ctx, iterations, video_caps, new_tmp, free_tmp);
+  measure ("get_viewfinder_caps cached", ctx, iterations,
+      cached_viewfinder_caps);
+  measure ("prepare", ctx, iterations, prepare, new_tmp, free_tmp);
+
+  camera_params_free (ctx.params);
+
+  return ctx.sum == 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = DEFAULT_ITERATIONS;
+  int ret = 0;
+  int x = 1;
+
+  /* Make GSlice allocations visible to the counters */
+  setenv ("G_SLICE", "always-malloc", 1);
+
+  gst_init (&argc, &argv);
+
+  if (argc > 2 && !strcmp (argv[1], "-n")) {
+    iterations = atoi (argv[2]);
+    x = 3;
+  }
+
+  if (x >= argc || iterations <= 0) {
+    std::cerr << "usage: " << argv[0] << " [-n iterations] file..." <<
+        std::endl;
+    return 1;
+  }
+
+  for (; x < argc; x++) {
+    if (!bench (argv[x], iterations)) {
+      ret = 1;
+    }
+  }
+
+  return ret;
+}
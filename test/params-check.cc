@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Deterministic checks of the camera parameters API. Fails with the line
+ * of the first check that does not hold.
+ */
+
+#include "cameraparams.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+          #cond);                                                       \
+      abort ();                                                         \
+    }                                                                   \
+  } while (0)
+
+static void
+check_fps_range (struct camera_params *params, int fps, gboolean variable,
+    int min, int max)
+{
+  char str[32];
+  int lo, hi;
+
+  CHECK (camera_params_set_viewfinder_fps_range (params, fps, 1, variable,
+          &lo, &hi));
+  CHECK (lo == min && hi == max);
+
+  snprintf (str, sizeof (str), "%d,%d", min, max);
+  CHECK (!strcmp (camera_params_get_key (params,
+              CAMERA_PARAM_PREVIEW_FPS_RANGE), str));
+}
+
+/* The caps offer every rate within a range so all of them have to work */
+static void
+check_fps_ranges (void)
+{
+  struct camera_params *params =
+      camera_params_from_string ("preview-fps-range-values="
+      "(15000,30000),(7500,30000),(30000,30000);"
+      "preview-frame-rate-values=30;preview-fps-range=30000,30000");
+  int lo, hi;
+
+  /* Ranges topping out at the rate win */
+  check_fps_range (params, 30, TRUE, 7500, 30000);
+  check_fps_range (params, 30, FALSE, 30000, 30000);
+
+  /* Strictly inside a range */
+  check_fps_range (params, 24, TRUE, 7500, 24000);
+  check_fps_range (params, 24, FALSE, 15000, 24000);
+  check_fps_range (params, 10, FALSE, 7500, 10000);
+
+  CHECK (!camera_params_set_viewfinder_fps_range (params, 60, 1, TRUE, &lo,
+          &hi));
+  CHECK (!camera_params_set_viewfinder_fps_range (params, 5, 1, TRUE, &lo,
+          &hi));
+
+  camera_params_unref (params);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+
+  check_fps_ranges ();
+
+  printf ("OK\n");
+
+  return 0;
+}
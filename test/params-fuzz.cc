@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2013 Jolla LTD.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Feeds arbitrary strings to the camera parameters API and aborts if
+ * anything does not round trip.
+ *
+ * As a libFuzzer target:
+ *   clang++ -g -fsanitize=fuzzer,address -DPARAMS_FUZZ_LIBFUZZER \
+ *     -I../gst/droidcamsrc `pkg-config --cflags --libs gstreamer-0.10` \
+ *     params-fuzz.cc ../gst/droidcamsrc/cameraparams.cc -o params-fuzz
+ *   ./params-fuzz hal-params/
+ *
+ * Otherwise it runs every file given on the command line and then
+ * mutations of them:
+ *   params-fuzz [-n mutations] [-s seed] file...
+ */
+
+#include "cameraparams.h"
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+
+#define DEFAULT_MUTATIONS 100000
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+          #cond);                                                       \
+      abort ();                                                         \
+    }                                                                   \
+  } while (0)
+
+static const char *const keys[] = {
+  "",
+  "=",
+  "zoom",
+  "max-zoom",
+  "missing-key",
+  "preview-size-values",
+  "preview-frame-rate-values",
+  "picture-size-values",
+  "video-size-values",
+  "flash-mode-values",
+};
+
+static void
+check_caps (GstCaps * caps)
+{
+  CHECK (caps != NULL);
+  gst_caps_unref (caps);
+}
+
+static void
+run (const char *str)
+{
+  struct camera_params *params = camera_params_from_string (str);
+  struct camera_params *copy;
+  char *first, *second;
+  int x;
+
+  /* Serializing what we parsed must be stable */
+  first = camera_params_to_string (params);
+  copy = camera_params_from_string (first);
+  second = camera_params_to_string (copy);
+  CHECK (!strcmp (first, second));
+  camera_params_unref (copy);
+  free (second);
+
+  /* Refreshing with the same string changes nothing */
+  CHECK (camera_params_refresh (params, str) == 0);
+  CHECK (!camera_params_is_dirty (params));
+
+  for (x = 0; x < (int) (sizeof (keys) / sizeof (keys[0])); x++) {
+    camera_params_get_int (params, keys[x]);
+  }
+
+  for (x = 0; x < CAMERA_PARAM_LAST; x++) {
+    const char *val = camera_params_get_key (params, (CameraParamKey) x);
+
+    camera_params_get_int_key (params, (CameraParamKey) x);
+    camera_params_get_float_key (params, (CameraParamKey) x);
+
+    if (val) {
+      /* The HAL gave it to us so it has to be good enough */
+      camera_params_is_supported (params, (CameraParamKey) x, val);
+    }
+  }
+
+  check_caps (camera_params_get_viewfinder_caps (params));
+  check_caps (camera_params_get_capture_caps (params));
+  check_caps (camera_params_get_video_caps (params));
+
+  /* Snapshots must not see changes made to their copies */
+  camera_params_prepare (params);
+  copy = camera_params_copy (params);
+
+  for (x = 0; x < (int) (sizeof (keys) / sizeof (keys[0])); x++) {
+    if (keys[x][0]) {
+      camera_params_set (copy, keys[x], str[0] ? str : "1");
+    }
+  }
+
+  camera_params_set_viewfinder_size (copy, 640, 480);
+  camera_params_set_viewfinder_fps (copy, 30);
+  camera_params_refresh (copy, str);
+  CHECK (camera_params_is_dirty (copy));
+  check_caps (camera_params_get_viewfinder_caps (copy));
+  free (camera_params_to_string (copy));
+  camera_params_unref (copy);
+
+  second = camera_params_to_string (params);
+  CHECK (!strcmp (first, second));
+  free (first);
+  free (second);
+
+  camera_params_unref (params);
+}
+
+#ifdef PARAMS_FUZZ_LIBFUZZER
+
+/* The caps run () builds need the types gst_init () registers */
+extern "C" int
+LLVMFuzzerInitialize (int *argc, char ***argv)
+{
+  gst_init (argc, argv);
+
+  return 0;
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t * data, size_t size)
+{
+  /* The HAL hands us a C string */
+  std::string str ((const char *) data, size);
+
+  run (str.c_str ());
+
+  return 0;
+}
+
+#else
+
+static bool
+load (const char *path, std::string & str)
+{
+  std::ifstream file (path);
+  std::stringstream stream;
+
+  if (!file) {
+    return false;
+  }
+
+  stream << file.rdbuf ();
+  str = stream.str ();
+
+  return true;
+}
+
+/* Separators and the characters values are made of are the interesting bits */
+static char
+random_char (void)
+{
+  static const char alphabet[] = "=;,x0123456789-abz ";
+
+  if (rand () % 4) {
+    return alphabet[rand () % (sizeof (alphabet) - 1)];
+  }
+
+  return 1 + rand () % 255;
+}
+
+static void
+mutate (std::string & str)
+{
+  int ops = 1 + rand () % 8;
+
+  while (ops--) {
+    size_t pos = str.empty ()? 0 : rand () % (str.size () + 1);
+
+    switch (rand () % 4) {
+      case 0:
+        str.insert (pos, 1, random_char ());
+        break;
+      case 1:
+        if (pos < str.size ()) {
+          str.erase (pos, 1 + rand () % 16);
+        }
+        break;
+      case 2:
+        if (pos < str.size ()) {
+          str[pos] = random_char ();
+        }
+        break;
+      case 3:
+        /* Duplicate a piece so keys show up more than once */
+        if (pos < str.size ()) {
+          str.insert (rand () % (str.size () + 1), str.substr (pos,
+                  1 + rand () % 64));
+        }
+        break;
+    }
+  }
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::vector < std::string > corpus;
+  int mutations = DEFAULT_MUTATIONS;
+  unsigned seed = 0;
+  int x;
+
+  gst_init (&argc, &argv);
+
+  for (x = 1; x < argc; x++) {
+    std::string str;
+
+    if (!strcmp (argv[x], "-n") && x + 1 < argc) {
+      mutations = atoi (argv[++x]);
+      continue;
+    }
+
+    if (!strcmp (argv[x], "-s") && x + 1 < argc) {
+      seed = strtoul (argv[++x], NULL, 10);
+      continue;
+    }
+
+    if (!load (argv[x], str)) {
+      std::cerr << "failed to read " << argv[x] << std::endl;
+      return 1;
+    }
+
+    corpus.push_back (str);
+  }
+
+  /* Things which are easy to get wrong */
+  corpus.push_back ("");
+  corpus.push_back (";");
+  corpus.push_back ("=");
+  corpus.push_back ("==;;==");
+  corpus.push_back ("a");
+  corpus.push_back ("a=");
+  corpus.push_back ("=b");
+  corpus.push_back ("a=b;a=c");
+  corpus.push_back ("b=1;a=2;b=3");
+  corpus.push_back ("preview-size-values=x,1x,x1,0x0,-1x-1,640x480,");
+  corpus.push_back ("preview-frame-rate-values=,,0,-5,30;"
+      "preview-size-values=640x480");
+  corpus.push_back ("max-zoom=99999999999999999999;zoom=-");
+
+  for (x = 0; x < (int) corpus.size (); x++) {
+    run (corpus[x].c_str ());
+  }
+
+  srand (seed);
+
+  for (x = 0; x < mutations; x++) {
+    std::string str = corpus[rand () % corpus.size ()];
+
+    mutate (str);
+
+    run (str.c_str ());
+  }
+
+  printf ("%u inputs, %d mutations, seed %u: OK\n",
+      (unsigned) corpus.size (), mutations, seed);
+
+  return 0;
+}
+
+#endif /* PARAMS_FUZZ_LIBFUZZER */